@@ -0,0 +1,996 @@
+/**
+ * @file align.c
+ * @brief Smith-Waterman local alignment of a probe against a reference (part of libdnamatch)
+ * @author George Fotiou
+ * @date 01/10/2025
+ *
+ * The best local alignment score is computed with Farrar's striped SIMD
+ * algorithm: the probe is laid out in stripes across the lanes of a 128-bit
+ * register so that the cells updated together never depend on each other,
+ * and vertical gaps are fixed up afterwards by the "lazy F" loop. Each
+ * reference chunk is first scored in sixteen saturating 8-bit lanes; if the
+ * score saturates it is redone in eight 16-bit lanes, and beyond that with
+ * plain integers. Gaps are affine: a gap of L bases costs
+ * gapOpen + (L - 1) * gapExtend.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "dnamatch.h"
+#include "dnamatchInternal.h"
+
+/** Reference positions per chunk handed to one thread */
+#define ALIGN_CHUNK 65536
+
+/** Diagonals an approximate match may drift beyond those of its seeds (insertions minus deletions) */
+#define APPROX_MAX_DRIFT 16
+
+/** Profile rows: A, C, G, T and anything else (which never matches) */
+#define ALIGN_CODES 5
+
+/** A best score and the first reference position where it is reached */
+typedef struct {
+    int score;  /**< Best score, 0 if nothing aligns */
+    int end;    /**< Reference position of the last aligned base, -1 if none */
+} AlignHit;
+
+/**
+ * @brief Maps a base to its profile row
+ * @param base Base character
+ * @return 0-3 for A, C, G, T, 4 for anything else
+ */
+static inline int profileCode(char base) {
+    int code = encodeBase(base);
+    return code < 0 ? 4 : code;
+}
+
+/**
+ * @brief Scores one pair of bases
+ * @param scoring Scores
+ * @param queryCode Profile row of the probe base
+ * @param textCode Profile row of the reference base
+ * @return Match score if both are the same real base, else the mismatch score
+ */
+static inline int pairScore(const DnaAlignScoring* scoring, int queryCode, int textCode) {
+    return queryCode == textCode && queryCode < 4 ? scoring->match : scoring->mismatch;
+}
+
+/**
+ * @brief Scalar Gotoh local alignment, used when the 16-bit lanes overflow
+ * @param query Probe
+ * @param queryLen Length of the probe
+ * @param text Reference slice
+ * @param textLen Length of the slice
+ * @param scoring Scores
+ * @param hit Receives the best score and where it ends in the slice
+ * @return 0 on success, -1 on error
+ */
+static int alignScalar(const char* query, int queryLen, const char* text, int textLen,
+                       const DnaAlignScoring* scoring, AlignHit* hit) {
+    int* h = (int*)trackedCalloc(queryLen + 1, sizeof(int));
+    int* e = (int*)trackedCalloc(queryLen + 1, sizeof(int));
+    int i, j;
+
+    if (h == NULL || e == NULL) {
+        free(h);
+        free(e);
+        return -1;
+    }
+
+    hit->score = 0;
+    hit->end = -1;
+    for (j = 0; j < textLen; j++) {
+        int textCode = profileCode(text[j]);
+        int diagonal = 0;
+        int f = 0;
+        for (i = 1; i <= queryLen; i++) {
+            // e[i]: gap in the probe, f: gap in the reference
+            int up = h[i];
+            e[i] = e[i] - scoring->gapExtend > up - scoring->gapOpen ?
+                   e[i] - scoring->gapExtend : up - scoring->gapOpen;
+            f = f - scoring->gapExtend > h[i - 1] - scoring->gapOpen ?
+                f - scoring->gapExtend : h[i - 1] - scoring->gapOpen;
+            int score = diagonal + pairScore(scoring, profileCode(query[i - 1]), textCode);
+            if (score < e[i]) {
+                score = e[i];
+            }
+            if (score < f) {
+                score = f;
+            }
+            if (score < 0) {
+                score = 0;
+            }
+            diagonal = up;
+            h[i] = score;
+            if (score > hit->score) {
+                hit->score = score;
+                hit->end = j;
+            }
+        }
+    }
+
+    free(h);
+    free(e);
+    return 0;
+}
+
+#ifdef __SSE2__
+
+/**
+ * @brief Allocates a zeroed block aligned for 128-bit loads
+ * @param size Number of bytes
+ * @param memory Receives the pointer to free()
+ * @return Aligned pointer, or NULL on error
+ */
+static void* alignedCalloc(size_t size, void** memory) {
+    *memory = trackedCalloc(size + 15, 1);
+    if (*memory == NULL) {
+        return NULL;
+    }
+    return (void*)(((uintptr_t)*memory + 15) & ~(uintptr_t)15);
+}
+
+/** Striped query profiles and sizes shared by all threads */
+typedef struct {
+    int segments8;        /**< Vectors per column with 16 lanes */
+    int segments16;       /**< Vectors per column with 8 lanes */
+    int bias;             /**< Added to every 8-bit profile entry to keep it unsigned */
+    __m128i* profile8;    /**< ALIGN_CODES x segments8 vectors */
+    __m128i* profile16;   /**< ALIGN_CODES x segments16 vectors */
+    void* memory8;        /**< Allocation holding profile8 */
+    void* memory16;       /**< Allocation holding profile16 */
+} StripedProfile;
+
+/**
+ * @brief Builds the striped 8-bit and 16-bit query profiles
+ *
+ * Lane k of segment s holds probe position k * segments + s. Positions past
+ * the end of the probe score as mismatches, which can never raise the best
+ * score since they only extend alignments past the probe's last base.
+ *
+ * @param query Probe
+ * @param queryLen Length of the probe
+ * @param scoring Scores
+ * @param profile Receives the profiles
+ * @return 0 on success, -1 on error
+ */
+static int buildProfiles(const char* query, int queryLen, const DnaAlignScoring* scoring,
+                         StripedProfile* profile) {
+    int code, s, k;
+
+    profile->segments8 = (queryLen + 15) / 16;
+    profile->segments16 = (queryLen + 7) / 8;
+    profile->bias = -scoring->mismatch;
+    profile->profile8 = (__m128i*)alignedCalloc(ALIGN_CODES * profile->segments8 * sizeof(__m128i),
+                                                &profile->memory8);
+    profile->profile16 = (__m128i*)alignedCalloc(ALIGN_CODES * profile->segments16 * sizeof(__m128i),
+                                                 &profile->memory16);
+    if (profile->profile8 == NULL || profile->profile16 == NULL) {
+        free(profile->memory8);
+        free(profile->memory16);
+        return -1;
+    }
+
+    for (code = 0; code < ALIGN_CODES; code++) {
+        uint8_t* row8 = (uint8_t*)(profile->profile8 + code * profile->segments8);
+        int16_t* row16 = (int16_t*)(profile->profile16 + code * profile->segments16);
+        for (s = 0; s < profile->segments8; s++) {
+            for (k = 0; k < 16; k++) {
+                int position = k * profile->segments8 + s;
+                int score = position < queryLen ? pairScore(scoring, profileCode(query[position]), code)
+                                                : scoring->mismatch;
+                row8[s * 16 + k] = (uint8_t)(score + profile->bias);
+            }
+        }
+        for (s = 0; s < profile->segments16; s++) {
+            for (k = 0; k < 8; k++) {
+                int position = k * profile->segments16 + s;
+                row16[s * 8 + k] = (int16_t)(position < queryLen ?
+                                   pairScore(scoring, profileCode(query[position]), code) :
+                                   scoring->mismatch);
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Horizontal maximum of sixteen unsigned bytes
+ * @param v Vector
+ * @return Largest lane
+ */
+static inline int maxLane8(__m128i v) {
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 8));
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 4));
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 2));
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 1));
+    return _mm_cvtsi128_si32(v) & 0xff;
+}
+
+/**
+ * @brief Horizontal maximum of eight signed 16-bit words
+ * @param v Vector
+ * @return Largest lane
+ */
+static inline int maxLane16(__m128i v) {
+    v = _mm_max_epi16(v, _mm_srli_si128(v, 8));
+    v = _mm_max_epi16(v, _mm_srli_si128(v, 4));
+    v = _mm_max_epi16(v, _mm_srli_si128(v, 2));
+    return (int16_t)_mm_cvtsi128_si32(v);
+}
+
+/**
+ * @brief Striped Smith-Waterman in sixteen saturating unsigned 8-bit lanes
+ * @param profile Striped profiles
+ * @param text Reference slice
+ * @param textLen Length of the slice
+ * @param scoring Scores
+ * @param hit Receives the best score and where it ends in the slice
+ * @return 0 on success, 1 if the score saturated, -1 on error
+ */
+static int alignStriped8(const StripedProfile* profile, const char* text, int textLen,
+                         const DnaAlignScoring* scoring, AlignHit* hit) {
+    int segments = profile->segments8;
+    void* memory;
+    __m128i* buffers = (__m128i*)alignedCalloc(3 * segments * sizeof(__m128i), &memory);
+    if (buffers == NULL) {
+        return -1;
+    }
+    __m128i* hStore = buffers;
+    __m128i* hLoad = buffers + segments;
+    __m128i* eColumn = buffers + 2 * segments;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i gapOpen = _mm_set1_epi8((char)scoring->gapOpen);
+    const __m128i gapExtend = _mm_set1_epi8((char)scoring->gapExtend);
+    const __m128i bias = _mm_set1_epi8((char)profile->bias);
+    __m128i best = zero;
+    int j, s, k;
+
+    hit->score = 0;
+    hit->end = -1;
+    for (j = 0; j < textLen; j++) {
+        const __m128i* scores = profile->profile8 + profileCode(text[j]) * segments;
+        __m128i columnMax = zero;
+        __m128i f = zero;
+        // Diagonal for the first segment: last segment of the previous column, moved up one lane
+        __m128i h = _mm_slli_si128(hStore[segments - 1], 1);
+        __m128i* swap = hLoad;
+        hLoad = hStore;
+        hStore = swap;
+
+        for (s = 0; s < segments; s++) {
+            h = _mm_subs_epu8(_mm_adds_epu8(h, scores[s]), bias);
+            __m128i e = eColumn[s];
+            h = _mm_max_epu8(h, e);
+            h = _mm_max_epu8(h, f);
+            columnMax = _mm_max_epu8(columnMax, h);
+            hStore[s] = h;
+            h = _mm_subs_epu8(h, gapOpen);
+            eColumn[s] = _mm_max_epu8(_mm_subs_epu8(e, gapExtend), h);
+            f = _mm_max_epu8(_mm_subs_epu8(f, gapExtend), h);
+            h = hLoad[s];
+        }
+
+        // Lazy F: carry vertical gaps across lane boundaries until they stop mattering.
+        // A cell raised by f opens gaps of its own, which beat extending f when
+        // gapOpen < gapExtend, so f carries both like the first pass does
+        for (k = 0; k < 16; k++) {
+            f = _mm_slli_si128(f, 1);
+            for (s = 0; s < segments; s++) {
+                __m128i opened = _mm_subs_epu8(hStore[s], gapOpen);
+                h = _mm_max_epu8(hStore[s], f);
+                hStore[s] = h;
+                columnMax = _mm_max_epu8(columnMax, h);
+                h = _mm_subs_epu8(h, gapOpen);
+                eColumn[s] = _mm_max_epu8(eColumn[s], h);
+                f = _mm_max_epu8(_mm_subs_epu8(f, gapExtend), h);
+                // Stop once no lane of f exceeds the gaps the first pass already opened here
+                if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(f, opened), zero)) == 0xffff) {
+                    goto lazyDone;
+                }
+            }
+        }
+lazyDone:
+
+        // Only look for the new maximum when some lane beat the old one
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(columnMax, best), zero)) != 0xffff) {
+            hit->score = maxLane8(columnMax);
+            hit->end = j;
+            best = _mm_set1_epi8((char)hit->score);
+            if (hit->score + profile->bias >= 255) {
+                free(memory);
+                return 1;
+            }
+        }
+    }
+
+    free(memory);
+    return 0;
+}
+
+/**
+ * @brief Striped Smith-Waterman in eight saturating signed 16-bit lanes
+ * @param profile Striped profiles
+ * @param text Reference slice
+ * @param textLen Length of the slice
+ * @param scoring Scores
+ * @param hit Receives the best score and where it ends in the slice
+ * @return 0 on success, 1 if the score saturated, -1 on error
+ */
+static int alignStriped16(const StripedProfile* profile, const char* text, int textLen,
+                          const DnaAlignScoring* scoring, AlignHit* hit) {
+    int segments = profile->segments16;
+    void* memory;
+    __m128i* buffers = (__m128i*)alignedCalloc(3 * segments * sizeof(__m128i), &memory);
+    if (buffers == NULL) {
+        return -1;
+    }
+    __m128i* hStore = buffers;
+    __m128i* hLoad = buffers + segments;
+    __m128i* eColumn = buffers + 2 * segments;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i gapOpen = _mm_set1_epi16((short)scoring->gapOpen);
+    const __m128i gapExtend = _mm_set1_epi16((short)scoring->gapExtend);
+    __m128i best = zero;
+    int j, s, k;
+
+    hit->score = 0;
+    hit->end = -1;
+    for (j = 0; j < textLen; j++) {
+        const __m128i* scores = profile->profile16 + profileCode(text[j]) * segments;
+        __m128i columnMax = zero;
+        __m128i f = zero;
+        __m128i h = _mm_slli_si128(hStore[segments - 1], 2);
+        __m128i* swap = hLoad;
+        hLoad = hStore;
+        hStore = swap;
+
+        for (s = 0; s < segments; s++) {
+            h = _mm_max_epi16(_mm_adds_epi16(h, scores[s]), zero);
+            __m128i e = eColumn[s];
+            h = _mm_max_epi16(h, e);
+            h = _mm_max_epi16(h, f);
+            columnMax = _mm_max_epi16(columnMax, h);
+            hStore[s] = h;
+            h = _mm_subs_epi16(h, gapOpen);
+            eColumn[s] = _mm_max_epi16(_mm_subs_epi16(e, gapExtend), h);
+            f = _mm_max_epi16(_mm_subs_epi16(f, gapExtend), h);
+            h = hLoad[s];
+        }
+
+        for (k = 0; k < 8; k++) {
+            f = _mm_slli_si128(f, 2);
+            for (s = 0; s < segments; s++) {
+                __m128i opened = _mm_subs_epi16(hStore[s], gapOpen);
+                h = _mm_max_epi16(hStore[s], f);
+                hStore[s] = h;
+                columnMax = _mm_max_epi16(columnMax, h);
+                h = _mm_subs_epi16(h, gapOpen);
+                eColumn[s] = _mm_max_epi16(eColumn[s], h);
+                f = _mm_max_epi16(_mm_subs_epi16(f, gapExtend), h);
+                if (_mm_movemask_epi8(_mm_cmpgt_epi16(f, opened)) == 0) {
+                    goto lazyDone;
+                }
+            }
+        }
+lazyDone:
+
+        if (_mm_movemask_epi8(_mm_cmpgt_epi16(columnMax, best)) != 0) {
+            hit->score = maxLane16(columnMax);
+            hit->end = j;
+            best = _mm_set1_epi16((short)hit->score);
+            if (hit->score >= 32767 - scoring->match) {
+                free(memory);
+                return 1;
+            }
+        }
+    }
+
+    free(memory);
+    return 0;
+}
+
+#endif
+
+/** State shared by the threads of dnaAlignBest() */
+typedef struct {
+    const char* query;               /**< Probe */
+    int queryLen;                    /**< Length of the probe */
+    const char* text;                /**< Reference */
+    int textLen;                     /**< Length of the reference */
+    const DnaAlignScoring* scoring;  /**< Scores */
+    int overlap;                     /**< Longest reference span of any alignment */
+    int chunkCount;                  /**< Number of chunks */
+    AlignHit* hits;                  /**< Best hit of every chunk, in reference coordinates */
+    atomic_int nextChunk;            /**< Next chunk to claim */
+    atomic_int widest;               /**< Widest lanes used: 8, 16 or 32 bits */
+    atomic_int failed;               /**< Set if a thread ran out of memory */
+#ifdef __SSE2__
+    StripedProfile profile;          /**< Striped profiles, shared read-only */
+#endif
+} AlignWork;
+
+/**
+ * @brief Alignment worker: claims chunks and scores each one
+ *
+ * A chunk [from, to) is aligned from from - overlap, so every alignment
+ * ending inside it is seen whole.
+ *
+ * @param arg The shared AlignWork
+ * @return NULL
+ */
+static void* alignWorker(void* arg) {
+    AlignWork* work = (AlignWork*)arg;
+    int chunk;
+
+    while ((chunk = atomic_fetch_add(&work->nextChunk, 1)) < work->chunkCount) {
+        int to = (chunk + 1) * ALIGN_CHUNK < work->textLen ? (chunk + 1) * ALIGN_CHUNK : work->textLen;
+        int from = chunk * ALIGN_CHUNK - work->overlap > 0 ? chunk * ALIGN_CHUNK - work->overlap : 0;
+        const char* slice = work->text + from;
+        AlignHit hit;
+        int status = 1;
+        int bits = 8;
+
+#ifdef __SSE2__
+        status = alignStriped8(&work->profile, slice, to - from, work->scoring, &hit);
+        if (status == 1) {
+            bits = 16;
+            status = alignStriped16(&work->profile, slice, to - from, work->scoring, &hit);
+        }
+#endif
+        if (status == 1) {
+            bits = 32;
+            status = alignScalar(work->query, work->queryLen, slice, to - from, work->scoring, &hit);
+        }
+        if (status != 0) {
+            atomic_store(&work->failed, 1);
+            continue;
+        }
+
+        int widest = atomic_load(&work->widest);
+        while (bits > widest && !atomic_compare_exchange_weak(&work->widest, &widest, bits)) {
+        }
+        work->hits[chunk].score = hit.score;
+        work->hits[chunk].end = hit.end < 0 ? -1 : from + hit.end;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Finds where the best alignment ending at a position starts
+ *
+ * Re-runs a scalar alignment over the span that can hold the alignment,
+ * carrying the start of every cell along, and returns the start of a cell in
+ * the end column that reaches the best score.
+ *
+ * @param query Probe
+ * @param queryLen Length of the probe
+ * @param text Reference
+ * @param end Reference position of the last aligned base
+ * @param overlap Longest reference span of any alignment
+ * @param scoring Scores
+ * @param score Best score
+ * @return Reference position of the first aligned base, -1 if memory ran out,
+ *         or -2 if no cell of the end column reaches the score
+ */
+static int alignmentStart(const char* query, int queryLen, const char* text, int end, int overlap,
+                          const DnaAlignScoring* scoring, int score) {
+    int from = end - overlap + 1 > 0 ? end - overlap + 1 : 0;
+    int* h = (int*)trackedCalloc(queryLen + 1, sizeof(int));
+    int* e = (int*)trackedCalloc(queryLen + 1, sizeof(int));
+    int* hStart = (int*)trackedCalloc(queryLen + 1, sizeof(int));
+    int* eStart = (int*)trackedCalloc(queryLen + 1, sizeof(int));
+    int start = -1;
+    int i, j;
+
+    if (h == NULL || e == NULL || hStart == NULL || eStart == NULL) {
+        free(h);
+        free(e);
+        free(hStart);
+        free(eStart);
+        return -1;
+    }
+
+    for (j = from; j <= end && start < 0; j++) {
+        int textCode = profileCode(text[j]);
+        int diagonal = 0;
+        int diagonalStart = j;
+        int f = 0;
+        int fStart = j;
+        for (i = 1; i <= queryLen; i++) {
+            int up = h[i];
+            int upStart = hStart[i];
+            if (e[i] - scoring->gapExtend > up - scoring->gapOpen) {
+                e[i] -= scoring->gapExtend;
+            } else {
+                e[i] = up - scoring->gapOpen;
+                eStart[i] = upStart;
+            }
+            if (f - scoring->gapExtend <= h[i - 1] - scoring->gapOpen) {
+                f = h[i - 1] - scoring->gapOpen;
+                fStart = hStart[i - 1];
+            } else {
+                f -= scoring->gapExtend;
+            }
+
+            int cell = diagonal + pairScore(scoring, profileCode(query[i - 1]), textCode);
+            int cellStart = diagonal > 0 ? diagonalStart : j;
+            if (cell < e[i]) {
+                cell = e[i];
+                cellStart = eStart[i];
+            }
+            if (cell < f) {
+                cell = f;
+                cellStart = fStart;
+            }
+            if (cell <= 0) {
+                cell = 0;
+                cellStart = j + 1;
+            }
+            diagonal = up;
+            diagonalStart = upStart;
+            h[i] = cell;
+            hStart[i] = cellStart;
+            if (j == end && cell == score) {
+                start = cellStart;
+                break;
+            }
+        }
+        // The next column's fresh alignments start there
+        if (j < end) {
+            for (i = 0; i <= queryLen; i++) {
+                if (h[i] == 0) {
+                    hStart[i] = j + 1;
+                }
+            }
+        }
+    }
+
+    free(h);
+    free(e);
+    free(hStart);
+    free(eStart);
+    return start >= 0 ? start : -2;
+}
+
+/**
+ * @brief Finds the best local alignment of a probe anywhere in a reference
+ * @param query Probe
+ * @param queryLen Length of the probe, at least 1
+ * @param text Reference
+ * @param textLen Length of the reference
+ * @param scoring Scores: match > 0, mismatch <= 0, gapOpen >= 1, gapExtend >= 1
+ * @param threadCount Number of threads to use
+ * @param best Receives the best alignment; ties go to the leftmost end
+ * @return 0 on success, -1 on invalid scores or if memory ran out, -2 if the
+ *         best alignment could not be traced back to its start
+ */
+int dnaAlignBest(const char* query, int queryLen, const char* text, int textLen,
+                 const DnaAlignScoring* scoring, int threadCount, DnaAlignment* best) {
+    AlignWork work;
+    int c;
+
+    if (queryLen <= 0 || scoring->match <= 0 || scoring->mismatch > 0 ||
+        scoring->gapOpen < 1 || scoring->gapExtend < 1 ||
+        scoring->match + scoring->gapOpen - scoring->mismatch > 255) {
+        return -1;
+    }
+
+    best->score = 0;
+    best->textStart = -1;
+    best->textEnd = -1;
+    best->engine = "scalar";
+    if (textLen <= 0) {
+        return 0;
+    }
+
+    work.query = query;
+    work.queryLen = queryLen;
+    work.text = text;
+    work.textLen = textLen;
+    work.scoring = scoring;
+    // Each reference gap base costs at least gapExtend out of at most queryLen * match
+    long long overlap = queryLen + (long long)queryLen * scoring->match / scoring->gapExtend;
+    work.overlap = overlap < textLen ? (int)overlap : textLen;
+    work.chunkCount = (textLen + ALIGN_CHUNK - 1) / ALIGN_CHUNK;
+    work.hits = (AlignHit*)trackedCalloc(work.chunkCount, sizeof(AlignHit));
+    if (work.hits == NULL) {
+        return -1;
+    }
+    atomic_init(&work.nextChunk, 0);
+    atomic_init(&work.widest, 0);
+    atomic_init(&work.failed, 0);
+#ifdef __SSE2__
+    if (buildProfiles(query, queryLen, scoring, &work.profile) != 0) {
+        free(work.hits);
+        return -1;
+    }
+#endif
+
+    if (threadCount > work.chunkCount) {
+        threadCount = work.chunkCount;
+    }
+    runWorkers(threadCount, alignWorker, &work);
+
+#ifdef __SSE2__
+    free(work.profile.memory8);
+    free(work.profile.memory16);
+#endif
+
+    if (atomic_load(&work.failed)) {
+        free(work.hits);
+        return -1;
+    }
+
+    // Chunks overlap, so the same hit may be seen twice; keep the leftmost best
+    for (c = 0; c < work.chunkCount; c++) {
+        if (work.hits[c].score > best->score ||
+            (work.hits[c].score == best->score && work.hits[c].score > 0 && work.hits[c].end < best->textEnd)) {
+            best->score = work.hits[c].score;
+            best->textEnd = work.hits[c].end;
+        }
+    }
+    free(work.hits);
+
+    best->engine = atomic_load(&work.widest) == 8 ? "striped-8bit" :
+                   atomic_load(&work.widest) == 16 ? "striped-16bit" : "scalar";
+    if (best->score > 0) {
+        best->textStart = alignmentStart(query, queryLen, text, best->textEnd, work.overlap,
+                                         scoring, best->score);
+        if (best->textStart < 0) {
+            return best->textStart;
+        }
+        // Report [textStart, textEnd) like DnaRegion
+        best->textEnd++;
+    }
+    return 0;
+}
+
+/** One exact seed hit: pattern offset `offset` found at text position diagonal + offset */
+typedef struct {
+    int diagonal;  /**< Text position minus pattern offset */
+    int offset;    /**< Offset of the seed in the pattern */
+} ApproxSeed;
+
+/** Growable seed list filled by collectSeed() */
+typedef struct {
+    ApproxSeed* seeds;  /**< Seeds found so far */
+    int count;          /**< Number of seeds */
+    int capacity;       /**< Allocated size of seeds */
+    int seedLength;     /**< Length of every seed */
+    int failed;         /**< Set if growing the list failed */
+} SeedList;
+
+/**
+ * @brief Pattern-set callback recording one seed hit
+ * @param pattern Index of the seed, i.e. its offset divided by the seed length
+ * @param position Text position of the hit
+ * @param userData The SeedList
+ * @return 0 to continue, 1 to stop after an allocation failure
+ */
+static int collectSeed(int pattern, int position, void* userData) {
+    SeedList* list = (SeedList*)userData;
+
+    if (list->count == list->capacity) {
+        int capacity = list->capacity > 0 ? 2 * list->capacity : 256;
+        ApproxSeed* grown = (ApproxSeed*)trackedRealloc(list->seeds, list->capacity * sizeof(ApproxSeed),
+                                                         capacity * sizeof(ApproxSeed));
+        if (grown == NULL) {
+            list->failed = 1;
+            return 1;
+        }
+        list->seeds = grown;
+        list->capacity = capacity;
+    }
+    list->seeds[list->count].offset = pattern * list->seedLength;
+    list->seeds[list->count].diagonal = position - pattern * list->seedLength;
+    list->count++;
+    return 0;
+}
+
+/**
+ * @brief Orders seeds by diagonal, then by pattern offset
+ * @param a First ApproxSeed
+ * @param b Second ApproxSeed
+ * @return Negative, zero or positive as for qsort()
+ */
+static int compareSeeds(const void* a, const void* b) {
+    const ApproxSeed* x = (const ApproxSeed*)a;
+    const ApproxSeed* y = (const ApproxSeed*)b;
+    if (x->diagonal != y->diagonal) {
+        return x->diagonal < y->diagonal ? -1 : 1;
+    }
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+/**
+ * @brief Orders hits by text start, then by descending score
+ * @param a First DnaApproxHit
+ * @param b Second DnaApproxHit
+ * @return Negative, zero or positive as for qsort()
+ */
+static int compareApproxHits(const void* a, const void* b) {
+    const DnaApproxHit* x = (const DnaApproxHit*)a;
+    const DnaApproxHit* y = (const DnaApproxHit*)b;
+    if (x->textStart != y->textStart) {
+        return x->textStart < y->textStart ? -1 : 1;
+    }
+    return (y->score > x->score) - (y->score < x->score);
+}
+
+/**
+ * @brief Aligns the whole pattern to the text inside a band of diagonals
+ *
+ * Banded Gotoh with free text ends: row i holds pattern prefix i, and cell k
+ * of a row is text position i + lowDiagonal + k, so only the diagonals
+ * [lowDiagonal, highDiagonal] are ever filled. The start of every cell is
+ * carried along so the best alignment needs no traceback.
+ *
+ * @param pattern Pattern
+ * @param patternLen Length of the pattern
+ * @param text Text
+ * @param textLen Length of the text
+ * @param lowDiagonal Lowest diagonal (text position minus pattern offset)
+ * @param highDiagonal Highest diagonal
+ * @param scoring Scores
+ * @param hit Receives the best alignment in the band
+ * @return 0 on success, -1 on error
+ */
+static int bandedAlign(const char* pattern, int patternLen, const char* text, int textLen,
+                       int lowDiagonal, int highDiagonal, const DnaAlignScoring* scoring,
+                       DnaApproxHit* hit) {
+    // Far below any reachable score, yet safe to subtract penalties from
+    const int minusInfinity = INT_MIN / 2;
+    int width = highDiagonal - lowDiagonal + 1;
+    int* rows = (int*)trackedMalloc(8 * (size_t)width * sizeof(int));
+    int i, k;
+
+    if (rows == NULL) {
+        return -1;
+    }
+    // Current and previous row of H, F and the starts of both
+    int* h = rows;
+    int* f = rows + width;
+    int* hStart = rows + 2 * width;
+    int* fStart = rows + 3 * width;
+    int* prevH = rows + 4 * width;
+    int* prevF = rows + 5 * width;
+    int* prevHStart = rows + 6 * width;
+    int* prevFStart = rows + 7 * width;
+
+    // Row 0: the alignment may begin anywhere in the text
+    for (k = 0; k < width; k++) {
+        int j = lowDiagonal + k;
+        h[k] = j >= 0 && j <= textLen ? 0 : minusInfinity;
+        f[k] = minusInfinity;
+        hStart[k] = j;
+        fStart[k] = j;
+    }
+
+    for (i = 1; i <= patternLen; i++) {
+        int* swap;
+        swap = prevH; prevH = h; h = swap;
+        swap = prevF; prevF = f; f = swap;
+        swap = prevHStart; prevHStart = hStart; hStart = swap;
+        swap = prevFStart; prevFStart = fStart; fStart = swap;
+
+        int patternCode = profileCode(pattern[i - 1]);
+        int e = minusInfinity;
+        int eStart = 0;
+        for (k = 0; k < width; k++) {
+            int j = i + lowDiagonal + k;
+            h[k] = minusInfinity;
+            f[k] = minusInfinity;
+            if (j < 0 || j > textLen) {
+                e = minusInfinity;
+                continue;
+            }
+
+            // Pattern base against text base: same k in the previous row
+            int best = minusInfinity;
+            int bestStart = 0;
+            if (j >= 1) {
+                best = prevH[k] + pairScore(scoring, patternCode, profileCode(text[j - 1]));
+                bestStart = prevHStart[k];
+            }
+
+            // Pattern base against a gap: cell k + 1 of the previous row
+            if (k + 1 < width) {
+                if (prevH[k + 1] - scoring->gapOpen >= prevF[k + 1] - scoring->gapExtend) {
+                    f[k] = prevH[k + 1] - scoring->gapOpen;
+                    fStart[k] = prevHStart[k + 1];
+                } else {
+                    f[k] = prevF[k + 1] - scoring->gapExtend;
+                    fStart[k] = prevFStart[k + 1];
+                }
+                if (f[k] > best) {
+                    best = f[k];
+                    bestStart = fStart[k];
+                }
+            }
+
+            // Text base against a gap: cell k - 1 of this row
+            if (k > 0) {
+                if (h[k - 1] - scoring->gapOpen >= e - scoring->gapExtend) {
+                    e = h[k - 1] - scoring->gapOpen;
+                    eStart = hStart[k - 1];
+                } else {
+                    e -= scoring->gapExtend;
+                }
+                if (e > best) {
+                    best = e;
+                    bestStart = eStart;
+                }
+            }
+
+            h[k] = best < minusInfinity ? minusInfinity : best;
+            hStart[k] = bestStart;
+        }
+    }
+
+    // Last row: the alignment may end anywhere in the text
+    hit->score = minusInfinity;
+    hit->textStart = -1;
+    hit->textEnd = -1;
+    for (k = 0; k < width; k++) {
+        int j = patternLen + lowDiagonal + k;
+        if (j >= 0 && j <= textLen && h[k] > hit->score) {
+            hit->score = h[k];
+            hit->textStart = hStart[k];
+            hit->textEnd = j;
+        }
+    }
+
+    free(rows);
+    return 0;
+}
+
+/**
+ * @brief Finds approximate occurrences of a pattern by seed and extend
+ *
+ * The pattern is cut into non-overlapping seeds of seedLength bases, which
+ * are found exactly with a multi-pattern Karp-Rabin set. Seed hits are
+ * grouped by diagonal (text position minus pattern offset), and only groups
+ * holding minSeeds seeds are extended, by aligning the whole pattern in a
+ * band reaching APPROX_MAX_DRIFT diagonals beyond the group's (less if no
+ * gap that long can still score minScore). By the pigeonhole principle an
+ * occurrence with fewer than seedCount - minSeeds + 1 edits always leaves
+ * enough seeds intact to be found, as long as its insertions and deletions
+ * do not drift further than that from its seeds.
+ *
+ * @param pattern Pattern
+ * @param patternLen Length of the pattern, at least 1
+ * @param text Text
+ * @param textLen Length of the text
+ * @param options Seed length, seeds per group, minimum score and scores
+ * @param hitCount Receives the number of hits
+ * @return Array of hits sorted by text start, never overlapping (free()), or NULL on error
+ */
+DnaApproxHit* dnaApproxSearch(const char* pattern, int patternLen, const char* text, int textLen,
+                              const DnaApproxOptions* options, int* hitCount) {
+    const DnaAlignScoring* scoring = &options->scoring;
+    int seedLength = options->seedLength < patternLen ? options->seedLength : patternLen;
+    int i;
+
+    if (patternLen <= 0 || seedLength <= 0 || scoring->match <= 0 || scoring->mismatch > 0 ||
+        scoring->gapOpen < 1 || scoring->gapExtend < 1) {
+        return NULL;
+    }
+
+    int seedCount = patternLen / seedLength;
+    int minSeeds = options->minSeeds < 1 ? 1 : options->minSeeds > seedCount ? seedCount : options->minSeeds;
+    const char** seeds = (const char**)trackedMalloc(seedCount * sizeof(char*));
+    int* lengths = (int*)trackedMalloc(seedCount * sizeof(int));
+    DnaApproxHit* hits = (DnaApproxHit*)trackedMalloc(sizeof(DnaApproxHit));
+    DnaPatternSet* set = NULL;
+    SeedList list;
+    int used = 0;
+    int capacity = 1;
+    int failed = 0;
+
+    memset(&list, 0, sizeof(list));
+    list.seedLength = seedLength;
+    if (seeds != NULL && lengths != NULL && hits != NULL) {
+        for (i = 0; i < seedCount; i++) {
+            seeds[i] = pattern + i * seedLength;
+            lengths[i] = seedLength;
+        }
+        set = dnaPatternSetCreate(seeds, lengths, seedCount);
+    }
+    free(seeds);
+    free(lengths);
+    if (set == NULL) {
+        free(hits);
+        return NULL;
+    }
+
+    dnaPatternSetSearch(set, text, textLen, collectSeed, &list);
+    dnaPatternSetFree(set);
+    if (list.failed) {
+        free(list.seeds);
+        free(hits);
+        return NULL;
+    }
+
+    // Drift allowed around the seeds, no wider than the longest gap an
+    // alignment can hold and still reach minScore
+    long long slack = (long long)patternLen * scoring->match - options->minScore - scoring->gapOpen;
+    int band = slack < 0 ? 0 : (int)(slack / scoring->gapExtend + 1);
+    if (band > APPROX_MAX_DRIFT) {
+        band = APPROX_MAX_DRIFT;
+    }
+
+    qsort(list.seeds, list.count, sizeof(ApproxSeed), compareSeeds);
+    int first = 0;
+    while (first < list.count && !failed) {
+        // Chain seeds whose diagonals are within a band of each other, up to
+        // one pattern length of diagonals per group
+        int last = first;
+        while (last + 1 < list.count &&
+               list.seeds[last + 1].diagonal - list.seeds[last].diagonal <= band &&
+               list.seeds[last + 1].diagonal - list.seeds[first].diagonal <= patternLen) {
+            last++;
+        }
+
+        // Count distinct seeds, since a repeat can place one seed twice in a group
+        int distinct = 0;
+        for (i = first; i <= last; i++) {
+            int j = first;
+            while (j < i && list.seeds[j].offset != list.seeds[i].offset) {
+                j++;
+            }
+            distinct += j == i;
+            if (distinct >= minSeeds) {
+                break;
+            }
+        }
+
+        if (distinct >= minSeeds) {
+            DnaApproxHit hit;
+            if (bandedAlign(pattern, patternLen, text, textLen, list.seeds[first].diagonal - band,
+                            list.seeds[last].diagonal + band, scoring, &hit) != 0) {
+                failed = 1;
+            } else if (hit.score >= options->minScore) {
+                if (used == capacity) {
+                    DnaApproxHit* grown = (DnaApproxHit*)trackedRealloc(hits, capacity * sizeof(DnaApproxHit),
+                                                                        2 * capacity * sizeof(DnaApproxHit));
+                    if (grown == NULL) {
+                        failed = 1;
+                        break;
+                    }
+                    hits = grown;
+                    capacity *= 2;
+                }
+                hits[used++] = hit;
+            }
+        }
+        first = last + 1;
+    }
+    free(list.seeds);
+
+    if (failed) {
+        free(hits);
+        return NULL;
+    }
+
+    // Neighbouring groups can align to the same place; keep the best of overlapping hits
+    qsort(hits, used, sizeof(DnaApproxHit), compareApproxHits);
+    int kept = 0;
+    for (i = 0; i < used; i++) {
+        if (kept > 0 && hits[i].textStart < hits[kept - 1].textEnd) {
+            if (hits[i].score > hits[kept - 1].score) {
+                hits[kept - 1] = hits[i];
+            }
+            continue;
+        }
+        hits[kept++] = hits[i];
+    }
+
+    *hitCount = kept;
+    return hits;
+}
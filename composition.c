@@ -0,0 +1,203 @@
+/**
+ * @file composition.c
+ * @brief Base composition, GC content, GC skew and entropy profiles (part of libdnamatch)
+ * @author George Fotiou
+ * @date 01/10/2025
+ *
+ * Everything here derives from the four base counts of a stretch of text.
+ * Counting is done sixteen bases at a time with SSE2: each base is compared
+ * with A, C, G and T and the matches are summed in byte lanes, which are
+ * added up before they can overflow.
+ *
+ * A profile slides a window along the text in a single pass. Consecutive
+ * windows share most of their bases, so each one is derived from the
+ * previous counts by counting only the bases that enter and those that
+ * leave, which costs O(1) per base of text whatever the window size.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "dnamatch.h"
+#include "dnamatchInternal.h"
+
+/** Blocks of 16 bases counted in byte lanes before they are added up; a lane gains at most 1 per block */
+#define COMPOSITION_LANE_BLOCKS 255
+
+/**
+ * @brief Adds the A, C, G and T counts of a range of text, in either case
+ * @param text Text
+ * @param from First position counted
+ * @param to One past the last position counted
+ * @param counts Counts of A, C, G and T to add to
+ */
+static void countBases(const char* text, int from, int to, int counts[4]) {
+    int i = from;
+
+#ifdef __SSE2__
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bases[4] = {_mm_set1_epi8('a'), _mm_set1_epi8('c'), _mm_set1_epi8('g'), _mm_set1_epi8('t')};
+    int b;
+
+    while (i + 16 <= to) {
+        __m128i lanes[4] = {zero, zero, zero, zero};
+        int blocks = 0;
+
+        // A matching byte compares as -1, so subtracting counts it
+        for (; blocks < COMPOSITION_LANE_BLOCKS && i + 16 <= to; blocks++, i += 16) {
+            __m128i folded = _mm_or_si128(_mm_loadu_si128((const __m128i*)(text + i)), lower);
+            for (b = 0; b < 4; b++) {
+                lanes[b] = _mm_sub_epi8(lanes[b], _mm_cmpeq_epi8(folded, bases[b]));
+            }
+        }
+        for (b = 0; b < 4; b++) {
+            __m128i sums = _mm_sad_epu8(lanes[b], zero);
+            counts[b] += _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+        }
+    }
+#endif
+
+    for (; i < to; i++) {
+        int code = encodeBase(text[i]);
+        if (code >= 0) {
+            counts[code]++;
+        }
+    }
+}
+
+/**
+ * @brief Computes log2 of a positive number without libm
+ * @param x Positive number
+ * @return log2(x), within 1e-9
+ */
+static double log2Of(double x) {
+    double result = 0;
+    while (x >= 2) {
+        x /= 2;
+        result += 1;
+    }
+    while (x < 1) {
+        x *= 2;
+        result -= 1;
+    }
+
+    // ln(x) = 2 atanh(z) with z = (x - 1) / (x + 1) at most 1/3 on [1, 2)
+    double z = (x - 1) / (x + 1);
+    double zz = z * z;
+    double term = z;
+    double sum = 0;
+    int k;
+    for (k = 1; k < 40 && term > 1e-12; k += 2) {
+        sum += term / k;
+        term *= zz;
+    }
+    return result + 2 * sum * 1.4426950408889634;
+}
+
+/**
+ * @brief Fills in the fractions derived from the base counts of a composition
+ * @param composition Composition whose counts are set
+ */
+static void deriveComposition(DnaComposition* composition) {
+    const int* counts = composition->counts;
+    int total = counts[0] + counts[1] + counts[2] + counts[3];
+    int gc = counts[1] + counts[2];
+    int b;
+
+    composition->bases = total;
+    composition->gc = total > 0 ? (double)gc / total : 0;
+    composition->skew = gc > 0 ? (double)(counts[2] - counts[1]) / gc : 0;
+    composition->entropy = 0;
+    for (b = 0; b < 4; b++) {
+        if (counts[b] > 0) {
+            double p = (double)counts[b] / total;
+            composition->entropy -= p * log2Of(p);
+        }
+    }
+}
+
+/**
+ * @brief Computes the base composition of a text
+ * @param text Text
+ * @param textLen Length of the text
+ * @param composition Receives the counts, GC fraction, GC skew and entropy
+ */
+void dnaBaseComposition(const char* text, int textLen, DnaComposition* composition) {
+    memset(composition, 0, sizeof(DnaComposition));
+    countBases(text, 0, textLen > 0 ? textLen : 0, composition->counts);
+    deriveComposition(composition);
+}
+
+/**
+ * @brief Profiles the composition of a text in sliding windows
+ *
+ * Windows start every step bases; the last one is cut short at the end of
+ * the text, and no window starts after one that reaches it or at or past the
+ * end of the text. With steps no longer than the window, the counts of each
+ * window are updated from the previous one by the step bases entering and
+ * leaving it.
+ *
+ * @param text Text to profile
+ * @param textLen Length of the text
+ * @param window Window length, at least 1
+ * @param step Distance between window starts, at least 1
+ * @param windowCount Receives the number of windows
+ * @return Windows in text order (free()), or NULL on error
+ */
+DnaCompositionWindow* dnaCompositionProfile(const char* text, int textLen, int window, int step,
+                                            int* windowCount) {
+    if (window < 1 || step < 1) {
+        return NULL;
+    }
+    if (textLen < 0) {
+        textLen = 0;
+    }
+
+    // Windows start at 0, step, 2 step, ... until one reaches the end; with
+    // steps longer than the window the next start can fall past the end first
+    int count = textLen > window ? (textLen - window + step - 1) / step + 1 : textLen > 0;
+    if (count > (textLen + step - 1) / step) {
+        count = (textLen + step - 1) / step;
+    }
+    DnaCompositionWindow* windows = (DnaCompositionWindow*)trackedMalloc((count > 0 ? count : 1) *
+                                                                         sizeof(DnaCompositionWindow));
+    if (windows == NULL) {
+        return NULL;
+    }
+
+    int counts[4] = {0, 0, 0, 0};
+    int start = 0;
+    int end = 0;
+    int w;
+    for (w = 0; w < count; w++) {
+        int nextStart = w * step;
+        int nextEnd = nextStart + window < textLen ? nextStart + window : textLen;
+        if (nextStart >= end) {
+            // No overlap with the previous window: count from scratch
+            memset(counts, 0, sizeof(counts));
+            countBases(text, nextStart, nextEnd, counts);
+        } else {
+            int leaving[4] = {0, 0, 0, 0};
+            countBases(text, end, nextEnd, counts);
+            countBases(text, start, nextStart, leaving);
+            counts[0] -= leaving[0];
+            counts[1] -= leaving[1];
+            counts[2] -= leaving[2];
+            counts[3] -= leaving[3];
+        }
+        start = nextStart;
+        end = nextEnd;
+
+        windows[w].start = start;
+        windows[w].end = end;
+        memcpy(windows[w].composition.counts, counts, sizeof(counts));
+        deriveComposition(&windows[w].composition);
+    }
+
+    *windowCount = count;
+    return windows;
+}
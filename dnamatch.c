@@ -0,0 +1,1462 @@
+/**
+ * @file dnamatch.c
+ * @brief Implementation of libdnamatch: sequence input and matching engines
+ * @author George Fotiou
+ * @date 01/10/2025
+ *
+ * Build as a static library with:
+ * ```
+ * gcc -O2 -pthread -c dnamatch.c && ar rcs libdnamatch.a dnamatch.o
+ * ```
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "dnamatch.h"
+#include "dnamatchInternal.h"
+
+/**
+ * @brief Search kernel specialized for one pattern length
+ * @param packed Pattern, 2 bits per base, first base most significant
+ * @param text Text to search in
+ * @param textLen Length of the text
+ * @param nonOverlapping Non-zero to skip matches overlapping the previous hit
+ * @param onHit Callback for each match, or NULL
+ * @param userData Passed through to onHit
+ * @return Number of matches found
+ */
+typedef int (*FixedKernel)(uint64_t packed, const char* text, int textLen, int nonOverlapping,
+                           DnaHitCallback onHit, void* userData);
+
+/** A pattern compiled by dnaMatcherCreate() */
+struct DnaMatcher {
+    DnaAlgorithm algorithm;  /**< Engine requested by the caller */
+    const char* engineName;  /**< Engine actually used, for reporting */
+    char* pattern;           /**< Private copy of the pattern */
+    int patternLen;          /**< Length of the pattern */
+    int nonOverlapping;      /**< Matches may not overlap (DNA_NON_OVERLAPPING) */
+    long long patternHash;   /**< Karp-Rabin hash of the pattern */
+    long long highPower;     /**< 2^(patternLen-1) % MOD, used when rolling */
+    int* border;             /**< KMP failure function, for the periodic engine */
+    int critical;            /**< Two-Way critical position (last index of the left half) */
+    int period;              /**< Two-Way shift: the period, or a safe lower bound */
+    int periodic;            /**< Two-Way: the left half repeats with that period */
+    FixedKernel kernel;      /**< Length-specialized kernel, or NULL */
+    uint64_t packed;         /**< 2-bit packed pattern for the kernel */
+};
+
+/** Match start positions per chunk of a parallel search */
+#define PARALLEL_CHUNK 65536
+
+/** dnaChooseAlgorithm(): chance that a text base equals a pattern base above which periodic patterns go to KMP */
+#define AUTO_PERIODIC_MATCH_RATE 0.75
+
+/** Total number of bytes requested through the tracked allocators */
+static atomic_size_t bytesAllocated = 0;
+
+/**
+ * @brief Allocates memory and records the request size for statistics
+ * @param size Number of bytes to allocate
+ * @return Pointer to the allocated memory, or NULL on failure
+ */
+void* trackedMalloc(size_t size) {
+    void* ptr = malloc(size);
+    if (ptr != NULL) {
+        atomic_fetch_add_explicit(&bytesAllocated, size, memory_order_relaxed);
+    }
+    return ptr;
+}
+
+/**
+ * @brief Allocates zeroed memory and records the request size for statistics
+ * @param count Number of elements
+ * @param size Size of each element
+ * @return Pointer to the allocated memory, or NULL on failure
+ */
+void* trackedCalloc(size_t count, size_t size) {
+    void* ptr = calloc(count, size);
+    if (ptr != NULL) {
+        atomic_fetch_add_explicit(&bytesAllocated, count * size, memory_order_relaxed);
+    }
+    return ptr;
+}
+
+/**
+ * @brief Resizes memory and records any growth for statistics
+ * @param ptr Block previously returned by a tracked allocator
+ * @param oldSize Current size of the block
+ * @param newSize Requested size of the block
+ * @return Pointer to the resized memory, or NULL on failure (ptr stays valid)
+ */
+void* trackedRealloc(void* ptr, size_t oldSize, size_t newSize) {
+    void* bigger = realloc(ptr, newSize);
+    if (bigger != NULL && newSize > oldSize) {
+        atomic_fetch_add_explicit(&bytesAllocated, newSize - oldSize, memory_order_relaxed);
+    }
+    return bigger;
+}
+
+/**
+ * @brief Returns the number of bytes requested through the tracked allocators
+ * @return Total bytes allocated since the program started
+ */
+size_t allocatedBytes(void) {
+    return atomic_load_explicit(&bytesAllocated, memory_order_relaxed);
+}
+
+/**
+ * @brief Returns the number of online CPUs, the default worker count
+ * @return Number of CPUs, at least 1
+ */
+int defaultThreadCount(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+/**
+ * @brief Runs the same worker function on several threads and waits for them
+ * @param threadCount Number of workers; the calling thread is one of them
+ * @param worker Function run by every worker, normally claiming work from arg
+ * @param arg Shared state passed to every worker
+ */
+void runWorkers(int threadCount, void* (*worker)(void*), void* arg) {
+    pthread_t* threads = NULL;
+    int started = 0;
+    int i;
+    
+    if (threadCount > 1) {
+        threads = (pthread_t*)trackedMalloc((threadCount - 1) * sizeof(pthread_t));
+    }
+    
+    // Workers that fail to start are simply not run; the others pick up their share
+    for (i = 0; threads != NULL && i < threadCount - 1; i++) {
+        if (pthread_create(&threads[started], NULL, worker, arg) == 0) {
+            started++;
+        }
+    }
+    
+    worker(arg);
+    
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+/**
+ * @brief Reads the first line of a file without any filtering
+ * @param filename Name of the file to read from
+ * @param length Receives the number of characters read
+ * @return Newly allocated, NUL-terminated line, or NULL on error
+ */
+char* loadLine(const char* filename, int* length) {
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) {
+        printf("Error: Cannot open file %s\n", filename);
+        return NULL;
+    }
+
+    int capacity = 4096;
+    int used = 0;
+    int ch;
+    char* line = (char*)trackedMalloc(capacity);
+
+    while (line != NULL && (ch = fgetc(file)) != EOF && ch != '\n') {
+        if (used == capacity - 1) {
+            // Grow geometrically; the old block is released by realloc
+            char* bigger = (char*)trackedRealloc(line, capacity, capacity * 2);
+            if (bigger == NULL) {
+                free(line);
+                line = NULL;
+                break;
+            }
+            capacity *= 2;
+            line = bigger;
+        }
+        line[used++] = ch;
+    }
+    fclose(file);
+
+    if (line == NULL) {
+        printf("Error: Memory allocation failed\n");
+        return NULL;
+    }
+
+    line[used] = '\0';
+    *length = used;
+    return line;
+}
+
+/**
+ * @brief Keeps only the DNA bases of a raw line, converted to uppercase
+ * @param raw Raw characters as read from the file
+ * @param rawLen Number of raw characters
+ * @param sequence Array to store the sequence
+ * @param maxSize Maximum size of the sequence
+ * @return Length of the normalized sequence
+ */
+int normalizeSequence(const char* raw, int rawLen, char* sequence, int maxSize) {
+    int length = 0;
+    int i;
+
+    for (i = 0; i < rawLen && length < maxSize - 1; i++) {
+        char ch = raw[i];
+        if (ch == 'A' || ch == 'T' || ch == 'C' || ch == 'G' || 
+            ch == 'a' || ch == 't' || ch == 'c' || ch == 'g') {
+            // Convert to uppercase for consistency
+            if (ch >= 'a' && ch <= 'z') {
+                ch = ch - 'a' + 'A';
+            }
+            sequence[length++] = ch;
+        }
+    }
+
+    sequence[length] = '\0';
+
+    // Only warn if bases were actually left over
+    if (length == maxSize - 1 && i < rawLen) {
+        printf("Warning: Sequence may have been truncated\n");
+    }
+
+    return length;
+}
+
+/**
+ * @brief Reads a DNA sequence from a file into a character array
+ * @param filename Name of the file to read from
+ * @param sequence Array to store the sequence
+ * @param maxSize Maximum size of the sequence
+ * @return Length of the sequence read, or -1 on error
+ */
+int readSequence(const char* filename, char* sequence, int maxSize) {
+    int rawLen;
+    char* raw = loadLine(filename, &rawLen);
+    if (raw == NULL) {
+        return -1;
+    }
+
+    int length = normalizeSequence(raw, rawLen, sequence, maxSize);
+    free(raw);
+    return length;
+}
+
+/**
+ * @brief Implements brute force pattern matching algorithm
+ * @param text The DNA sequence text to search in
+ * @param pattern The pattern to search for
+ * @param textLen Length of the text
+ * @param patternLen Length of the pattern
+ * @return Number of matches found
+ */
+int bruteForceSearch(const char* text, const char* pattern, int textLen, int patternLen) {
+    int matches = 0;
+    int i, j;
+    
+    // Search for pattern in text
+    for (i = 0; i <= textLen - patternLen; i++) {
+        j = 0;
+        
+        // Check if pattern matches at current position
+        while (j < patternLen && text[i + j] == pattern[j]) {
+            j++;
+        }
+        
+        // If we matched the entire pattern
+        if (j == patternLen) {
+            matches++;
+        }
+    }
+    
+    return matches;
+}
+
+/**
+ * @brief Calculates hash value for a string using rolling hash
+ * @param str String to hash
+ * @param len Length of the string
+ * @return Hash value
+ */
+long long calculateHash(const char* str, int len) {
+    long long hash = 0;
+    long long base = 1;
+    int i;
+    
+    // Calculate hash = (str[0]*2^(len-1) + str[1]*2^(len-2) + ... + str[len-1]*2^0) % MOD
+    for (i = len - 1; i >= 0; i--) {
+        hash = (hash + ((long long)str[i] * base) % MOD) % MOD;
+        if (i > 0) {
+            base = (base * 2) % MOD;
+        }
+    }
+    
+    return hash;
+}
+
+/**
+ * @brief Recalculates hash value by removing old character and adding new one
+ * @param oldChar Character being removed
+ * @param oldHash Previous hash value
+ * @param newChar Character being added
+ * @param patternLen Length of the pattern
+ * @return New hash value
+ */
+long long rehash(char oldChar, long long oldHash, char newChar, int patternLen) {
+    long long powerOf2 = 1;
+    int i;
+    
+    // Calculate 2^(patternLen-1)
+    for (i = 0; i < patternLen - 1; i++) {
+        powerOf2 = (powerOf2 * 2) % MOD;
+    }
+    
+    // rehash(a, h, b) = ((h - a*2^(M-1)) * 2 + b) % MOD
+    long long newHash = oldHash - ((long long)oldChar * powerOf2) % MOD;
+    if (newHash < 0) {
+        newHash += MOD;
+    }
+    newHash = (newHash * 2 + newChar) % MOD;
+    
+    return newHash;
+}
+
+/**
+ * @brief Verifies if pattern actually matches at given position
+ * @param text The text to check
+ * @param pattern The pattern to match
+ * @param pos Position in text to start checking
+ * @param patternLen Length of pattern
+ * @return 1 if match, 0 otherwise
+ */
+int verifyMatch(const char* text, const char* pattern, int pos, int patternLen) {
+    int i;
+    for (i = 0; i < patternLen; i++) {
+        if (text[pos + i] != pattern[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Karp-Rabin search with the pattern hash already computed
+ * @param text The DNA sequence text to search in
+ * @param pattern The pattern to search for
+ * @param textLen Length of the text
+ * @param patternLen Length of the pattern
+ * @param patternHash Hash of the pattern as returned by calculateHash()
+ * @return Number of matches found
+ */
+int karpRabinSearchHashed(const char* text, const char* pattern, int textLen, int patternLen,
+                          long long patternHash) {
+    if (patternLen > textLen) {
+        return 0;
+    }
+    
+    int matches = 0;
+    long long textHash = calculateHash(text, patternLen);
+    int i;
+    
+    // Check first window
+    if (patternHash == textHash && verifyMatch(text, pattern, 0, patternLen)) {
+        matches++;
+    }
+    
+    // Roll through the rest of the text
+    for (i = 1; i <= textLen - patternLen; i++) {
+        textHash = rehash(text[i - 1], textHash, text[i + patternLen - 1], patternLen);
+        
+        if (patternHash == textHash && verifyMatch(text, pattern, i, patternLen)) {
+            matches++;
+        }
+    }
+    
+    return matches;
+}
+
+/**
+ * @brief Implements Karp-Rabin pattern matching algorithm
+ * @param text The DNA sequence text to search in
+ * @param pattern The pattern to search for
+ * @param textLen Length of the text
+ * @param patternLen Length of the pattern
+ * @return Number of matches found
+ */
+int karpRabinSearch(const char* text, const char* pattern, int textLen, int patternLen) {
+    if (patternLen > textLen) {
+        return 0;
+    }
+    
+    return karpRabinSearchHashed(text, pattern, textLen, patternLen,
+                                 calculateHash(pattern, patternLen));
+}
+
+
+/**
+ * @brief Maps a command line flag to an algorithm
+ * @param flag Flag such as "-bf" or "-kr"
+ * @param algorithm Receives the algorithm
+ * @return 0 on success, -1 if the flag names no algorithm
+ */
+int dnaAlgorithmFromFlag(const char* flag, DnaAlgorithm* algorithm) {
+    if (strcmp(flag, "-bf") == 0) {
+        *algorithm = DNA_ALG_BRUTE_FORCE;
+    } else if (strcmp(flag, "-kr") == 0) {
+        *algorithm = DNA_ALG_KARP_RABIN;
+    } else if (strcmp(flag, "-pc") == 0) {
+        *algorithm = DNA_ALG_POPCOUNT;
+    } else if (strcmp(flag, "-kmp") == 0) {
+        *algorithm = DNA_ALG_PERIODIC;
+    } else if (strcmp(flag, "-tw") == 0) {
+        *algorithm = DNA_ALG_TWO_WAY;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Defines fixedSearchK(), a kernel for patterns of exactly K bases
+ *
+ * The whole pattern lives in one register as 2-bit codes and the text is
+ * rolled through a K-base window with constant shift and mask, so every
+ * position costs one shift, one or and one compare. K is a compile-time
+ * constant, letting the compiler fold the mask and unroll the warm-up.
+ * Emptying the window after a hit makes the next hit start at least K bases
+ * later, which is all non-overlapping mode needs.
+ */
+#define DEFINE_FIXED_KERNEL(K)                                                     \
+static int fixedSearch##K(uint64_t packed, const char* text, int textLen,          \
+                          int nonOverlapping, DnaHitCallback onHit,                \
+                          void* userData) {                                        \
+    const uint64_t mask = (K) == 32 ? ~0ull : (1ull << (2 * (K))) - 1;             \
+    uint64_t window = 0;                                                           \
+    int valid = 0;                                                                 \
+    int matches = 0;                                                               \
+    int i;                                                                         \
+    for (i = 0; i < textLen; i++) {                                                \
+        int code = encodeExactBase(text[i]);                                       \
+        if (code < 0) {                                                            \
+            valid = 0;                                                             \
+            continue;                                                              \
+        }                                                                          \
+        window = ((window << 2) | (uint64_t)code) & mask;                          \
+        if (++valid >= (K) && window == packed) {                                  \
+            matches++;                                                             \
+            if (onHit != NULL && onHit(i - (K) + 1, userData)) {                   \
+                break;                                                             \
+            }                                                                      \
+            if (nonOverlapping) {                                                  \
+                valid = 0;                                                         \
+            }                                                                      \
+        }                                                                          \
+    }                                                                              \
+    return matches;                                                                \
+}
+
+DEFINE_FIXED_KERNEL(8)
+DEFINE_FIXED_KERNEL(12)
+DEFINE_FIXED_KERNEL(16)
+DEFINE_FIXED_KERNEL(20)
+DEFINE_FIXED_KERNEL(24)
+DEFINE_FIXED_KERNEL(32)
+
+/** Pattern lengths with a specialized kernel */
+static const struct {
+    int length;          /**< Pattern length handled */
+    FixedKernel kernel;  /**< Kernel for that length */
+    const char* name;    /**< Engine name reported by dnaMatcherEngine() */
+} fixedKernels[] = {
+    {8, fixedSearch8, "fixed8"},
+    {12, fixedSearch12, "fixed12"},
+    {16, fixedSearch16, "fixed16"},
+    {20, fixedSearch20, "fixed20"},
+    {24, fixedSearch24, "fixed24"},
+    {32, fixedSearch32, "fixed32"}
+};
+
+/**
+ * @brief Packs a pattern into 2-bit codes
+ * @param pattern Pattern to pack
+ * @param patternLen Length of the pattern, at most 32
+ * @param packed Receives the packed pattern
+ * @return 0 on success, -1 if the pattern holds anything but upper-case ACGT
+ */
+static int packPattern(const char* pattern, int patternLen, uint64_t* packed) {
+    uint64_t value = 0;
+    int i;
+    for (i = 0; i < patternLen; i++) {
+        int code = encodeExactBase(pattern[i]);
+        if (code < 0) {
+            return -1;
+        }
+        value = (value << 2) | (uint64_t)code;
+    }
+    *packed = value;
+    return 0;
+}
+
+/**
+ * @brief Computes the KMP failure function of a pattern
+ *
+ * border[j] is the length of the longest proper prefix of pattern[0..j] that
+ * is also its suffix; patternLen - border[patternLen - 1] is the smallest
+ * period of the pattern.
+ *
+ * @param pattern Pattern to analyse
+ * @param patternLen Length of the pattern
+ * @param border Receives patternLen entries
+ */
+static void computeBorders(const char* pattern, int patternLen, int* border) {
+    int k = 0;
+    int j;
+    
+    border[0] = 0;
+    for (j = 1; j < patternLen; j++) {
+        while (k > 0 && pattern[j] != pattern[k]) {
+            k = border[k - 1];
+        }
+        if (pattern[j] == pattern[k]) {
+            k++;
+        }
+        border[j] = k;
+    }
+}
+
+/**
+ * @brief Finds the maximal suffix of a pattern under one of two orders
+ * @param pattern Pattern to analyse
+ * @param patternLen Length of the pattern
+ * @param reversed Zero for the alphabetical order, non-zero for its reverse
+ * @param period Receives the period of the maximal suffix
+ * @return Index just before the maximal suffix (-1 if it is the whole pattern)
+ */
+static int maximalSuffix(const char* pattern, int patternLen, int reversed, int* period) {
+    int start = -1;
+    int j = 0;
+    int k = 1;
+    int p = 1;
+    
+    while (j + k < patternLen) {
+        char a = pattern[j + k];
+        char b = pattern[start + k];
+        if (reversed ? a > b : a < b) {
+            // The suffix at j is smaller; extend the current period
+            j += k;
+            k = 1;
+            p = j - start;
+        } else if (a == b) {
+            if (k != p) {
+                k++;
+            } else {
+                j += p;
+                k = 1;
+            }
+        } else {
+            // A larger suffix starts at j + 1
+            start = j;
+            j = start + 1;
+            k = p = 1;
+        }
+    }
+    
+    *period = p;
+    return start;
+}
+
+/**
+ * @brief Computes the critical factorization used by the Two-Way engine
+ *
+ * The larger of the two maximal-suffix positions is a critical position of
+ * the pattern (Crochemore-Perrin). If the left half repeats with the right
+ * half's period the pattern is periodic and the search remembers how much of
+ * the previous window still matches; otherwise any shift up to
+ * max(left, right) + 1 is safe and no memory is needed.
+ *
+ * @param matcher Matcher whose pattern is set; receives critical, period and periodic
+ */
+static void factorizePattern(DnaMatcher* matcher) {
+    const char* pattern = matcher->pattern;
+    int patternLen = matcher->patternLen;
+    int forwardPeriod, reversedPeriod;
+    int forward = maximalSuffix(pattern, patternLen, 0, &forwardPeriod);
+    int reversed = maximalSuffix(pattern, patternLen, 1, &reversedPeriod);
+    
+    matcher->critical = forward > reversed ? forward : reversed;
+    matcher->period = forward > reversed ? forwardPeriod : reversedPeriod;
+    matcher->periodic = memcmp(pattern, pattern + matcher->period, matcher->critical + 1) == 0;
+    if (!matcher->periodic) {
+        int left = matcher->critical + 1;
+        int right = patternLen - matcher->critical - 1;
+        matcher->period = (left > right ? left : right) + 1;
+    }
+}
+
+/**
+ * @brief Compiles a pattern, doing all per-pattern preprocessing once
+ * @param algorithm Engine to use when searching
+ * @param pattern The pattern to search for (need not be NUL-terminated)
+ * @param patternLen Length of the pattern, at least 1
+ * @param flags 0 or DNA_NON_OVERLAPPING
+ * @return New matcher to release with dnaMatcherFree(), or NULL on error
+ */
+DnaMatcher* dnaMatcherCreateFlags(DnaAlgorithm algorithm, const char* pattern, int patternLen,
+                                  int flags) {
+    if (patternLen <= 0 || algorithm < 0 || algorithm >= DNA_ALGORITHM_COUNT) {
+        return NULL;
+    }
+    
+    DnaMatcher* matcher = (DnaMatcher*)trackedMalloc(sizeof(DnaMatcher));
+    if (matcher == NULL) {
+        return NULL;
+    }
+    
+    matcher->pattern = (char*)trackedMalloc(patternLen + 1);
+    if (matcher->pattern == NULL) {
+        free(matcher);
+        return NULL;
+    }
+    memcpy(matcher->pattern, pattern, patternLen);
+    matcher->pattern[patternLen] = '\0';
+    matcher->algorithm = algorithm;
+    matcher->patternLen = patternLen;
+    matcher->nonOverlapping = (flags & DNA_NON_OVERLAPPING) != 0;
+    matcher->patternHash = 0;
+    matcher->highPower = 1;
+    matcher->border = NULL;
+    matcher->critical = -1;
+    matcher->period = 1;
+    matcher->periodic = 0;
+    matcher->kernel = NULL;
+    matcher->packed = 0;
+    matcher->engineName = algorithm == DNA_ALG_KARP_RABIN ? "karp-rabin" :
+                          algorithm == DNA_ALG_POPCOUNT ? "popcount" :
+                          algorithm == DNA_ALG_PERIODIC ? "periodic" :
+                          algorithm == DNA_ALG_TWO_WAY ? "two-way" : "brute-force";
+    
+    // Common primer lengths get a kernel specialized for their length; it
+    // gives the same answers as brute force and Karp-Rabin, which it replaces
+    size_t k;
+    int fixedAllowed = algorithm == DNA_ALG_BRUTE_FORCE || algorithm == DNA_ALG_KARP_RABIN;
+    for (k = 0; fixedAllowed && k < sizeof(fixedKernels) / sizeof(fixedKernels[0]); k++) {
+        if (fixedKernels[k].length == patternLen &&
+            packPattern(pattern, patternLen, &matcher->packed) == 0) {
+            matcher->kernel = fixedKernels[k].kernel;
+            matcher->engineName = fixedKernels[k].name;
+            return matcher;
+        }
+    }
+    
+    if (algorithm == DNA_ALG_KARP_RABIN) {
+        int i;
+        matcher->patternHash = calculateHash(pattern, patternLen);
+        // Hoist the 2^(M-1) that rehash() would recompute at every step
+        for (i = 0; i < patternLen - 1; i++) {
+            matcher->highPower = (matcher->highPower * 2) % MOD;
+        }
+    }
+    
+    if (algorithm == DNA_ALG_PERIODIC) {
+        matcher->border = (int*)trackedMalloc(patternLen * sizeof(int));
+        if (matcher->border == NULL) {
+            dnaMatcherFree(matcher);
+            return NULL;
+        }
+        computeBorders(matcher->pattern, patternLen, matcher->border);
+    }
+    
+    if (algorithm == DNA_ALG_TWO_WAY) {
+        factorizePattern(matcher);
+    }
+    
+    return matcher;
+}
+
+/**
+ * @brief Compiles a pattern that reports every match, overlapping or not
+ * @param algorithm Engine to use when searching
+ * @param pattern The pattern to search for (need not be NUL-terminated)
+ * @param patternLen Length of the pattern, at least 1
+ * @return New matcher to release with dnaMatcherFree(), or NULL on error
+ */
+DnaMatcher* dnaMatcherCreate(DnaAlgorithm algorithm, const char* pattern, int patternLen) {
+    return dnaMatcherCreateFlags(algorithm, pattern, patternLen, 0);
+}
+
+/**
+ * @brief Picks an engine for a pattern from its shape and the composition of the text
+ *
+ * Counting alone goes to the popcount engine over packed text, which is
+ * much faster than any scan. Otherwise Two-Way is used, except for a
+ * pattern repeating a short unit in a text made mostly of the same bases
+ * (such as poly-A in an A-rich text): there every window matches a long
+ * prefix, and KMP's failure links never re-read a base while Two-Way falls
+ * back on its memory of the period.
+ *
+ * @param pattern Pattern to search for
+ * @param patternLen Length of the pattern, at least 1
+ * @param text Composition of the text, from dnaBaseComposition()
+ * @param countOnly Non-zero if only the number of matches is needed
+ * @return Engine to compile the pattern for
+ */
+DnaAlgorithm dnaChooseAlgorithm(const char* pattern, int patternLen, const DnaComposition* text,
+                                int countOnly) {
+    if (countOnly) {
+        return DNA_ALG_POPCOUNT;
+    }
+    if (patternLen <= 1 || text->bases == 0) {
+        return DNA_ALG_TWO_WAY;
+    }
+    
+    // Chance that a text base equals a pattern base, both drawn at random
+    int patternCounts[4] = {0, 0, 0, 0};
+    int patternBases = 0;
+    int i;
+    for (i = 0; i < patternLen; i++) {
+        int code = encodeBase(pattern[i]);
+        if (code >= 0) {
+            patternCounts[code]++;
+            patternBases++;
+        }
+    }
+    double matchRate = 0;
+    for (i = 0; i < 4 && patternBases > 0; i++) {
+        matchRate += (double)text->counts[i] / text->bases * patternCounts[i] / patternBases;
+    }
+    if (matchRate < AUTO_PERIODIC_MATCH_RATE) {
+        return DNA_ALG_TWO_WAY;
+    }
+    
+    int* border = (int*)trackedMalloc(patternLen * sizeof(int));
+    if (border == NULL) {
+        return DNA_ALG_TWO_WAY;
+    }
+    computeBorders(pattern, patternLen, border);
+    int period = patternLen - border[patternLen - 1];
+    free(border);
+    return 2 * period <= patternLen ? DNA_ALG_PERIODIC : DNA_ALG_TWO_WAY;
+}
+
+/**
+ * @brief Releases a matcher
+ * @param matcher Matcher returned by dnaMatcherCreate(), or NULL
+ */
+void dnaMatcherFree(DnaMatcher* matcher) {
+    if (matcher == NULL) {
+        return;
+    }
+    free(matcher->border);
+    free(matcher->pattern);
+    free(matcher);
+}
+
+/**
+ * @brief Returns the length of the compiled pattern
+ * @param matcher Compiled pattern
+ * @return Pattern length
+ */
+int dnaMatcherLength(const DnaMatcher* matcher) {
+    return matcher->patternLen;
+}
+
+/**
+ * @brief Returns the name of the engine a matcher searches with
+ * @param matcher Compiled pattern
+ * @return Engine name, such as "karp-rabin" or "fixed16"
+ */
+const char* dnaMatcherEngine(const DnaMatcher* matcher) {
+    return matcher->engineName;
+}
+
+/**
+ * @brief Brute force scan reporting every hit
+ * @param matcher Compiled pattern
+ * @param text Text to search in
+ * @param textLen Length of the text
+ * @param onHit Callback for each match, or NULL
+ * @param userData Passed through to onHit
+ * @return Number of matches found
+ */
+static int matcherBruteForce(const DnaMatcher* matcher, const char* text, int textLen,
+                             DnaHitCallback onHit, void* userData) {
+    const char* pattern = matcher->pattern;
+    int patternLen = matcher->patternLen;
+    int matches = 0;
+    int i, j;
+    
+    for (i = 0; i <= textLen - patternLen; i++) {
+        j = 0;
+        while (j < patternLen && text[i + j] == pattern[j]) {
+            j++;
+        }
+        
+        if (j == patternLen) {
+            matches++;
+            if (onHit != NULL && onHit(i, userData)) {
+                break;
+            }
+            if (matcher->nonOverlapping) {
+                // Resume right after the hit
+                i += patternLen - 1;
+            }
+        }
+    }
+    
+    return matches;
+}
+
+/**
+ * @brief Karp-Rabin scan reporting every hit
+ * @param matcher Compiled pattern
+ * @param text Text to search in
+ * @param textLen Length of the text
+ * @param onHit Callback for each match, or NULL
+ * @param userData Passed through to onHit
+ * @return Number of matches found
+ */
+static int matcherKarpRabin(const DnaMatcher* matcher, const char* text, int textLen,
+                            DnaHitCallback onHit, void* userData) {
+    const char* pattern = matcher->pattern;
+    int patternLen = matcher->patternLen;
+    long long textHash = calculateHash(text, patternLen);
+    int matches = 0;
+    int i = 0;
+    
+    while (1) {
+        if (matcher->patternHash == textHash && verifyMatch(text, pattern, i, patternLen)) {
+            matches++;
+            if (onHit != NULL && onHit(i, userData)) {
+                break;
+            }
+            if (matcher->nonOverlapping) {
+                // Jump past the hit and hash the new window afresh instead
+                // of rolling through every skipped base
+                i += patternLen;
+                if (i > textLen - patternLen) {
+                    break;
+                }
+                textHash = calculateHash(text + i, patternLen);
+                continue;
+            }
+        }
+        
+        if (i == textLen - patternLen) {
+            break;
+        }
+        
+        // Same recurrence as rehash(), with the power precomputed
+        textHash = textHash - ((long long)text[i] * matcher->highPower) % MOD;
+        if (textHash < 0) {
+            textHash += MOD;
+        }
+        textHash = (textHash * 2 + text[i + patternLen]) % MOD;
+        i++;
+    }
+    
+    return matches;
+}
+
+/**
+ * @brief Period-aware scan reporting every hit, linear even on repeats
+ *
+ * Text characters are never compared twice after a match: on a mismatch the
+ * matched prefix shrinks to its longest border, and after a hit the scan
+ * keeps the border of the whole pattern, i.e. resumes one period later with
+ * patternLen - period bases already known to match. Poly-A or ATAT... patterns
+ * against long repeats therefore cost one comparison per text base instead of
+ * up to patternLen.
+ *
+ * @param matcher Compiled pattern
+ * @param text Text to search in
+ * @param textLen Length of the text
+ * @param onHit Callback for each match, or NULL
+ * @param userData Passed through to onHit
+ * @return Number of matches found
+ */
+static int matcherPeriodic(const DnaMatcher* matcher, const char* text, int textLen,
+                           DnaHitCallback onHit, void* userData) {
+    const char* pattern = matcher->pattern;
+    const int* border = matcher->border;
+    int patternLen = matcher->patternLen;
+    int matches = 0;
+    int matched = 0;
+    int i;
+    
+    for (i = 0; i < textLen; i++) {
+        while (matched > 0 && text[i] != pattern[matched]) {
+            matched = border[matched - 1];
+        }
+        if (text[i] == pattern[matched]) {
+            matched++;
+        }
+        
+        if (matched == patternLen) {
+            matches++;
+            if (onHit != NULL && onHit(i - patternLen + 1, userData)) {
+                break;
+            }
+            // Reuse the matched prefix unless the next hit may not overlap this one
+            matched = matcher->nonOverlapping ? 0 : border[patternLen - 1];
+        }
+    }
+    
+    return matches;
+}
+
+/**
+ * @brief Two-Way scan reporting every hit, linear time in constant space
+ *
+ * Each window is compared right half first, left to right from the critical
+ * position; a mismatch there shifts the window past the matched part. Only
+ * when the right half matches is the left half compared, right to left. For
+ * periodic patterns the bases shared with the previous window after a
+ * period shift are remembered and skipped, which keeps the scan linear on
+ * AAAA...AC style inputs without any table.
+ *
+ * @param matcher Compiled pattern
+ * @param text Text to search in
+ * @param textLen Length of the text
+ * @param onHit Callback for each match, or NULL
+ * @param userData Passed through to onHit
+ * @return Number of matches found
+ */
+static int matcherTwoWay(const DnaMatcher* matcher, const char* text, int textLen,
+                         DnaHitCallback onHit, void* userData) {
+    const char* pattern = matcher->pattern;
+    int patternLen = matcher->patternLen;
+    int critical = matcher->critical;
+    int period = matcher->period;
+    // Prefix of the window already known to match, or -1
+    int memory = -1;
+    int matches = 0;
+    int j = 0;
+    
+    while (j <= textLen - patternLen) {
+        const char* window = text + j;
+        int i = (critical > memory ? critical : memory) + 1;
+        
+        while (i < patternLen && pattern[i] == window[i]) {
+            i++;
+        }
+        if (i < patternLen) {
+            j += i - critical;
+            memory = -1;
+            continue;
+        }
+        
+        i = critical;
+        while (i > memory && pattern[i] == window[i]) {
+            i--;
+        }
+        if (i <= memory) {
+            matches++;
+            if (onHit != NULL && onHit(j, userData)) {
+                break;
+            }
+            if (matcher->nonOverlapping) {
+                j += patternLen;
+                memory = -1;
+                continue;
+            }
+        }
+        
+        j += period;
+        memory = matcher->periodic ? patternLen - period - 1 : -1;
+    }
+    
+    return matches;
+}
+
+/**
+ * @brief Searches a caller-provided buffer; safe to call from many threads
+ * @param matcher Compiled pattern
+ * @param text Text to search in
+ * @param textLen Length of the text
+ * @param onHit Callback for each match in increasing position order, or NULL
+ * @param userData Passed through to onHit
+ * @return Number of matches reported (including the one that stopped the search),
+ *         or -1 if the popcount engine could not pack the text
+ */
+int dnaMatcherSearch(const DnaMatcher* matcher, const char* text, int textLen,
+                     DnaHitCallback onHit, void* userData) {
+    if (matcher->patternLen > textLen) {
+        return 0;
+    }
+    
+    if (matcher->kernel != NULL) {
+        return matcher->kernel(matcher->packed, text, textLen, matcher->nonOverlapping,
+                               onHit, userData);
+    }
+    
+    switch (matcher->algorithm) {
+        case DNA_ALG_BRUTE_FORCE:
+            return matcherBruteForce(matcher, text, textLen, onHit, userData);
+        case DNA_ALG_KARP_RABIN:
+            return matcherKarpRabin(matcher, text, textLen, onHit, userData);
+        case DNA_ALG_PERIODIC:
+            return matcherPeriodic(matcher, text, textLen, onHit, userData);
+        case DNA_ALG_TWO_WAY:
+            return matcherTwoWay(matcher, text, textLen, onHit, userData);
+        case DNA_ALG_POPCOUNT: {
+            // Callers searching the same text repeatedly should pack it once
+            DnaPackedText* packed = dnaPackText(text, textLen);
+            if (packed == NULL) {
+                return -1;
+            }
+            int matches = dnaPopcountSearch(packed, matcher->pattern, matcher->patternLen,
+                                            matcher->nonOverlapping, onHit, userData);
+            dnaPackedTextFree(packed);
+            return matches;
+        }
+        default:
+            break;
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Counts the matches of a compiled pattern in a buffer
+ * @param matcher Compiled pattern
+ * @param text Text to search in
+ * @param textLen Length of the text
+ * @return Number of matches found, or -1 if the popcount engine could not pack the text
+ */
+int dnaMatcherCount(const DnaMatcher* matcher, const char* text, int textLen) {
+    return dnaMatcherSearch(matcher, text, textLen, NULL, NULL);
+}
+
+/**
+ * @brief Counts the matches of a compiled pattern in a packed text
+ *
+ * The popcount engine counts straight from the bit-planes; other engines
+ * have no packed form and report 0.
+ *
+ * @param matcher Compiled pattern, normally for DNA_ALG_POPCOUNT
+ * @param packed Text packed by dnaPackText()
+ * @return Number of matches found
+ */
+int dnaMatcherCountPacked(const DnaMatcher* matcher, const DnaPackedText* packed) {
+    if (matcher->algorithm != DNA_ALG_POPCOUNT) {
+        return 0;
+    }
+    if (matcher->nonOverlapping) {
+        // Skipping overlaps needs the positions, so walk them instead of popcounting
+        return dnaPopcountSearch(packed, matcher->pattern, matcher->patternLen, 1, NULL, NULL);
+    }
+    return dnaPopcountCount(packed, matcher->pattern, matcher->patternLen);
+}
+
+/**
+ * @brief Reports the matches of a compiled pattern in a packed text
+ *
+ * Lets a caller searching one text with many popcount matchers pack it only
+ * once; other engines have no packed form and report 0.
+ *
+ * @param matcher Compiled pattern, normally for DNA_ALG_POPCOUNT
+ * @param packed Text packed by dnaPackText()
+ * @param onHit Callback for each match in increasing position order, or NULL
+ * @param userData Passed through to onHit
+ * @return Number of matches reported (including the one that stopped the search)
+ */
+int dnaMatcherSearchPacked(const DnaMatcher* matcher, const DnaPackedText* packed,
+                           DnaHitCallback onHit, void* userData) {
+    if (matcher->algorithm != DNA_ALG_POPCOUNT) {
+        return 0;
+    }
+    return dnaPopcountSearch(packed, matcher->pattern, matcher->patternLen, matcher->nonOverlapping,
+                             onHit, userData);
+}
+
+/** One slice of text searched by one thread of a parallel search */
+typedef struct {
+    int from;        /**< First match start in the slice */
+    int to;          /**< One past the last match start in the slice */
+    int matches;     /**< Matches found in the slice */
+    int first;       /**< Position of the first match, -1 if none */
+    int last;        /**< Position of the last match, -1 if none */
+    int* positions;  /**< First positions found, when a hit limit is set */
+    int done;        /**< The slice has been searched (or skipped) */
+} SearchChunk;
+
+/** State shared by the threads of dnaRegionSearch() */
+typedef struct {
+    const DnaMatcher* matcher;  /**< Compiled pattern */
+    const char* text;           /**< Text to search in */
+    int maxHits;                /**< Hit limit, 0 for none */
+    int chunkCount;             /**< Number of chunks */
+    SearchChunk* chunks;        /**< Chunks in text order */
+    int* order;                 /**< Chunk indices, largest chunk first */
+    atomic_int nextChunk;       /**< Next entry of order to claim */
+    atomic_int cutoff;          /**< Chunks from this index on are not needed */
+    atomic_int failed;          /**< Set if a position buffer or packed text could not be allocated */
+    pthread_mutex_t lock;       /**< Protects done flags and the cutoff update */
+} ParallelSearch;
+
+/** Hit callback state of one chunk */
+typedef struct {
+    ParallelSearch* search;  /**< Shared search state */
+    SearchChunk* chunk;      /**< Chunk being searched */
+    int index;               /**< Index of the chunk in text order */
+    int found;               /**< Hits seen so far in this chunk */
+} ChunkHits;
+
+/**
+ * @brief Hit callback of a chunk: records the position and checks the limits
+ * @param position Match position within the chunk
+ * @param userData The ChunkHits
+ * @return Non-zero once this chunk has enough hits or is no longer needed
+ */
+static int recordChunkHit(int position, void* userData) {
+    ChunkHits* hits = (ChunkHits*)userData;
+    ParallelSearch* search = hits->search;
+
+    position += hits->chunk->from;
+    if (hits->chunk->first < 0) {
+        hits->chunk->first = position;
+    }
+    hits->chunk->last = position;
+    if (search->maxHits == 0) {
+        return 0;
+    }
+    if (hits->chunk->positions != NULL) {
+        hits->chunk->positions[hits->found] = position;
+    }
+    hits->found++;
+    return hits->found >= search->maxHits ||
+           hits->index >= atomic_load_explicit(&search->cutoff, memory_order_relaxed);
+}
+
+/**
+ * @brief Lowers the cutoff once finished chunks in front hold enough hits
+ *
+ * Any chunk after the point where the finished chunks before it already hold
+ * maxHits hits cannot contribute to the first maxHits hits. Without overlaps
+ * a chunk may lose its first hit to the previous chunk's last one (see
+ * resyncChunk()), so only the hits after its first are relied on.
+ *
+ * @param search Shared search state, with its lock held
+ */
+static void updateCutoff(ParallelSearch* search) {
+    int found = 0;
+    int c;
+
+    for (c = 0; c < atomic_load(&search->cutoff); c++) {
+        if (search->chunks[c].done) {
+            int sure = search->chunks[c].matches;
+            if (search->matcher->nonOverlapping && c > 0 && sure > 0) {
+                sure--;
+            }
+            found += sure;
+            if (found >= search->maxHits) {
+                atomic_store(&search->cutoff, c + 1);
+                return;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Parallel search worker: claims chunks, largest first
+ * @param arg The ParallelSearch
+ * @return NULL
+ */
+static void* parallelSearchWorker(void* arg) {
+    ParallelSearch* search = (ParallelSearch*)arg;
+    int patternLen = search->matcher->patternLen;
+    int next;
+
+    while ((next = atomic_fetch_add(&search->nextChunk, 1)) < search->chunkCount) {
+        int c = search->order[next];
+        SearchChunk* chunk = &search->chunks[c];
+
+        if (c < atomic_load(&search->cutoff)) {
+            ChunkHits hits;
+            if (search->maxHits > 0) {
+                chunk->positions = (int*)trackedMalloc(search->maxHits * sizeof(int));
+                if (chunk->positions == NULL) {
+                    atomic_store(&search->failed, 1);
+                }
+            }
+            hits.search = search;
+            hits.chunk = chunk;
+            hits.index = c;
+            hits.found = 0;
+            chunk->first = -1;
+            chunk->last = -1;
+            // Windows starting in [from, to) end by to + patternLen - 1; nothing is copied
+            chunk->matches = dnaMatcherSearch(search->matcher, search->text + chunk->from,
+                                              chunk->to - chunk->from + patternLen - 1,
+                                              recordChunkHit, &hits);
+            if (chunk->matches < 0) {
+                atomic_store(&search->failed, 1);
+                chunk->matches = 0;
+            }
+        }
+
+        pthread_mutex_lock(&search->lock);
+        chunk->done = 1;
+        if (search->maxHits > 0) {
+            updateCutoff(search);
+        }
+        pthread_mutex_unlock(&search->lock);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Searches a chunk again from a later start, after a hit straddling its front
+ *
+ * Chunks of a non-overlapping search are scanned independently, each from its
+ * own start. When the previous chunk's last hit runs into this chunk, the
+ * greedy choice here changes and the chunk is searched again from where that
+ * hit ends; this only happens for hits near chunk boundaries.
+ *
+ * @param search Shared search state, after all workers finished
+ * @param chunk Chunk to redo
+ * @param from First position not covered by the previous hit
+ */
+static void resyncChunk(ParallelSearch* search, SearchChunk* chunk, int from) {
+    int patternLen = search->matcher->patternLen;
+    ChunkHits hits;
+
+    hits.search = search;
+    hits.chunk = chunk;
+    hits.index = 0;
+    hits.found = 0;
+    chunk->first = -1;
+    chunk->last = -1;
+    chunk->matches = 0;
+    chunk->from = from;
+    if (from < chunk->to) {
+        chunk->matches = dnaMatcherSearch(search->matcher, search->text + from,
+                                          chunk->to - from + patternLen - 1,
+                                          recordChunkHit, &hits);
+        if (chunk->matches < 0) {
+            atomic_store(&search->failed, 1);
+            chunk->matches = 0;
+        }
+    }
+}
+
+/**
+ * @brief Orders regions by start
+ * @param a First DnaRegion
+ * @param b Second DnaRegion
+ * @return Negative, zero or positive as for qsort()
+ */
+static int compareRegions(const void* a, const void* b) {
+    const DnaRegion* x = (const DnaRegion*)a;
+    const DnaRegion* y = (const DnaRegion*)b;
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+/** Sort key of a chunk when scheduling */
+typedef struct {
+    int size;   /**< Match starts in the chunk */
+    int index;  /**< Index of the chunk in text order */
+} ChunkOrder;
+
+/**
+ * @brief Orders chunks by decreasing size, then by position
+ * @param a First ChunkOrder
+ * @param b Second ChunkOrder
+ * @return Negative, zero or positive as for qsort()
+ */
+static int compareChunkSizes(const void* a, const void* b) {
+    const ChunkOrder* x = (const ChunkOrder*)a;
+    const ChunkOrder* y = (const ChunkOrder*)b;
+    if (x->size != y->size) {
+        return y->size - x->size;
+    }
+    return x->index - y->index;
+}
+
+/**
+ * @brief Sorts, clips and merges regions in place
+ * @param regions Regions to normalize
+ * @param regionCount Number of regions
+ * @param textLen Length of the text the regions refer to
+ * @return Number of regions left, disjoint and in text order
+ */
+int dnaNormalizeRegions(DnaRegion* regions, int regionCount, int textLen) {
+    int used = 0;
+    int r;
+
+    qsort(regions, regionCount, sizeof(DnaRegion), compareRegions);
+    for (r = 0; r < regionCount; r++) {
+        DnaRegion region = regions[r];
+        if (region.start < 0) {
+            region.start = 0;
+        }
+        if (region.end > textLen) {
+            region.end = textLen;
+        }
+        if (region.start >= region.end) {
+            continue;
+        }
+        // Overlapping or touching regions are searched as one, so no hit is counted twice
+        if (used > 0 && region.start <= regions[used - 1].end) {
+            if (region.end > regions[used - 1].end) {
+                regions[used - 1].end = region.end;
+            }
+        } else {
+            regions[used++] = region;
+        }
+    }
+    return used;
+}
+
+/**
+ * @brief Searches only inside regions of a text, with several threads
+ *
+ * A copy of the regions is normalized with dnaNormalizeRegions() and cut into chunks
+ * of at most PARALLEL_CHUNK match starts; threads claim the chunks largest
+ * first so uneven regions still balance. A match counts only if it lies
+ * wholly inside the union of the regions. With a hit limit each chunk stops at the limit,
+ * and a chunk is cancelled as soon as finished chunks in front of it hold
+ * enough hits, so the hits returned are always the first ones in the text.
+ *
+ * @param matcher Compiled pattern
+ * @param text Text to search in; regions index into it directly
+ * @param textLen Length of the text
+ * @param regions Regions to search, in any order, possibly overlapping
+ * @param regionCount Number of regions
+ * @param threadCount Number of threads to use
+ * @param maxHits Stop after this many hits, 0 to count them all
+ * @param positions Receives the first min(result, maxHits) positions, or NULL
+ * @return Number of matches (at most maxHits when it is set), or -1 on error
+ */
+int dnaRegionSearch(const DnaMatcher* matcher, const char* text, int textLen,
+                    const DnaRegion* regions, int regionCount, int threadCount, int maxHits,
+                    int* positions) {
+    ParallelSearch search;
+    int patternLen = matcher->patternLen;
+    int chunkCount = 0;
+    int r, c;
+
+    // Work on a private copy so threads may share the caller's regions
+    DnaRegion* merged = (DnaRegion*)trackedMalloc((regionCount > 0 ? regionCount : 1) * sizeof(DnaRegion));
+    if (merged == NULL) {
+        return -1;
+    }
+    memcpy(merged, regions, regionCount * sizeof(DnaRegion));
+    regionCount = dnaNormalizeRegions(merged, regionCount, textLen);
+    regions = merged;
+    
+    for (r = 0; r < regionCount; r++) {
+        int starts = regions[r].end - regions[r].start - patternLen + 1;
+        if (starts > 0) {
+            chunkCount += (starts + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK;
+        }
+    }
+    if (chunkCount == 0) {
+        free(merged);
+        return 0;
+    }
+
+    search.matcher = matcher;
+    search.text = text;
+    search.maxHits = maxHits > 0 ? maxHits : 0;
+    search.chunkCount = chunkCount;
+    search.chunks = (SearchChunk*)trackedCalloc(chunkCount, sizeof(SearchChunk));
+    search.order = (int*)trackedMalloc(chunkCount * sizeof(int));
+    if (search.chunks == NULL || search.order == NULL) {
+        free(search.chunks);
+        free(search.order);
+        free(merged);
+        return -1;
+    }
+
+    ChunkOrder* sizes = (ChunkOrder*)trackedMalloc(chunkCount * sizeof(ChunkOrder));
+    if (sizes == NULL) {
+        free(search.chunks);
+        free(search.order);
+        free(merged);
+        return -1;
+    }
+    
+    c = 0;
+    for (r = 0; r < regionCount; r++) {
+        int from = regions[r].start;
+        int last = regions[r].end - patternLen + 1;
+        while (from < last) {
+            search.chunks[c].from = from;
+            search.chunks[c].to = from + PARALLEL_CHUNK < last ? from + PARALLEL_CHUNK : last;
+            sizes[c].size = search.chunks[c].to - from;
+            sizes[c].index = c;
+            from = search.chunks[c].to;
+            c++;
+        }
+    }
+    free(merged);
+    
+    // Largest first, so a big region is not left for last on one thread
+    qsort(sizes, chunkCount, sizeof(ChunkOrder), compareChunkSizes);
+    for (c = 0; c < chunkCount; c++) {
+        search.order[c] = sizes[c].index;
+    }
+    free(sizes);
+
+    atomic_init(&search.nextChunk, 0);
+    atomic_init(&search.cutoff, chunkCount);
+    atomic_init(&search.failed, 0);
+    pthread_mutex_init(&search.lock, NULL);
+
+    if (threadCount > chunkCount) {
+        threadCount = chunkCount;
+    }
+    runWorkers(threadCount, parallelSearchWorker, &search);
+
+    // Chunks are merged in text order, so the first hits come first
+    int matches = 0;
+    int nextFree = 0;
+    for (c = 0; c < chunkCount && (search.maxHits == 0 || matches < search.maxHits); c++) {
+        SearchChunk* chunk = &search.chunks[c];
+        if (matcher->nonOverlapping && chunk->matches > 0 && chunk->first < nextFree) {
+            resyncChunk(&search, chunk, nextFree);
+        }
+        int take = chunk->matches;
+        if (search.maxHits > 0 && take > search.maxHits - matches) {
+            take = search.maxHits - matches;
+        }
+        if (positions != NULL && chunk->positions != NULL) {
+            memcpy(positions + matches, chunk->positions, take * sizeof(int));
+        }
+        if (take > 0) {
+            // A partial take ends the merge, so only a full chunk moves nextFree
+            nextFree = chunk->last + patternLen;
+        }
+        matches += take;
+    }
+
+    for (c = 0; c < chunkCount; c++) {
+        free(search.chunks[c].positions);
+    }
+    free(search.chunks);
+    free(search.order);
+    pthread_mutex_destroy(&search.lock);
+    return atomic_load(&search.failed) ? -1 : matches;
+}
+
+/**
+ * @brief Searches a whole text with several threads, optionally stopping early
+ * @param matcher Compiled pattern
+ * @param text Text to search in
+ * @param textLen Length of the text
+ * @param threadCount Number of threads to use
+ * @param maxHits Stop after this many hits, 0 to count them all
+ * @param positions Receives the first min(result, maxHits) positions, or NULL
+ * @return Number of matches (at most maxHits when it is set), or -1 on error
+ */
+int dnaParallelSearch(const DnaMatcher* matcher, const char* text, int textLen, int threadCount,
+                      int maxHits, int* positions) {
+    DnaRegion whole;
+    whole.start = 0;
+    whole.end = textLen;
+    return dnaRegionSearch(matcher, text, textLen, &whole, 1, threadCount, maxHits, positions);
+}
@@ -0,0 +1,294 @@
+/**
+ * @file dnamatch.h
+ * @brief Public interface of libdnamatch, the DNA pattern matching library
+ * @author George Fotiou
+ * @date 01/10/2025
+ *
+ * The library holds the matching engines used by the patternMatching tool so
+ * they can be linked into other programs. A pattern is compiled once into a
+ * DnaMatcher, which can then search any number of caller-provided buffers.
+ *
+ * Thread safety: a DnaMatcher is never modified after dnaMatcherCreate()
+ * returns, so one matcher may be shared by any number of threads searching
+ * concurrently. All search state lives on the caller's stack.
+ */
+
+#ifndef DNAMATCH_H
+#define DNAMATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Matching engines a DnaMatcher can be compiled for */
+typedef enum {
+    DNA_ALG_BRUTE_FORCE,  /**< Brute Force algorithm (-bf) */
+    DNA_ALG_KARP_RABIN,   /**< Karp-Rabin algorithm (-kr) */
+    DNA_ALG_POPCOUNT,     /**< Bit-parallel popcount engine over packed text (-pc) */
+    DNA_ALG_PERIODIC,     /**< Period-aware KMP scan, linear on repeats (-kmp) */
+    DNA_ALG_TWO_WAY,      /**< Two-Way, linear time in constant space (-tw) */
+    DNA_ALGORITHM_COUNT   /**< Number of algorithms */
+} DnaAlgorithm;
+
+/**
+ * @brief Called for every match found by dnaMatcherSearch()
+ * @param position Offset of the match in the searched text
+ * @param userData Pointer passed through from dnaMatcherSearch()
+ * @return 0 to continue searching, non-zero to stop
+ */
+typedef int (*DnaHitCallback)(int position, void* userData);
+
+/** dnaMatcherCreateFlags() flag: report matches greedily left to right, never overlapping */
+#define DNA_NON_OVERLAPPING 0x1
+
+/** Opaque, immutable compiled pattern */
+typedef struct DnaMatcher DnaMatcher;
+
+/** A half-open interval [start, end) of 0-based text positions */
+typedef struct {
+    int start;  /**< First position in the region */
+    int end;    /**< One past the last position in the region */
+} DnaRegion;
+
+/**
+ * @brief Called for every match found by dnaPatternSetSearch()
+ * @param pattern Index of the matching pattern in the set
+ * @param position Offset of the match in the searched text
+ * @param userData Pointer passed through from dnaPatternSetSearch()
+ * @return 0 to continue searching, non-zero to stop
+ */
+typedef int (*DnaMultiHitCallback)(int pattern, int position, void* userData);
+
+/** Opaque, immutable compiled set of patterns */
+typedef struct DnaPatternSet DnaPatternSet;
+
+/** Engines a DnaPatternSet can be compiled for */
+typedef enum {
+    DNA_MULTI_KARP_RABIN,  /**< Rolling fingerprint table, one pass per length (-kr) */
+    DNA_MULTI_WU_MANBER    /**< Wu-Manber q-gram shifts, best for long patterns (-wm) */
+} DnaMultiAlgorithm;
+
+/** Build options of dnaPatternSetCreateWith(); all zero gives the defaults */
+typedef struct {
+    DnaMultiAlgorithm algorithm;  /**< Engine to compile the set for */
+    double bloomFpr;  /**< Karp-Rabin: Bloom prefilter false-positive rate, 0 for none */
+} DnaPatternSetOptions;
+
+/** Prefilter counters of dnaPatternSetCount() */
+typedef struct {
+    uint64_t windows;  /**< Text windows tested */
+    uint64_t passed;   /**< Windows that passed the Bloom filter (all, without one) */
+    uint64_t hits;     /**< Pattern matches found */
+} DnaFilterStats;
+
+/** Scores of dnaAlignBest(); a gap of L bases costs gapOpen + (L - 1) * gapExtend */
+typedef struct {
+    int match;      /**< Score of two equal bases, > 0 */
+    int mismatch;   /**< Score of two different bases or any non-ACGT base, <= 0 */
+    int gapOpen;    /**< Penalty of the first base of a gap, >= 1 */
+    int gapExtend;  /**< Penalty of every further base of a gap, >= 1 */
+} DnaAlignScoring;
+
+/** Best local alignment found by dnaAlignBest() */
+typedef struct {
+    int score;           /**< Alignment score, 0 if nothing aligns */
+    int textStart;       /**< First aligned reference position, -1 if score is 0 */
+    int textEnd;         /**< One past the last aligned reference position, -1 if score is 0 */
+    const char* engine;  /**< Widest lanes needed: "striped-8bit", "striped-16bit" or "scalar" */
+} DnaAlignment;
+
+/** Parameters of dnaApproxSearch() */
+typedef struct {
+    int seedLength;           /**< Length of the exact seeds the pattern is cut into */
+    int minSeeds;             /**< Seeds that must share a diagonal before it is aligned */
+    int minScore;             /**< Lowest alignment score reported */
+    DnaAlignScoring scoring;  /**< Alignment scores */
+} DnaApproxOptions;
+
+/** One approximate occurrence found by dnaApproxSearch() */
+typedef struct {
+    int textStart;  /**< First aligned text position */
+    int textEnd;    /**< One past the last aligned text position */
+    int score;      /**< Score of the whole pattern aligned to [textStart, textEnd) */
+} DnaApproxHit;
+
+/** Opaque, immutable sampled (w,k) minimizer index of a text */
+typedef struct DnaMinimizerIndex DnaMinimizerIndex;
+
+/** Opaque, immutable direct-addressed q-gram index of a text */
+typedef struct DnaQgramIndex DnaQgramIndex;
+
+/** Opaque, immutable suffix automaton of a text with occurrence counts */
+typedef struct DnaSuffixAutomaton DnaSuffixAutomaton;
+
+/** The longest match ending at a query position, found by dnaMaximalMatches() */
+typedef struct {
+    int queryStart;  /**< Start of the match in the query */
+    int textStart;   /**< Start of its first occurrence in the text */
+    int length;      /**< Length of the match */
+    int count;       /**< Occurrences in the text, all of them maximal */
+} DnaMaximalMatch;
+
+/** A tandem repeat found by dnaTandemRepeats() */
+typedef struct {
+    int start;   /**< First base of the repeat */
+    int end;     /**< One past its last base */
+    int period;  /**< Length of the repeated unit, the smallest that fits */
+} DnaTandemRepeat;
+
+/** A restriction enzyme of the built-in table of dnaEnzymeTable() */
+typedef struct {
+    const char* name;  /**< Enzyme name, e.g. "EcoRI" */
+    const char* site;  /**< Recognition site, with IUPAC codes for degenerate bases */
+} DnaEnzyme;
+
+/** A recognition site found by dnaEnzymeSites() */
+typedef struct {
+    int enzyme;    /**< Index of the enzyme in the list searched for */
+    int position;  /**< Leftmost base of the site */
+} DnaSiteHit;
+
+/** A reverse-complement palindrome found by dnaPalindromes() */
+typedef struct {
+    int start;   /**< First base of the palindrome */
+    int length;  /**< Its length, always even */
+} DnaPalindrome;
+
+/** Base composition of a text or window, from dnaBaseComposition() */
+typedef struct {
+    int counts[4];   /**< Occurrences of A, C, G and T */
+    int bases;       /**< Their sum; other characters are not counted */
+    double gc;       /**< GC fraction (G + C) / bases, 0 without bases */
+    double skew;     /**< GC skew (G - C) / (G + C), 0 without G or C */
+    double entropy;  /**< Shannon entropy of the base frequencies, 0 to 2 bits */
+} DnaComposition;
+
+/** One window of a dnaCompositionProfile() */
+typedef struct {
+    int start;                   /**< First base of the window */
+    int end;                     /**< One past its last base */
+    DnaComposition composition;  /**< Its composition */
+} DnaCompositionWindow;
+
+/** Opaque text packed into bit-planes for the popcount engine */
+typedef struct DnaPackedText DnaPackedText;
+
+/** Occurrences of one 2-bit encoded k-mer */
+typedef struct {
+    uint64_t kmer;   /**< K-mer, 2 bits per base, first base most significant */
+    uint32_t count;  /**< Number of occurrences */
+} DnaKmerCount;
+
+/* Sequence input */
+int readSequence(const char* filename, char* sequence, int maxSize);
+
+/* Single-shot engines */
+int bruteForceSearch(const char* text, const char* pattern, int textLen, int patternLen);
+long long calculateHash(const char* str, int len);
+long long rehash(char oldChar, long long oldHash, char newChar, int patternLen);
+int verifyMatch(const char* text, const char* pattern, int pos, int patternLen);
+int karpRabinSearchHashed(const char* text, const char* pattern, int textLen, int patternLen,
+                          long long patternHash);
+int karpRabinSearch(const char* text, const char* pattern, int textLen, int patternLen);
+
+/* Compiled matchers */
+int dnaAlgorithmFromFlag(const char* flag, DnaAlgorithm* algorithm);
+DnaAlgorithm dnaChooseAlgorithm(const char* pattern, int patternLen, const DnaComposition* text,
+                                int countOnly);
+DnaMatcher* dnaMatcherCreate(DnaAlgorithm algorithm, const char* pattern, int patternLen);
+DnaMatcher* dnaMatcherCreateFlags(DnaAlgorithm algorithm, const char* pattern, int patternLen,
+                                  int flags);
+void dnaMatcherFree(DnaMatcher* matcher);
+int dnaMatcherLength(const DnaMatcher* matcher);
+const char* dnaMatcherEngine(const DnaMatcher* matcher);
+int dnaMatcherSearch(const DnaMatcher* matcher, const char* text, int textLen,
+                     DnaHitCallback onHit, void* userData);
+int dnaMatcherCount(const DnaMatcher* matcher, const char* text, int textLen);
+int dnaMatcherCountPacked(const DnaMatcher* matcher, const DnaPackedText* packed);
+int dnaMatcherSearchPacked(const DnaMatcher* matcher, const DnaPackedText* packed,
+                           DnaHitCallback onHit, void* userData);
+int dnaParallelSearch(const DnaMatcher* matcher, const char* text, int textLen, int threadCount,
+                      int maxHits, int* positions);
+int dnaNormalizeRegions(DnaRegion* regions, int regionCount, int textLen);
+int dnaRegionSearch(const DnaMatcher* matcher, const char* text, int textLen,
+                    const DnaRegion* regions, int regionCount, int threadCount, int maxHits,
+                    int* positions);
+
+/* Packed text and popcount engine (packedText.c) */
+DnaPackedText* dnaPackText(const char* text, int textLen);
+void dnaPackedTextFree(DnaPackedText* packed);
+int dnaPackedTextLength(const DnaPackedText* packed);
+int dnaPopcountCount(const DnaPackedText* packed, const char* pattern, int patternLen);
+int dnaPopcountSearch(const DnaPackedText* packed, const char* pattern, int patternLen,
+                      int nonOverlapping, DnaHitCallback onHit, void* userData);
+
+/* Multi-pattern search (multiMatch.c) */
+DnaPatternSet* dnaPatternSetCreate(const char* const* patterns, const int* lengths, int count);
+DnaPatternSet* dnaPatternSetCreateWith(const char* const* patterns, const int* lengths, int count,
+                                       const DnaPatternSetOptions* options);
+void dnaPatternSetFree(DnaPatternSet* set);
+int dnaPatternSetSize(const DnaPatternSet* set);
+int dnaPatternSetSearch(const DnaPatternSet* set, const char* text, int textLen,
+                        DnaMultiHitCallback onHit, void* userData);
+int dnaPatternSetCount(const DnaPatternSet* set, const char* text, int textLen, int threadCount,
+                       int* counts, DnaFilterStats* filterStats);
+
+/* Local alignment (align.c) */
+int dnaAlignBest(const char* query, int queryLen, const char* text, int textLen,
+                 const DnaAlignScoring* scoring, int threadCount, DnaAlignment* best);
+DnaApproxHit* dnaApproxSearch(const char* pattern, int patternLen, const char* text, int textLen,
+                              const DnaApproxOptions* options, int* hitCount);
+
+/* Minimizer index (minimizer.c) */
+DnaMinimizerIndex* dnaMinimizerIndexBuild(const char* text, int textLen, int k, int w);
+void dnaMinimizerIndexFree(DnaMinimizerIndex* index);
+int dnaMinimizerIndexSize(const DnaMinimizerIndex* index);
+size_t dnaMinimizerIndexBytes(const DnaMinimizerIndex* index);
+int dnaMinimizerSearch(const DnaMinimizerIndex* index, const DnaMatcher* matcher, const char* pattern,
+                       int patternLen, const char* text, int textLen, int maxHits, int* positions);
+
+/* Q-gram index (qgramIndex.c) */
+DnaQgramIndex* dnaQgramIndexBuild(const char* text, int textLen, int q);
+void dnaQgramIndexFree(DnaQgramIndex* index);
+int dnaQgramIndexSize(const DnaQgramIndex* index);
+size_t dnaQgramIndexBytes(const DnaQgramIndex* index);
+int dnaQgramSearch(const DnaQgramIndex* index, const char* text, int textLen, const char* pattern,
+                   int patternLen, int maxMismatches, int maxHits, int* positions);
+
+/* Suffix automaton (suffixAutomaton.c) */
+DnaSuffixAutomaton* dnaSuffixAutomatonBuild(const char* text, int textLen);
+void dnaSuffixAutomatonFree(DnaSuffixAutomaton* automaton);
+int dnaSuffixAutomatonStates(const DnaSuffixAutomaton* automaton);
+size_t dnaSuffixAutomatonBytes(const DnaSuffixAutomaton* automaton);
+int dnaSuffixAutomatonCount(const DnaSuffixAutomaton* automaton, const char* pattern, int patternLen);
+DnaMaximalMatch* dnaMaximalMatches(const DnaSuffixAutomaton* automaton, const char* query, int queryLen,
+                                   int minLength, int threadCount, int* matchCount);
+
+/* Tandem repeats (tandemRepeat.c) */
+DnaTandemRepeat* dnaTandemRepeats(const char* text, int textLen, int maxPeriod, int minLength,
+                                  int* repeatCount);
+
+/* Restriction sites and palindromes (restrictionSites.c) */
+const DnaEnzyme* dnaEnzymeTable(int* enzymeCount);
+int dnaFindEnzyme(const char* name);
+DnaSiteHit* dnaEnzymeSites(const char* text, int textLen, const int* enzymes, int enzymeCount,
+                           int* hitCount);
+DnaPalindrome* dnaPalindromes(const char* text, int textLen, int minLength, int maxLength,
+                              int* palindromeCount);
+
+/* Base composition (composition.c) */
+void dnaBaseComposition(const char* text, int textLen, DnaComposition* composition);
+DnaCompositionWindow* dnaCompositionProfile(const char* text, int textLen, int window, int step,
+                                            int* windowCount);
+
+/* Low-complexity masking (dust.c) */
+DnaRegion* dnaDustMask(const char* text, int textLen, int window, int level, int* regionCount);
+DnaRegion* dnaUnmaskedRegions(const DnaRegion* regions, int regionCount, const DnaRegion* masked,
+                              int maskedCount, int textLen, int* resultCount);
+int dnaSoftMask(char* text, const DnaRegion* masked, int maskedCount);
+
+/* K-mer counting (kmerCount.c) */
+void dnaDecodeKmer(uint64_t kmer, int k, char* out);
+DnaKmerCount* dnaCountKmers(const char* text, int textLen, int k, int canonical, int threadCount,
+                            int* distinct);
+
+#endif
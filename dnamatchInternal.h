@@ -0,0 +1,71 @@
+/**
+ * @file dnamatchInternal.h
+ * @brief Helpers shared by the libdnamatch sources and the patternMatching tool
+ * @author George Fotiou
+ * @date 01/10/2025
+ *
+ * Nothing here is part of the library interface: programs linking
+ * libdnamatch include dnamatch.h only. These are the base encoding, the
+ * allocation accounting behind --stats, the worker pool and the sequence
+ * file readers that the engines and the command line tool have in common.
+ */
+
+#ifndef DNAMATCH_INTERNAL_H
+#define DNAMATCH_INTERNAL_H
+
+#include <stddef.h>
+#include <limits.h>
+
+/** Modulo value for Karp-Rabin hash function */
+#define MOD INT_MAX
+
+/**
+ * @brief Maps a base to its 2-bit code
+ * @param base Base character
+ * @return 0-3 for A, C, G, T (any case), -1 for anything else
+ */
+static inline int encodeBase(char base) {
+    switch (base) {
+        case 'A': case 'a': return 0;
+        case 'C': case 'c': return 1;
+        case 'G': case 'g': return 2;
+        case 'T': case 't': return 3;
+        default: return -1;
+    }
+}
+
+/**
+ * @brief Maps an upper-case base to its 2-bit code
+ *
+ * For engines that stand in for the exact character comparisons of the
+ * others, where a lower-case base must neither match nor be matched by an
+ * upper-case one.
+ *
+ * @param base Base character
+ * @return 0-3 for A, C, G, T, -1 for anything else, lower case included
+ */
+static inline int encodeExactBase(char base) {
+    switch (base) {
+        case 'A': return 0;
+        case 'C': return 1;
+        case 'G': return 2;
+        case 'T': return 3;
+        default: return -1;
+    }
+}
+
+/* Memory accounting */
+void* trackedMalloc(size_t size);
+void* trackedCalloc(size_t count, size_t size);
+void* trackedRealloc(void* ptr, size_t oldSize, size_t newSize);
+size_t allocatedBytes(void);
+
+/* Threading */
+int defaultThreadCount(void);
+void runWorkers(int threadCount, void* (*worker)(void*), void* arg);
+
+/* Sequence input */
+char* loadLine(const char* filename, int* length);
+int normalizeSequence(const char* raw, int rawLen, char* sequence, int maxSize);
+
+#endif
@@ -0,0 +1,218 @@
+/**
+ * @file dust.c
+ * @brief DUST masking of low-complexity regions (part of libdnamatch)
+ * @author George Fotiou
+ * @date 01/10/2025
+ *
+ * Low-complexity stretches (poly-A tails, short tandem repeats) match far
+ * more often than chance and flood searches with hits. DUST finds them from
+ * the triplets of a window: a window of l triplets in which triplet t occurs
+ * c_t times scores sum(c_t (c_t - 1) / 2) / (l - 1), the number of pairs of
+ * equal triplets per triplet. Random sequence scores well under 1, a
+ * homopolymer about l / 2.
+ *
+ * The window slides one base at a time. Adding a triplet seen c times adds c
+ * pairs and removing one seen c times removes c - 1, so every window is
+ * scored in O(1) and the whole text in linear time. A window scoring above
+ * level / 10 (level 20 as in dustmasker by default) is masked, less any
+ * triplets at its ends that occur only once in it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dnamatch.h"
+#include "dnamatchInternal.h"
+
+/**
+ * @brief Encodes the triplet starting at a position
+ * @param text Text
+ * @param position Position of its first base
+ * @return 6-bit code of the triplet, or -1 if it holds a non-ACGT base
+ */
+static inline int tripletAt(const char* text, int position) {
+    int a = encodeBase(text[position]);
+    int b = encodeBase(text[position + 1]);
+    int c = encodeBase(text[position + 2]);
+    return a < 0 || b < 0 || c < 0 ? -1 : (a << 4) | (b << 2) | c;
+}
+
+/**
+ * @brief Finds the low-complexity regions of a text with the DUST score
+ * @param text Text to scan
+ * @param textLen Length of the text
+ * @param window Window length in bases, at least 4 (64 is usual)
+ * @param level Threshold times ten: a window scoring above level / 10 is masked
+ * @param regionCount Receives the number of regions
+ * @return Masked regions, disjoint and in text order (free()), or NULL on error
+ */
+DnaRegion* dnaDustMask(const char* text, int textLen, int window, int level, int* regionCount) {
+    int counts[64];
+    int capacity = 16;
+    int used = 0;
+    int pairs = 0;
+    int triplets = 0;
+    int end;
+
+    if (window < 4 || level < 0) {
+        return NULL;
+    }
+    DnaRegion* regions = (DnaRegion*)trackedMalloc(capacity * sizeof(DnaRegion));
+    if (regions == NULL) {
+        return NULL;
+    }
+    memset(counts, 0, sizeof(counts));
+
+    // The window is [end - window, end); its triplets start in [end - window, end - 2)
+    for (end = 3; end <= textLen; end++) {
+        int entering = tripletAt(text, end - 3);
+        if (entering >= 0) {
+            pairs += counts[entering]++;
+            triplets++;
+        }
+        int start = end - window;
+        if (start > 0) {
+            int leaving = tripletAt(text, start - 1);
+            if (leaving >= 0) {
+                pairs -= --counts[leaving];
+                triplets--;
+            }
+        }
+        if (start < 0 && end < textLen) {
+            continue;  // Texts shorter than a window are scored once, whole
+        }
+        if (start < 0) {
+            start = 0;
+        }
+        if (triplets < 2 || 10 * pairs <= level * (triplets - 1)) {
+            continue;
+        }
+
+        // Triplets seen once add nothing to the score; leave them out at the ends
+        int first = start;
+        int last = end - 3;
+        while (first < last) {
+            int code = tripletAt(text, first);
+            if (code >= 0 && counts[code] > 1) {
+                break;
+            }
+            first++;
+        }
+        while (last > first) {
+            int code = tripletAt(text, last);
+            if (code >= 0 && counts[code] > 1) {
+                break;
+            }
+            last--;
+        }
+
+        if (used > 0 && first <= regions[used - 1].end) {
+            if (last + 3 > regions[used - 1].end) {
+                regions[used - 1].end = last + 3;
+            }
+            if (first < regions[used - 1].start) {
+                regions[used - 1].start = first;
+            }
+            continue;
+        }
+        if (used == capacity) {
+            DnaRegion* grown = (DnaRegion*)trackedRealloc(regions, capacity * sizeof(DnaRegion),
+                                                          2 * capacity * sizeof(DnaRegion));
+            if (grown == NULL) {
+                free(regions);
+                return NULL;
+            }
+            regions = grown;
+            capacity *= 2;
+        }
+        regions[used].start = first;
+        regions[used].end = last + 3;
+        used++;
+    }
+
+    // A region widened to the left can reach back over an earlier one
+    *regionCount = dnaNormalizeRegions(regions, used, textLen);
+    return regions;
+}
+
+/**
+ * @brief Computes the parts of the searched regions that are not masked
+ * @param regions Regions to search, or NULL with regionCount 0 for the whole text
+ * @param regionCount Number of regions
+ * @param masked Masked regions, disjoint and in text order, as from dnaDustMask()
+ * @param maskedCount Number of masked regions
+ * @param textLen Length of the text
+ * @param resultCount Receives the number of regions left, which may be 0
+ * @return Regions left, disjoint and in text order (free()), or NULL on error
+ */
+DnaRegion* dnaUnmaskedRegions(const DnaRegion* regions, int regionCount, const DnaRegion* masked,
+                              int maskedCount, int textLen, int* resultCount) {
+    int count = regionCount > 0 ? regionCount : 1;
+    DnaRegion* searched = (DnaRegion*)trackedMalloc(count * sizeof(DnaRegion));
+    DnaRegion* result = (DnaRegion*)trackedMalloc((count + maskedCount) * sizeof(DnaRegion));
+    int used = 0;
+    int r, m = 0;
+
+    if (searched == NULL || result == NULL) {
+        free(searched);
+        free(result);
+        return NULL;
+    }
+    if (regionCount > 0) {
+        memcpy(searched, regions, regionCount * sizeof(DnaRegion));
+        count = dnaNormalizeRegions(searched, regionCount, textLen);
+    } else {
+        searched[0].start = 0;
+        searched[0].end = textLen;
+    }
+
+    // Both lists are sorted, so one sweep cuts every masked region out
+    for (r = 0; r < count; r++) {
+        int from = searched[r].start;
+        while (m < maskedCount && masked[m].end <= from) {
+            m++;
+        }
+        int k;
+        for (k = m; k < maskedCount && masked[k].start < searched[r].end; k++) {
+            if (masked[k].start > from) {
+                result[used].start = from;
+                result[used].end = masked[k].start;
+                used++;
+            }
+            if (masked[k].end > from) {
+                from = masked[k].end;
+            }
+        }
+        if (from < searched[r].end) {
+            result[used].start = from;
+            result[used].end = searched[r].end;
+            used++;
+        }
+    }
+
+    free(searched);
+    *resultCount = used;
+    return result;
+}
+
+/**
+ * @brief Soft-masks regions of a text by turning their bases to lower case
+ * @param text Text to mask in place
+ * @param masked Regions to mask
+ * @param maskedCount Number of regions
+ * @return Number of bases in the regions
+ */
+int dnaSoftMask(char* text, const DnaRegion* masked, int maskedCount) {
+    int bases = 0;
+    int r, i;
+
+    for (r = 0; r < maskedCount; r++) {
+        for (i = masked[r].start; i < masked[r].end; i++) {
+            if (text[i] >= 'A' && text[i] <= 'Z') {
+                text[i] = text[i] - 'A' + 'a';
+            }
+        }
+        bases += masked[r].end - masked[r].start;
+    }
+    return bases;
+}
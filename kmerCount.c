@@ -0,0 +1,399 @@
+/**
+ * @file kmerCount.c
+ * @brief Counting of every k-mer of a sequence (part of libdnamatch)
+ * @author George Fotiou
+ * @date 01/10/2025
+ *
+ * K-mers are 2-bit encoded into 64-bit codes, so k is at most 32. Small k
+ * use a direct-indexed count array shared by all threads. Larger k use a
+ * two-pass partitioned scheme: every thread encodes its slice of the text and
+ * scatters the codes into one bucket per partition, then every thread counts
+ * one partition into its own open-addressing table, so no table is shared.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "dnamatch.h"
+#include "dnamatchInternal.h"
+
+/** Largest k counted with the direct-indexed array (4^k 32-bit counters) */
+#define KMER_DIRECT_MAX_K 12
+
+/** Number of table slots prefetched ahead of the insertion point */
+#define KMER_PREFETCH_DISTANCE 8
+
+/** A growable array of k-mer codes */
+typedef struct {
+    uint64_t* codes;  /**< Codes in insertion order */
+    size_t used;      /**< Number of codes */
+    size_t capacity;  /**< Capacity of codes */
+} KmerBucket;
+
+/** State shared by the counting threads */
+typedef struct {
+    const char* text;         /**< Sequence being counted */
+    int textLen;              /**< Length of the sequence */
+    int k;                    /**< K-mer length */
+    int canonical;            /**< Count min(k-mer, reverse complement) */
+    int threadCount;          /**< Number of threads, also number of partitions */
+    atomic_int nextThread;    /**< Hands out thread indices */
+    atomic_uint* direct;      /**< Direct count array (small k only) */
+    KmerBucket* buckets;      /**< threadCount x threadCount buckets, [thread][partition] */
+    DnaKmerCount** partitions; /**< Counted k-mers of each partition */
+    int* partitionSizes;      /**< Number of distinct k-mers of each partition */
+    atomic_int failed;        /**< Set if any thread ran out of memory */
+} KmerWork;
+
+/**
+ * @brief Writes the bases of an encoded k-mer
+ * @param kmer Encoded k-mer
+ * @param k Length of the k-mer
+ * @param out Buffer of at least k + 1 characters
+ */
+void dnaDecodeKmer(uint64_t kmer, int k, char* out) {
+    static const char bases[4] = {'A', 'C', 'G', 'T'};
+    int i;
+    for (i = k - 1; i >= 0; i--) {
+        out[i] = bases[kmer & 3];
+        kmer >>= 2;
+    }
+    out[k] = '\0';
+}
+
+/**
+ * @brief Scrambles a k-mer code so partitions and slots are evenly used
+ * @param kmer Encoded k-mer
+ * @return 64-bit hash (splitmix64 finalizer)
+ */
+static uint64_t mixKmer(uint64_t kmer) {
+    kmer ^= kmer >> 30;
+    kmer *= 0xbf58476d1ce4e5b9ull;
+    kmer ^= kmer >> 27;
+    kmer *= 0x94d049bb133111ebull;
+    kmer ^= kmer >> 31;
+    return kmer;
+}
+
+/**
+ * @brief Calls a function for every k-mer starting in a slice of the text
+ * @param work Shared counting state
+ * @param from First start position of the slice
+ * @param to One past the last start position of the slice
+ * @param emit Receives each k-mer code (canonical if requested)
+ * @param emitData Passed through to emit
+ */
+static void scanKmers(const KmerWork* work, int from, int to,
+                      void (*emit)(uint64_t kmer, void* emitData), void* emitData) {
+    int k = work->k;
+    uint64_t mask = k == 32 ? ~0ull : (1ull << (2 * k)) - 1;
+    int revShift = 2 * (k - 1);
+    uint64_t forward = 0;
+    uint64_t reverse = 0;
+    int valid = 0;
+    int i;
+
+    // The window ending at i starts at i - k + 1
+    for (i = from; i < to + k - 1; i++) {
+        int code = encodeBase(work->text[i]);
+        if (code < 0) {
+            valid = 0;
+            continue;
+        }
+        forward = ((forward << 2) | (uint64_t)code) & mask;
+        reverse = (reverse >> 2) | ((uint64_t)(3 - code) << revShift);
+        if (++valid >= k) {
+            emit(work->canonical && reverse < forward ? reverse : forward, emitData);
+        }
+    }
+}
+
+/**
+ * @brief Emit function that bumps the shared direct count array
+ * @param kmer Encoded k-mer
+ * @param emitData The direct count array
+ */
+static void countDirect(uint64_t kmer, void* emitData) {
+    atomic_fetch_add_explicit(&((atomic_uint*)emitData)[kmer], 1, memory_order_relaxed);
+}
+
+/** Where a scanning thread scatters its codes */
+typedef struct {
+    KmerBucket* row;  /**< This thread's bucket per partition */
+    int partitions;   /**< Number of partitions */
+    int failed;       /**< Set if a bucket could not grow */
+} ScatterTarget;
+
+/**
+ * @brief Emit function that appends a code to the bucket of its partition
+ * @param kmer Encoded k-mer
+ * @param emitData The ScatterTarget
+ */
+static void scatterKmer(uint64_t kmer, void* emitData) {
+    ScatterTarget* target = (ScatterTarget*)emitData;
+    KmerBucket* bucket = &target->row[(mixKmer(kmer) >> 32) % target->partitions];
+
+    if (bucket->used == bucket->capacity) {
+        size_t newCap = bucket->capacity > 0 ? bucket->capacity * 2 : 1024;
+        uint64_t* bigger = (uint64_t*)trackedRealloc(bucket->codes, bucket->capacity * sizeof(uint64_t),
+                                                     newCap * sizeof(uint64_t));
+        if (bigger == NULL) {
+            target->failed = 1;
+            return;
+        }
+        bucket->codes = bigger;
+        bucket->capacity = newCap;
+    }
+    bucket->codes[bucket->used++] = kmer;
+}
+
+/**
+ * @brief Slice of k-mer start positions scanned by a thread
+ * @param work Shared counting state
+ * @param thread Thread index
+ * @param from Receives the first start position
+ * @param to Receives one past the last start position
+ */
+static void threadSlice(const KmerWork* work, int thread, int* from, int* to) {
+    long starts = work->textLen - work->k + 1;
+    *from = (int)(starts * thread / work->threadCount);
+    *to = (int)(starts * (thread + 1) / work->threadCount);
+}
+
+/**
+ * @brief Thread body for small k: scan a slice into the direct array
+ * @param arg The KmerWork
+ * @return NULL
+ */
+static void* directWorker(void* arg) {
+    KmerWork* work = (KmerWork*)arg;
+    int thread;
+    int from, to;
+
+    // Loop in case fewer threads were started than slices planned
+    while ((thread = atomic_fetch_add(&work->nextThread, 1)) < work->threadCount) {
+        threadSlice(work, thread, &from, &to);
+        scanKmers(work, from, to, countDirect, work->direct);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Thread body for large k, pass 1: scatter a slice into partitions
+ * @param arg The KmerWork
+ * @return NULL
+ */
+static void* scatterWorker(void* arg) {
+    KmerWork* work = (KmerWork*)arg;
+    ScatterTarget target;
+    int thread;
+    int from, to;
+
+    while ((thread = atomic_fetch_add(&work->nextThread, 1)) < work->threadCount) {
+        target.row = &work->buckets[thread * work->threadCount];
+        target.partitions = work->threadCount;
+        target.failed = 0;
+        threadSlice(work, thread, &from, &to);
+        scanKmers(work, from, to, scatterKmer, &target);
+        if (target.failed) {
+            atomic_store(&work->failed, 1);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Counts the codes scattered to one partition into its own table
+ * @param work Shared counting state
+ * @param partition Partition to count
+ */
+static void countPartition(KmerWork* work, int partition) {
+    size_t total = 0;
+    size_t slots = 16;
+    int t;
+
+    for (t = 0; t < work->threadCount; t++) {
+        total += work->buckets[t * work->threadCount + partition].used;
+    }
+    while (slots < 2 * total) {
+        slots *= 2;
+    }
+
+    // A slot with count 0 is empty
+    DnaKmerCount* table = (DnaKmerCount*)trackedCalloc(slots, sizeof(DnaKmerCount));
+    if (table == NULL) {
+        atomic_store(&work->failed, 1);
+        return;
+    }
+    uint64_t mask = slots - 1;
+    int distinct = 0;
+
+    for (t = 0; t < work->threadCount; t++) {
+        const KmerBucket* bucket = &work->buckets[t * work->threadCount + partition];
+        size_t i;
+        for (i = 0; i < bucket->used; i++) {
+            // Pull in the slot of a later insertion while this one probes
+            if (i + KMER_PREFETCH_DISTANCE < bucket->used) {
+                __builtin_prefetch(&table[mixKmer(bucket->codes[i + KMER_PREFETCH_DISTANCE]) & mask], 1);
+            }
+            uint64_t kmer = bucket->codes[i];
+            uint64_t slot = mixKmer(kmer) & mask;
+            while (table[slot].count != 0 && table[slot].kmer != kmer) {
+                slot = (slot + 1) & mask;
+            }
+            if (table[slot].count++ == 0) {
+                table[slot].kmer = kmer;
+                distinct++;
+            }
+        }
+    }
+
+    // Compact the occupied slots in place; a slot never moves forward
+    size_t slot;
+    int used = 0;
+    for (slot = 0; slot < slots; slot++) {
+        if (table[slot].count != 0) {
+            table[used++] = table[slot];
+        }
+    }
+
+    work->partitions[partition] = table;
+    work->partitionSizes[partition] = distinct;
+}
+
+/**
+ * @brief Thread body for large k, pass 2: count one partition
+ * @param arg The KmerWork
+ * @return NULL
+ */
+static void* partitionWorker(void* arg) {
+    KmerWork* work = (KmerWork*)arg;
+    int partition;
+
+    while ((partition = atomic_fetch_add(&work->nextThread, 1)) < work->threadCount) {
+        countPartition(work, partition);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Orders k-mer counts by code
+ * @param a First DnaKmerCount
+ * @param b Second DnaKmerCount
+ * @return Negative, zero or positive as for qsort()
+ */
+static int compareKmers(const void* a, const void* b) {
+    uint64_t x = ((const DnaKmerCount*)a)->kmer;
+    uint64_t y = ((const DnaKmerCount*)b)->kmer;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Counts every k-mer of a sequence
+ * @param text Sequence to count; k-mers containing other characters are skipped
+ * @param textLen Length of the sequence
+ * @param k K-mer length, 1 to 32
+ * @param canonical Non-zero to merge each k-mer with its reverse complement
+ * @param threadCount Number of threads to use
+ * @param distinct Receives the number of distinct k-mers
+ * @return Newly allocated counts sorted by code, or NULL on error
+ */
+DnaKmerCount* dnaCountKmers(const char* text, int textLen, int k, int canonical, int threadCount,
+                            int* distinct) {
+    KmerWork work;
+    DnaKmerCount* result = NULL;
+    int t;
+
+    if (k < 1 || k > 32) {
+        return NULL;
+    }
+
+    memset(&work, 0, sizeof(work));
+    work.text = text;
+    work.textLen = textLen;
+    work.k = k;
+    work.canonical = canonical;
+    // Tiny inputs are not worth a thread each
+    work.threadCount = textLen - k + 1 < 4096 * threadCount ? 1 : threadCount;
+    atomic_init(&work.nextThread, 0);
+    atomic_init(&work.failed, 0);
+    *distinct = 0;
+
+    if (textLen < k) {
+        return (DnaKmerCount*)trackedMalloc(sizeof(DnaKmerCount));
+    }
+
+    if (k <= KMER_DIRECT_MAX_K) {
+        size_t size = (size_t)1 << (2 * k);
+        work.direct = (atomic_uint*)trackedCalloc(size, sizeof(atomic_uint));
+        if (work.direct == NULL) {
+            return NULL;
+        }
+        runWorkers(work.threadCount, directWorker, &work);
+
+        size_t code;
+        int used = 0;
+        for (code = 0; code < size; code++) {
+            used += atomic_load_explicit(&work.direct[code], memory_order_relaxed) != 0;
+        }
+        result = (DnaKmerCount*)trackedMalloc((used > 0 ? used : 1) * sizeof(DnaKmerCount));
+        if (result != NULL) {
+            used = 0;
+            for (code = 0; code < size; code++) {
+                unsigned count = atomic_load_explicit(&work.direct[code], memory_order_relaxed);
+                if (count != 0) {
+                    result[used].kmer = code;
+                    result[used].count = count;
+                    used++;
+                }
+            }
+            *distinct = used;
+        }
+        free(work.direct);
+        return result;
+    }
+
+    int partitions = work.threadCount;
+    work.buckets = (KmerBucket*)trackedCalloc((size_t)partitions * partitions, sizeof(KmerBucket));
+    work.partitions = (DnaKmerCount**)trackedCalloc(partitions, sizeof(DnaKmerCount*));
+    work.partitionSizes = (int*)trackedCalloc(partitions, sizeof(int));
+
+    if (work.buckets != NULL && work.partitions != NULL && work.partitionSizes != NULL) {
+        runWorkers(work.threadCount, scatterWorker, &work);
+        if (!atomic_load(&work.failed)) {
+            atomic_store(&work.nextThread, 0);
+            runWorkers(work.threadCount, partitionWorker, &work);
+        }
+    } else {
+        atomic_store(&work.failed, 1);
+    }
+
+    if (!atomic_load(&work.failed)) {
+        int total = 0;
+        for (t = 0; t < partitions; t++) {
+            total += work.partitionSizes[t];
+        }
+        result = (DnaKmerCount*)trackedMalloc((total > 0 ? total : 1) * sizeof(DnaKmerCount));
+        if (result != NULL) {
+            int used = 0;
+            for (t = 0; t < partitions; t++) {
+                memcpy(result + used, work.partitions[t], work.partitionSizes[t] * sizeof(DnaKmerCount));
+                used += work.partitionSizes[t];
+            }
+            qsort(result, total, sizeof(DnaKmerCount), compareKmers);
+            *distinct = total;
+        }
+    }
+
+    for (t = 0; work.buckets != NULL && t < partitions * partitions; t++) {
+        free(work.buckets[t].codes);
+    }
+    for (t = 0; work.partitions != NULL && t < partitions; t++) {
+        free(work.partitions[t]);
+    }
+    free(work.buckets);
+    free(work.partitions);
+    free(work.partitionSizes);
+    return result;
+}
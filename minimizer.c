@@ -0,0 +1,394 @@
+/**
+ * @file minimizer.c
+ * @brief Sampled (w,k) minimizer index of a sequence (part of libdnamatch)
+ * @author George Fotiou
+ * @date 01/10/2025
+ *
+ * Of every w consecutive k-mers only the one with the smallest hash, the
+ * minimizer, is indexed, and consecutive windows usually share it, so about
+ * 2 / (w + 1) of the positions are kept instead of all of them. The index is
+ * a sorted array of the distinct minimizer k-mers with offsets into one array
+ * of positions, ascending for each k-mer.
+ *
+ * A pattern of at least w + k - 1 bases holds a whole window, and every
+ * occurrence of the pattern holds the same window, so it has the same
+ * minimizer at the same offset. Looking up the pattern's rarest minimizer
+ * therefore gives a superset of the occurrences, which the exact engines then
+ * verify one by one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dnamatch.h"
+#include "dnamatchInternal.h"
+
+/** Compiled minimizer index, immutable after dnaMinimizerIndexBuild() */
+struct DnaMinimizerIndex {
+    int k;            /**< K-mer length */
+    int w;            /**< Window, in k-mers */
+    int keyCount;     /**< Number of distinct minimizer k-mers */
+    int entryCount;   /**< Number of indexed positions */
+    uint64_t* keys;   /**< Distinct minimizer k-mers, ascending */
+    int* offsets;     /**< keyCount + 1 starts of each key's positions */
+    int* positions;   /**< Text positions of the minimizers, grouped by key */
+};
+
+/** One sampled minimizer: a k-mer and where it starts */
+typedef struct {
+    uint64_t kmer;  /**< 2-bit encoded k-mer */
+    int position;   /**< Start of the k-mer */
+} MinimizerEntry;
+
+/** Receives the minimizers found by scanMinimizers() */
+typedef int (*MinimizerSink)(uint64_t kmer, int position, void* userData);
+
+/**
+ * @brief Orders k-mers pseudo-randomly, so runs such as AAAA... are not always minimal
+ * @param kmer 2-bit encoded k-mer
+ * @return 64-bit hash (splitmix64 finalizer, a bijection, so only equal k-mers tie)
+ */
+static inline uint64_t minimizerOrder(uint64_t kmer) {
+    kmer ^= kmer >> 30;
+    kmer *= 0xbf58476d1ce4e5b9ULL;
+    kmer ^= kmer >> 27;
+    kmer *= 0x94d049bb133111ebULL;
+    kmer ^= kmer >> 31;
+    return kmer;
+}
+
+/**
+ * @brief Reports the minimizer of every window of w k-mers, once per run of windows sharing it
+ *
+ * A monotone queue holds the candidates of the current window in increasing
+ * hash order, so each k-mer is pushed and popped once. Ties go to the
+ * leftmost k-mer; k-mers holding a non-ACGT character are never candidates.
+ *
+ * @param text Sequence
+ * @param textLen Length of the sequence
+ * @param k K-mer length, 1 to 32
+ * @param w Window, in k-mers
+ * @param sink Called with every new minimizer, in increasing position order
+ * @param userData Passed through to sink
+ * @return 0 on success, -1 on error or if sink failed
+ */
+static int scanMinimizers(const char* text, int textLen, int k, int w, MinimizerSink sink, void* userData) {
+    uint64_t mask = k == 32 ? ~0ULL : (1ULL << (2 * k)) - 1;
+    int* queue = (int*)trackedMalloc((w + 1) * sizeof(int));
+    uint64_t* kmers = (uint64_t*)trackedMalloc((w + 1) * sizeof(uint64_t));
+    uint64_t* orders = (uint64_t*)trackedMalloc((w + 1) * sizeof(uint64_t));
+    uint64_t kmer = 0;
+    int head = 0;
+    int size = 0;
+    int valid = 0;
+    int lastReported = -1;
+    int i;
+
+    if (queue == NULL || kmers == NULL || orders == NULL) {
+        free(queue);
+        free(kmers);
+        free(orders);
+        return -1;
+    }
+
+    for (i = 0; i < textLen; i++) {
+        int code = encodeBase(text[i]);
+        if (code < 0) {
+            valid = 0;
+            kmer = 0;
+        } else {
+            kmer = ((kmer << 2) | (uint64_t)code) & mask;
+            valid++;
+        }
+
+        int start = i - k + 1;
+        if (start < 0) {
+            continue;
+        }
+
+        // The queue is a ring of w + 1 slots indexed by position
+        while (size > 0 && queue[head] <= start - w) {
+            head = (head + 1) % (w + 1);
+            size--;
+        }
+        if (valid >= k) {
+            uint64_t order = minimizerOrder(kmer);
+            while (size > 0 && orders[(head + size - 1) % (w + 1)] > order) {
+                size--;
+            }
+            int slot = (head + size) % (w + 1);
+            queue[slot] = start;
+            kmers[slot] = kmer;
+            orders[slot] = order;
+            size++;
+        }
+
+        if (start >= w - 1 && size > 0 && queue[head] != lastReported) {
+            lastReported = queue[head];
+            if (sink(kmers[head], queue[head], userData) != 0) {
+                free(queue);
+                free(kmers);
+                free(orders);
+                return -1;
+            }
+        }
+    }
+
+    free(queue);
+    free(kmers);
+    free(orders);
+    return 0;
+}
+
+/** Growable list of minimizers filled by appendMinimizer() */
+typedef struct {
+    MinimizerEntry* entries;  /**< Minimizers in position order */
+    int count;                /**< Number of minimizers */
+    int capacity;             /**< Allocated size of entries */
+} MinimizerList;
+
+/**
+ * @brief Sink of scanMinimizers() that appends to a MinimizerList
+ * @param kmer Minimizer k-mer
+ * @param position Its start
+ * @param userData The MinimizerList
+ * @return 0 on success, -1 on allocation failure
+ */
+static int appendMinimizer(uint64_t kmer, int position, void* userData) {
+    MinimizerList* list = (MinimizerList*)userData;
+
+    if (list->count == list->capacity) {
+        int capacity = list->capacity > 0 ? 2 * list->capacity : 1024;
+        MinimizerEntry* grown = (MinimizerEntry*)trackedRealloc(list->entries,
+                                                                list->capacity * sizeof(MinimizerEntry),
+                                                                capacity * sizeof(MinimizerEntry));
+        if (grown == NULL) {
+            return -1;
+        }
+        list->entries = grown;
+        list->capacity = capacity;
+    }
+    list->entries[list->count].kmer = kmer;
+    list->entries[list->count].position = position;
+    list->count++;
+    return 0;
+}
+
+/**
+ * @brief Orders minimizers by k-mer, then by position
+ * @param a First MinimizerEntry
+ * @param b Second MinimizerEntry
+ * @return Negative, zero or positive as for qsort()
+ */
+static int compareMinimizers(const void* a, const void* b) {
+    const MinimizerEntry* x = (const MinimizerEntry*)a;
+    const MinimizerEntry* y = (const MinimizerEntry*)b;
+    if (x->kmer != y->kmer) {
+        return x->kmer < y->kmer ? -1 : 1;
+    }
+    return (x->position > y->position) - (x->position < y->position);
+}
+
+/**
+ * @brief Builds the minimizer index of a sequence
+ * @param text Sequence to index; not kept, pass it again to dnaMinimizerSearch()
+ * @param textLen Length of the sequence
+ * @param k K-mer length, 1 to 32
+ * @param w Window, in k-mers, at least 1
+ * @return New index to release with dnaMinimizerIndexFree(), or NULL on error
+ */
+DnaMinimizerIndex* dnaMinimizerIndexBuild(const char* text, int textLen, int k, int w) {
+    MinimizerList list;
+    int i;
+
+    if (k < 1 || k > 32 || w < 1) {
+        return NULL;
+    }
+
+    memset(&list, 0, sizeof(list));
+    if (scanMinimizers(text, textLen, k, w, appendMinimizer, &list) != 0) {
+        free(list.entries);
+        return NULL;
+    }
+    qsort(list.entries, list.count, sizeof(MinimizerEntry), compareMinimizers);
+
+    DnaMinimizerIndex* index = (DnaMinimizerIndex*)trackedCalloc(1, sizeof(DnaMinimizerIndex));
+    int distinct = 0;
+    for (i = 0; i < list.count; i++) {
+        distinct += i == 0 || list.entries[i].kmer != list.entries[i - 1].kmer;
+    }
+    if (index != NULL) {
+        index->keys = (uint64_t*)trackedMalloc((distinct > 0 ? distinct : 1) * sizeof(uint64_t));
+        index->offsets = (int*)trackedMalloc((distinct + 1) * sizeof(int));
+        index->positions = (int*)trackedMalloc((list.count > 0 ? list.count : 1) * sizeof(int));
+    }
+    if (index == NULL || index->keys == NULL || index->offsets == NULL || index->positions == NULL) {
+        free(list.entries);
+        dnaMinimizerIndexFree(index);
+        return NULL;
+    }
+
+    index->k = k;
+    index->w = w;
+    index->entryCount = list.count;
+    for (i = 0; i < list.count; i++) {
+        if (i == 0 || list.entries[i].kmer != list.entries[i - 1].kmer) {
+            index->keys[index->keyCount] = list.entries[i].kmer;
+            index->offsets[index->keyCount++] = i;
+        }
+        index->positions[i] = list.entries[i].position;
+    }
+    index->offsets[index->keyCount] = list.count;
+
+    free(list.entries);
+    return index;
+}
+
+/**
+ * @brief Releases a minimizer index
+ * @param index Index returned by dnaMinimizerIndexBuild(), or NULL
+ */
+void dnaMinimizerIndexFree(DnaMinimizerIndex* index) {
+    if (index == NULL) {
+        return;
+    }
+    free(index->keys);
+    free(index->offsets);
+    free(index->positions);
+    free(index);
+}
+
+/**
+ * @brief Reports the number of positions held by an index
+ * @param index Minimizer index
+ * @return Number of indexed minimizer positions
+ */
+int dnaMinimizerIndexSize(const DnaMinimizerIndex* index) {
+    return index->entryCount;
+}
+
+/**
+ * @brief Reports the memory held by an index
+ * @param index Minimizer index
+ * @return Bytes of keys, offsets and positions
+ */
+size_t dnaMinimizerIndexBytes(const DnaMinimizerIndex* index) {
+    return sizeof(DnaMinimizerIndex) + index->keyCount * sizeof(uint64_t) +
+           (index->keyCount + 1) * sizeof(int) + index->entryCount * sizeof(int);
+}
+
+/**
+ * @brief Finds the positions of a k-mer in the index
+ * @param index Minimizer index
+ * @param kmer 2-bit encoded k-mer
+ * @param first Receives the first position slot
+ * @return Number of positions, 0 if the k-mer is not a minimizer
+ */
+static int lookupMinimizer(const DnaMinimizerIndex* index, uint64_t kmer, int* first) {
+    int low = 0;
+    int high = index->keyCount;
+
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (index->keys[middle] < kmer) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low == index->keyCount || index->keys[low] != kmer) {
+        return 0;
+    }
+    *first = index->offsets[low];
+    return index->offsets[low + 1] - index->offsets[low];
+}
+
+/** Counts the hit of one verified candidate window */
+typedef struct {
+    int found;  /**< Set by countCandidateHit() */
+} CandidateCheck;
+
+/**
+ * @brief Hit callback of the verification of one candidate
+ * @param position Offset of the match in the candidate window (always 0)
+ * @param userData The CandidateCheck
+ * @return 1, one hit is all a window can hold
+ */
+static int countCandidateHit(int position, void* userData) {
+    (void)position;
+    ((CandidateCheck*)userData)->found = 1;
+    return 1;
+}
+
+/**
+ * @brief Finds a pattern through the minimizer index, verifying every candidate
+ *
+ * The candidates are the occurrences of whichever minimizer of the pattern is
+ * rarest in the index, each verified with the matcher's exact engine. A
+ * pattern too short to hold a whole window (w + k - 1 bases), or holding no
+ * minimizer, is searched with a plain scan instead. Overlapping matches are
+ * all reported, whatever the matcher's flags.
+ *
+ * @param index Index of text
+ * @param matcher Compiled pattern used for verification
+ * @param pattern The same pattern
+ * @param patternLen Its length
+ * @param text The indexed text
+ * @param textLen Its length
+ * @param maxHits Stop after this many hits, 0 for no limit
+ * @param positions Receives the first min(maxHits, matches) positions in text order; may be NULL if maxHits is 0
+ * @return Number of matches (at most maxHits if non-zero), or -1 on error
+ */
+int dnaMinimizerSearch(const DnaMinimizerIndex* index, const DnaMatcher* matcher, const char* pattern,
+                       int patternLen, const char* text, int textLen, int maxHits, int* positions) {
+    MinimizerList probe;
+    int best = -1;
+    int bestCount = 0;
+    int bestFirst = 0;
+    int matches = 0;
+    int i;
+
+    memset(&probe, 0, sizeof(probe));
+    if (patternLen >= index->w + index->k - 1 &&
+        scanMinimizers(pattern, patternLen, index->k, index->w, appendMinimizer, &probe) != 0) {
+        free(probe.entries);
+        return -1;
+    }
+
+    // The rarest minimizer of the pattern gives the fewest candidates
+    for (i = 0; i < probe.count; i++) {
+        int first = 0;
+        int count = lookupMinimizer(index, probe.entries[i].kmer, &first);
+        if (best < 0 || count < bestCount) {
+            best = i;
+            bestCount = count;
+            bestFirst = first;
+        }
+    }
+    if (best < 0) {
+        free(probe.entries);
+        return dnaParallelSearch(matcher, text, textLen, 1, maxHits, positions);
+    }
+
+    int offset = probe.entries[best].position;
+    free(probe.entries);
+    for (i = 0; i < bestCount; i++) {
+        int start = index->positions[bestFirst + i] - offset;
+        if (start < 0 || start > textLen - patternLen) {
+            continue;
+        }
+        CandidateCheck check;
+        check.found = 0;
+        dnaMatcherSearch(matcher, text + start, patternLen, countCandidateHit, &check);
+        if (check.found) {
+            if (maxHits > 0) {
+                positions[matches] = start;
+            }
+            matches++;
+            if (matches == maxHits) {
+                break;
+            }
+        }
+    }
+    return matches;
+}
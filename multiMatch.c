@@ -0,0 +1,903 @@
+/**
+ * @file multiMatch.c
+ * @brief Multi-pattern search over a set of patterns (part of libdnamatch)
+ * @author George Fotiou
+ * @date 01/10/2025
+ *
+ * A pattern set is searched in one pass per distinct pattern length instead of
+ * one pass per pattern. Every pass rolls a fingerprint of the current window
+ * over the 2-bit base codes and looks it up in an open-addressing table of
+ * the fingerprints of all patterns of that length. Up to 32 bases the
+ * fingerprint is the packed window itself, so a table hit is a match; longer
+ * patterns use a polynomial hash modulo 2^64 and are verified.
+ *
+ * For very large sets (millions of probes) the table no longer fits in cache
+ * and most lookups miss. An optional blocked Bloom filter then answers the
+ * common "no pattern here" case with a single cache line per window.
+ *
+ * A set can instead be compiled for Wu-Manber, which slides one window of the
+ * shortest pattern length over the text and skips ahead by a shift looked up
+ * from the q-gram ending the window. With long patterns most shifts are large,
+ * so most of the text is never looked at.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "dnamatch.h"
+#include "dnamatchInternal.h"
+
+/** Window starts per chunk when counting with several threads */
+#define MULTI_CHUNK 65536
+
+/** Multiplier of the rolling hash for patterns longer than 32 bases */
+#define MULTI_HASH_BASE 0x9e3779b97f4a7c15ull
+
+/** 64-bit words per Bloom filter block; 8 words are one 64-byte cache line */
+#define BLOOM_BLOCK_WORDS 8
+
+/** Bits per Bloom filter block */
+#define BLOOM_BLOCK_BITS (BLOOM_BLOCK_WORDS * 64)
+
+/** Most bit probes per key */
+#define BLOOM_MAX_PROBES 16
+
+/** Mixed into the hash before deriving the in-block probes */
+#define BLOOM_SEED 0x5bd1e9955bd1e995ull
+
+/** Smallest and largest Wu-Manber q-gram length */
+#define WM_MIN_GRAM 4
+#define WM_MAX_GRAM 8
+
+/** Longest prefix compared in packed form before verifying a Wu-Manber candidate */
+#define WM_MAX_PREFIX 16
+
+/** One slot of a fingerprint table */
+typedef struct {
+    uint64_t key;  /**< Fingerprint of the patterns in this slot */
+    int pattern;   /**< First pattern with this fingerprint, -1 if the slot is empty */
+} FingerprintSlot;
+
+/** Patterns of one length and their fingerprint table */
+typedef struct {
+    int length;              /**< Length shared by the patterns */
+    int exact;               /**< Fingerprints are the packed bases (length <= 32) */
+    uint64_t base;           /**< Multiplier of the rolling fingerprint */
+    uint64_t dropPower;      /**< base^length, removes the base leaving the window */
+    FingerprintSlot* slots;  /**< Open-addressing table, a power of two in size */
+    uint64_t mask;           /**< Number of slots - 1 */
+    uint64_t* bloom;         /**< Cache-line aligned Bloom filter blocks, or NULL */
+    void* bloomMemory;       /**< Allocation holding bloom */
+    uint64_t bloomBlocks;    /**< Number of blocks */
+    int bloomProbes;         /**< Bits set per key */
+} LengthGroup;
+
+/** A compiled set of patterns */
+struct DnaPatternSet {
+    int count;            /**< Number of patterns */
+    char** patterns;      /**< Private copies of the patterns */
+    int* lengths;         /**< Length of every pattern */
+    int* nextSame;        /**< Next pattern with the same fingerprint, or -1 */
+    int maxLength;        /**< Longest pattern */
+    int groupCount;       /**< Number of distinct searchable lengths */
+    LengthGroup* groups;  /**< One group per length */
+    DnaMultiAlgorithm algorithm;  /**< Engine the set was compiled for */
+    int minLength;        /**< Wu-Manber window: the shortest searchable pattern, 0 if none */
+    int gramLength;       /**< Wu-Manber q-gram length */
+    int prefixLength;     /**< Bases in candidatePrefix */
+    int* shift;           /**< Wu-Manber shift of every q-gram (4^q entries) */
+    int* gramStart;       /**< First candidate of every q-gram (4^q + 1 entries) */
+    int* candidates;      /**< Patterns grouped by the q-gram ending their window */
+    uint32_t* candidatePrefix;  /**< Packed first prefixLength bases of every candidate */
+};
+
+/**
+ * @brief Scrambles a fingerprint so table slots are evenly used
+ * @param key Fingerprint
+ * @return 64-bit hash (splitmix64 finalizer)
+ */
+static inline uint64_t mixFingerprint(uint64_t key) {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebull;
+    key ^= key >> 31;
+    return key;
+}
+
+/**
+ * @brief Computes the fingerprint of a whole pattern
+ * @param group Group the pattern belongs to
+ * @param pattern Pattern bases
+ * @param key Receives the fingerprint
+ * @return 0 on success, -1 if the pattern holds a non-ACGT character
+ */
+static int fingerprintPattern(const LengthGroup* group, const char* pattern, uint64_t* key) {
+    uint64_t value = 0;
+    int i;
+    for (i = 0; i < group->length; i++) {
+        int code = encodeBase(pattern[i]);
+        if (code < 0) {
+            return -1;
+        }
+        value = value * group->base + (uint64_t)code;
+    }
+    *key = value;
+    return 0;
+}
+
+/**
+ * @brief Finds the slot holding a fingerprint, or the empty slot it belongs in
+ * @param group Group to look in
+ * @param key Fingerprint
+ * @param hash mixFingerprint(key)
+ * @return Slot for the key
+ */
+static inline FingerprintSlot* findSlot(const LengthGroup* group, uint64_t key, uint64_t hash) {
+    uint64_t slot = hash & group->mask;
+    while (group->slots[slot].pattern >= 0 && group->slots[slot].key != key) {
+        slot = (slot + 1) & group->mask;
+    }
+    return &group->slots[slot];
+}
+
+/**
+ * @brief Returns the Bloom filter block of a key
+ * @param group Group with a Bloom filter
+ * @param hash mixFingerprint() of the key; its high half picks the block
+ * @return First word of the block
+ */
+static inline uint64_t* bloomBlock(const LengthGroup* group, uint64_t hash) {
+    return group->bloom + (((hash >> 32) * group->bloomBlocks) >> 32) * BLOOM_BLOCK_WORDS;
+}
+
+/**
+ * @brief Sets the bits of a key in the Bloom filter
+ * @param group Group with a Bloom filter
+ * @param hash mixFingerprint() of the key
+ */
+static void bloomAdd(LengthGroup* group, uint64_t hash) {
+    uint64_t* block = bloomBlock(group, hash);
+    uint64_t bits = mixFingerprint(hash ^ BLOOM_SEED);
+    int i;
+
+    for (i = 0; i < group->bloomProbes; i++) {
+        // Seven 9-bit probes per 64 mixed bits
+        if (i > 0 && i % 7 == 0) {
+            bits = mixFingerprint(bits);
+        }
+        block[(bits & (BLOOM_BLOCK_BITS - 1)) >> 6] |= 1ull << (bits & 63);
+        bits >>= 9;
+    }
+}
+
+/**
+ * @brief Tests whether a key may be in the Bloom filter
+ * @param group Group with a Bloom filter
+ * @param hash mixFingerprint() of the key
+ * @return 0 if the key is certainly absent, 1 if it may be present
+ */
+static inline int bloomMayContain(const LengthGroup* group, uint64_t hash) {
+    const uint64_t* block = bloomBlock(group, hash);
+    uint64_t bits = mixFingerprint(hash ^ BLOOM_SEED);
+    int i;
+
+    for (i = 0; i < group->bloomProbes; i++) {
+        if (i > 0 && i % 7 == 0) {
+            bits = mixFingerprint(bits);
+        }
+        if ((block[(bits & (BLOOM_BLOCK_BITS - 1)) >> 6] & (1ull << (bits & 63))) == 0) {
+            return 0;
+        }
+        bits >>= 9;
+    }
+    return 1;
+}
+
+/**
+ * @brief Approximates log2(1 / rate), to size a Bloom filter without libm
+ * @param rate False-positive rate, between 0 and 1
+ * @return log2(1 / rate), within 0.1
+ */
+static double inverseLog2(double rate) {
+    double x = 1.0 / rate;
+    double result = 0;
+    while (x >= 2) {
+        x /= 2;
+        result += 1;
+    }
+    // log2(x) ~ x - 1 on [1, 2)
+    return result + (x - 1);
+}
+
+/**
+ * @brief Allocates a Bloom filter sized for a group and a false-positive rate
+ *
+ * The classic optimum is log2(1/p) probes and 1.44 * log2(1/p) bits per key.
+ * Keeping every probe of a key in one cache line raises the rate slightly,
+ * so one extra bit per key is added.
+ *
+ * @param group Group to filter
+ * @param members Number of patterns in the group
+ * @param falsePositiveRate Target rate, between 0 and 1
+ * @return 0 on success, -1 on error
+ */
+static int allocateBloom(LengthGroup* group, int members, double falsePositiveRate) {
+    double probes = inverseLog2(falsePositiveRate);
+    double bits = (1.44 * probes + 1) * members;
+
+    group->bloomProbes = (int)(probes + 0.5);
+    if (group->bloomProbes < 1) {
+        group->bloomProbes = 1;
+    }
+    if (group->bloomProbes > BLOOM_MAX_PROBES) {
+        group->bloomProbes = BLOOM_MAX_PROBES;
+    }
+    group->bloomBlocks = (uint64_t)(bits / BLOOM_BLOCK_BITS) + 1;
+
+    size_t size = group->bloomBlocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+    group->bloomMemory = trackedCalloc(size + 63, 1);
+    if (group->bloomMemory == NULL) {
+        return -1;
+    }
+    group->bloom = (uint64_t*)(((uintptr_t)group->bloomMemory + 63) & ~(uintptr_t)63);
+    return 0;
+}
+
+/**
+ * @brief Orders integers
+ * @param a First int
+ * @param b Second int
+ * @return Negative, zero or positive as for qsort()
+ */
+static int compareInts(const void* a, const void* b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Builds the fingerprint table, and optionally the Bloom filter, of one length group
+ * @param set Pattern set with patterns, lengths and nextSame allocated
+ * @param group Group whose length is set; receives its table
+ * @param falsePositiveRate Bloom filter target rate, 0 for no filter
+ * @return 0 on success, -1 on error
+ */
+static int buildGroup(DnaPatternSet* set, LengthGroup* group, double falsePositiveRate) {
+    int members = 0;
+    uint64_t slots = 1;
+    int p, i;
+
+    for (p = 0; p < set->count; p++) {
+        members += set->lengths[p] == group->length;
+    }
+    // At most half full, so probes stay short
+    while (slots < 2 * (uint64_t)members) {
+        slots <<= 1;
+    }
+
+    group->exact = group->length <= 32;
+    group->base = group->exact ? 4 : MULTI_HASH_BASE;
+    group->dropPower = 1;
+    for (i = 0; i < group->length; i++) {
+        group->dropPower *= group->base;
+    }
+    group->mask = slots - 1;
+    group->slots = (FingerprintSlot*)trackedMalloc(slots * sizeof(FingerprintSlot));
+    if (group->slots == NULL) {
+        return -1;
+    }
+    for (i = 0; i < (int)slots; i++) {
+        group->slots[i].pattern = -1;
+    }
+    if (falsePositiveRate > 0 && falsePositiveRate < 1 &&
+        allocateBloom(group, members, falsePositiveRate) != 0) {
+        return -1;
+    }
+
+    // Insert in reverse so every chain lists its patterns in input order
+    for (p = set->count - 1; p >= 0; p--) {
+        uint64_t key;
+        if (set->lengths[p] != group->length || fingerprintPattern(group, set->patterns[p], &key) != 0) {
+            continue;
+        }
+        uint64_t hash = mixFingerprint(key);
+        FingerprintSlot* slot = findSlot(group, key, hash);
+        slot->key = key;
+        set->nextSame[p] = slot->pattern;
+        slot->pattern = p;
+        if (group->bloom != NULL) {
+            bloomAdd(group, hash);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Packs bases into 2-bit codes
+ * @param bases Bases to pack
+ * @param length Number of bases, at most 32
+ * @param packed Receives the packed bases, first base most significant
+ * @return 0 on success, -1 if a base is not A, C, G or T
+ */
+static inline int packBases(const char* bases, int length, uint64_t* packed) {
+    uint64_t value = 0;
+    int i;
+    for (i = 0; i < length; i++) {
+        int code = encodeBase(bases[i]);
+        if (code < 0) {
+            return -1;
+        }
+        value = (value << 2) | (uint64_t)code;
+    }
+    *packed = value;
+    return 0;
+}
+
+/**
+ * @brief Tests whether a pattern can match at all
+ * @param pattern Pattern bases
+ * @param length Length of the pattern
+ * @return 1 if the pattern is non-empty and only holds A, C, G and T
+ */
+static int isSearchable(const char* pattern, int length) {
+    int i;
+    for (i = 0; i < length; i++) {
+        if (encodeBase(pattern[i]) < 0) {
+            return 0;
+        }
+    }
+    return length > 0;
+}
+
+/**
+ * @brief Builds the Wu-Manber shift table and candidate lists
+ *
+ * The q-gram length grows with the set so that 4^q comfortably exceeds the
+ * number of (pattern, q-gram) pairs, keeping most shifts non-zero; it is
+ * clamped to WM_MIN_GRAM..WM_MAX_GRAM and to the window length.
+ *
+ * @param set Pattern set with patterns and lengths filled in
+ * @return 0 on success, -1 on error
+ */
+static int buildWuManber(DnaPatternSet* set) {
+    int searchable = 0;
+    int p, j;
+
+    set->minLength = 0;
+    for (p = 0; p < set->count; p++) {
+        if (isSearchable(set->patterns[p], set->lengths[p])) {
+            if (searchable == 0 || set->lengths[p] < set->minLength) {
+                set->minLength = set->lengths[p];
+            }
+            searchable++;
+        }
+    }
+    if (searchable == 0) {
+        return 0;
+    }
+
+    int window = set->minLength;
+    int q = WM_MIN_GRAM;
+    while (q < WM_MAX_GRAM && (1ull << (2 * q)) < 2ull * window * searchable) {
+        q++;
+    }
+    if (q > window) {
+        q = window;
+    }
+    set->gramLength = q;
+    set->prefixLength = window < WM_MAX_PREFIX ? window : WM_MAX_PREFIX;
+
+    size_t grams = (size_t)1 << (2 * q);
+    set->shift = (int*)trackedMalloc(grams * sizeof(int));
+    set->gramStart = (int*)trackedCalloc(grams + 1, sizeof(int));
+    set->candidates = (int*)trackedMalloc(searchable * sizeof(int));
+    set->candidatePrefix = (uint32_t*)trackedMalloc(searchable * sizeof(uint32_t));
+    int* cursor = (int*)trackedMalloc(grams * sizeof(int));
+    if (set->shift == NULL || set->gramStart == NULL || set->candidates == NULL ||
+        set->candidatePrefix == NULL || cursor == NULL) {
+        free(cursor);
+        return -1;
+    }
+
+    // A q-gram never seen in any window lets the window jump past it
+    for (j = 0; j < (int)grams; j++) {
+        set->shift[j] = window - q + 1;
+    }
+    for (p = 0; p < set->count; p++) {
+        uint64_t gram = 0;
+        if (!isSearchable(set->patterns[p], set->lengths[p])) {
+            continue;
+        }
+        for (j = q - 1; j < window; j++) {
+            packBases(set->patterns[p] + j - q + 1, q, &gram);
+            if (window - 1 - j < set->shift[gram]) {
+                set->shift[gram] = window - 1 - j;
+            }
+        }
+        // gram now ends the window; count the pattern as its candidate
+        set->gramStart[gram + 1]++;
+    }
+
+    for (j = 0; j < (int)grams; j++) {
+        set->gramStart[j + 1] += set->gramStart[j];
+        cursor[j] = set->gramStart[j];
+    }
+    for (p = 0; p < set->count; p++) {
+        uint64_t gram = 0;
+        uint64_t prefix = 0;
+        if (!isSearchable(set->patterns[p], set->lengths[p])) {
+            continue;
+        }
+        packBases(set->patterns[p] + window - q, q, &gram);
+        packBases(set->patterns[p], set->prefixLength, &prefix);
+        set->candidates[cursor[gram]] = p;
+        set->candidatePrefix[cursor[gram]] = (uint32_t)prefix;
+        cursor[gram]++;
+    }
+
+    free(cursor);
+    return 0;
+}
+
+/**
+ * @brief Compiles a set of patterns for multi-pattern search
+ *
+ * Only A, C, G and T can match; a pattern holding any other character, or an
+ * empty one, is kept in the numbering but never reported.
+ *
+ * @param patterns Patterns to search for (need not be NUL-terminated)
+ * @param lengths Length of every pattern
+ * @param count Number of patterns
+ * @param options Build options, or NULL for the defaults
+ * @return New set to release with dnaPatternSetFree(), or NULL on error
+ */
+DnaPatternSet* dnaPatternSetCreateWith(const char* const* patterns, const int* lengths, int count,
+                                       const DnaPatternSetOptions* options) {
+    double falsePositiveRate = options != NULL ? options->bloomFpr : 0;
+    DnaPatternSet* set = (DnaPatternSet*)trackedCalloc(1, sizeof(DnaPatternSet));
+    int* distinct = (int*)trackedMalloc((count > 0 ? count : 1) * sizeof(int));
+    int used = 0;
+    int p;
+
+    if (set == NULL || distinct == NULL) {
+        free(set);
+        free(distinct);
+        return NULL;
+    }
+
+    set->count = count;
+    set->algorithm = options != NULL ? options->algorithm : DNA_MULTI_KARP_RABIN;
+    set->patterns = (char**)trackedCalloc(count > 0 ? count : 1, sizeof(char*));
+    set->lengths = (int*)trackedMalloc((count > 0 ? count : 1) * sizeof(int));
+    set->nextSame = (int*)trackedMalloc((count > 0 ? count : 1) * sizeof(int));
+    if (set->patterns == NULL || set->lengths == NULL || set->nextSame == NULL) {
+        free(distinct);
+        dnaPatternSetFree(set);
+        return NULL;
+    }
+
+    for (p = 0; p < count; p++) {
+        set->lengths[p] = lengths[p] > 0 ? lengths[p] : 0;
+        set->nextSame[p] = -1;
+        set->patterns[p] = (char*)trackedMalloc(set->lengths[p] + 1);
+        if (set->patterns[p] == NULL) {
+            free(distinct);
+            dnaPatternSetFree(set);
+            return NULL;
+        }
+        memcpy(set->patterns[p], patterns[p], set->lengths[p]);
+        set->patterns[p][set->lengths[p]] = '\0';
+        if (set->lengths[p] > set->maxLength) {
+            set->maxLength = set->lengths[p];
+        }
+        if (set->lengths[p] > 0) {
+            distinct[used++] = set->lengths[p];
+        }
+    }
+
+    if (set->algorithm == DNA_MULTI_WU_MANBER) {
+        free(distinct);
+        if (buildWuManber(set) != 0) {
+            dnaPatternSetFree(set);
+            return NULL;
+        }
+        return set;
+    }
+
+    // One group, and so one pass over the text, per distinct length
+    qsort(distinct, used, sizeof(int), compareInts);
+    set->groups = (LengthGroup*)trackedCalloc(used > 0 ? used : 1, sizeof(LengthGroup));
+    if (set->groups == NULL) {
+        free(distinct);
+        dnaPatternSetFree(set);
+        return NULL;
+    }
+    for (p = 0; p < used; p++) {
+        if (p > 0 && distinct[p] == distinct[p - 1]) {
+            continue;
+        }
+        LengthGroup* group = &set->groups[set->groupCount++];
+        group->length = distinct[p];
+        if (buildGroup(set, group, falsePositiveRate) != 0) {
+            free(distinct);
+            dnaPatternSetFree(set);
+            return NULL;
+        }
+    }
+
+    free(distinct);
+    return set;
+}
+
+/**
+ * @brief Compiles a set of patterns with the default options (no prefilter)
+ * @param patterns Patterns to search for (need not be NUL-terminated)
+ * @param lengths Length of every pattern
+ * @param count Number of patterns
+ * @return New set to release with dnaPatternSetFree(), or NULL on error
+ */
+DnaPatternSet* dnaPatternSetCreate(const char* const* patterns, const int* lengths, int count) {
+    return dnaPatternSetCreateWith(patterns, lengths, count, NULL);
+}
+
+/**
+ * @brief Releases a pattern set
+ * @param set Set returned by dnaPatternSetCreate(), or NULL
+ */
+void dnaPatternSetFree(DnaPatternSet* set) {
+    int i;
+
+    if (set == NULL) {
+        return;
+    }
+    for (i = 0; set->patterns != NULL && i < set->count; i++) {
+        free(set->patterns[i]);
+    }
+    for (i = 0; set->groups != NULL && i < set->groupCount; i++) {
+        free(set->groups[i].slots);
+        free(set->groups[i].bloomMemory);
+    }
+    free(set->patterns);
+    free(set->lengths);
+    free(set->nextSame);
+    free(set->groups);
+    free(set->shift);
+    free(set->gramStart);
+    free(set->candidates);
+    free(set->candidatePrefix);
+    free(set);
+}
+
+/**
+ * @brief Returns the number of patterns of a set
+ * @param set Pattern set
+ * @return Number of patterns, including ones that can never match
+ */
+int dnaPatternSetSize(const DnaPatternSet* set) {
+    return set->count;
+}
+
+/**
+ * @brief Rolls one length group over a text, reporting every hit
+ * @param set Pattern set
+ * @param group Group to search for
+ * @param text Text to search in
+ * @param textLen Length of the text
+ * @param startLimit Only windows starting before this position are tested
+ * @param onHit Callback for each match
+ * @param userData Passed through to onHit
+ * @param stopped Set to non-zero if onHit asked to stop
+ * @param filterStats Prefilter counters to add to
+ * @return Number of matches found
+ */
+static int searchGroup(const DnaPatternSet* set, const LengthGroup* group, const char* text,
+                       int textLen, int startLimit, DnaMultiHitCallback onHit, void* userData,
+                       int* stopped, DnaFilterStats* filterStats) {
+    int length = group->length;
+    int end = startLimit + length - 1 < textLen ? startLimit + length - 1 : textLen;
+    uint64_t key = 0;
+    uint64_t windows = 0;
+    uint64_t passed = 0;
+    int valid = 0;
+    int matches = 0;
+    int i;
+
+    for (i = 0; i < end && !*stopped; i++) {
+        int code = encodeBase(text[i]);
+        if (code < 0) {
+            valid = 0;
+            key = 0;
+            continue;
+        }
+        // Shift the new base in and drop the one leaving the window
+        key = key * group->base + (uint64_t)code;
+        if (valid >= length) {
+            key -= (uint64_t)encodeBase(text[i - length]) * group->dropPower;
+        }
+        if (++valid < length) {
+            continue;
+        }
+
+        uint64_t hash = mixFingerprint(key);
+        windows++;
+        if (group->bloom != NULL && !bloomMayContain(group, hash)) {
+            continue;
+        }
+        passed++;
+
+        FingerprintSlot* slot = findSlot(group, key, hash);
+        int p;
+        for (p = slot->pattern; p >= 0 && !*stopped; p = set->nextSame[p]) {
+            int start = i - length + 1;
+            if (!group->exact && memcmp(text + start, set->patterns[p], length) != 0) {
+                continue;
+            }
+            matches++;
+            *stopped = onHit(p, start, userData) != 0;
+        }
+    }
+
+    filterStats->windows += windows;
+    filterStats->passed += passed;
+    filterStats->hits += matches;
+    return matches;
+}
+
+/**
+ * @brief Slides the Wu-Manber window over a text, reporting every hit
+ *
+ * The window is as long as the shortest pattern. The q-gram ending it gives
+ * the distance to the next window end where some pattern could have that
+ * q-gram, and only a zero shift leads to the candidates, which are filtered
+ * on their packed prefix before being verified in full.
+ *
+ * @param set Pattern set compiled for Wu-Manber
+ * @param text Text to search in
+ * @param textLen Length of the text
+ * @param startLimit Only matches starting before this position are reported
+ * @param onHit Callback for each match
+ * @param userData Passed through to onHit
+ * @param stopped Set to non-zero if onHit asked to stop
+ * @param filterStats Counters to add to: windows tested, zero-shift windows, hits
+ * @return Number of matches found
+ */
+static int searchWuManber(const DnaPatternSet* set, const char* text, int textLen, int startLimit,
+                          DnaMultiHitCallback onHit, void* userData, int* stopped,
+                          DnaFilterStats* filterStats) {
+    int window = set->minLength;
+    int q = set->gramLength;
+    int last = startLimit + window - 2 < textLen - 1 ? startLimit + window - 2 : textLen - 1;
+    int end = window - 1;
+    uint64_t windows = 0;
+    uint64_t passed = 0;
+    int matches = 0;
+
+    if (window == 0) {
+        return 0;
+    }
+
+    while (end <= last && !*stopped) {
+        uint64_t gram = 0;
+        int bad = -1;
+        int j;
+
+        windows++;
+        // Read the q-gram right to left, so the last non-base is found first
+        for (j = 0; j < q; j++) {
+            int code = encodeBase(text[end - j]);
+            if (code < 0) {
+                bad = end - j;
+                break;
+            }
+            gram |= (uint64_t)code << (2 * j);
+        }
+        if (bad >= 0) {
+            // No window holding a non-base can match
+            end = bad + window;
+            continue;
+        }
+        if (set->shift[gram] > 0) {
+            end += set->shift[gram];
+            continue;
+        }
+
+        passed++;
+        int start = end - window + 1;
+        uint64_t prefix;
+        if (packBases(text + start, set->prefixLength, &prefix) == 0) {
+            int c;
+            for (c = set->gramStart[gram]; c < set->gramStart[gram + 1] && !*stopped; c++) {
+                int p = set->candidates[c];
+                if (set->candidatePrefix[c] != (uint32_t)prefix || start + set->lengths[p] > textLen ||
+                    memcmp(text + start, set->patterns[p], set->lengths[p]) != 0) {
+                    continue;
+                }
+                matches++;
+                *stopped = onHit(p, start, userData) != 0;
+            }
+        }
+        end++;
+    }
+
+    filterStats->windows += windows;
+    filterStats->passed += passed;
+    filterStats->hits += matches;
+    return matches;
+}
+
+/**
+ * @brief Searches a text range with the engine the set was compiled for
+ * @param set Pattern set
+ * @param text Text to search in
+ * @param textLen Length of the text
+ * @param startLimit Only matches starting before this position are reported
+ * @param onHit Callback for each match
+ * @param userData Passed through to onHit
+ * @param filterStats Counters to add to
+ * @return Number of matches reported
+ */
+static int searchRange(const DnaPatternSet* set, const char* text, int textLen, int startLimit,
+                       DnaMultiHitCallback onHit, void* userData, DnaFilterStats* filterStats) {
+    int stopped = 0;
+    int matches = 0;
+    int g;
+
+    if (set->algorithm == DNA_MULTI_WU_MANBER) {
+        return searchWuManber(set, text, textLen, startLimit, onHit, userData, &stopped, filterStats);
+    }
+    for (g = 0; g < set->groupCount && !stopped; g++) {
+        matches += searchGroup(set, &set->groups[g], text, textLen, startLimit, onHit, userData,
+                               &stopped, filterStats);
+    }
+    return matches;
+}
+
+/**
+ * @brief Searches a text for every pattern of a set
+ *
+ * With Karp-Rabin hits are reported one length at a time, shortest patterns
+ * first, and in position order within one length; with Wu-Manber they are
+ * reported in position order.
+ *
+ * @param set Pattern set
+ * @param text Text to search in
+ * @param textLen Length of the text
+ * @param onHit Callback for each match
+ * @param userData Passed through to onHit
+ * @return Number of matches reported (including the one that stopped the search)
+ */
+int dnaPatternSetSearch(const DnaPatternSet* set, const char* text, int textLen,
+                        DnaMultiHitCallback onHit, void* userData) {
+    DnaFilterStats filterStats;
+
+    memset(&filterStats, 0, sizeof(filterStats));
+    return searchRange(set, text, textLen, textLen, onHit, userData, &filterStats);
+}
+
+/** State shared by the threads of dnaPatternSetCount() */
+typedef struct {
+    const DnaPatternSet* set;  /**< Pattern set */
+    const char* text;          /**< Text to search in */
+    int textLen;               /**< Length of the text */
+    int chunkCount;            /**< Number of chunks of MULTI_CHUNK window starts */
+    atomic_int nextChunk;      /**< Next chunk to claim */
+    atomic_int nextThread;     /**< Hands out per-thread count arrays */
+    int** threadCounts;        /**< One count array per thread */
+    DnaFilterStats* threadFilterStats;  /**< Prefilter counters of every thread */
+} MultiCountWork;
+
+/**
+ * @brief Hit callback that counts the hits of every pattern
+ * @param pattern Index of the pattern
+ * @param position Offset of the match (unused)
+ * @param userData Count array of the thread
+ * @return 0, to continue searching
+ */
+static int countPatternHit(int pattern, int position, void* userData) {
+    (void)position;
+    ((int*)userData)[pattern]++;
+    return 0;
+}
+
+/**
+ * @brief Counting worker: claims chunks of window starts until none are left
+ * @param arg The shared MultiCountWork
+ * @return NULL
+ */
+static void* multiCountWorker(void* arg) {
+    MultiCountWork* work = (MultiCountWork*)arg;
+    int thread = atomic_fetch_add(&work->nextThread, 1);
+    int* counts = work->threadCounts[thread];
+    int chunk;
+
+    while ((chunk = atomic_fetch_add(&work->nextChunk, 1)) < work->chunkCount) {
+        int from = chunk * MULTI_CHUNK;
+        int to = from + MULTI_CHUNK < work->textLen ? from + MULTI_CHUNK : work->textLen;
+        // Windows starting in [from, to) end before to + maxLength - 1; nothing is copied
+        int span = to - from + work->set->maxLength - 1;
+        if (span > work->textLen - from) {
+            span = work->textLen - from;
+        }
+        searchRange(work->set, work->text + from, span, to - from, countPatternHit, counts,
+                    &work->threadFilterStats[thread]);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Counts the matches of every pattern of a set, with several threads
+ * @param set Pattern set
+ * @param text Text to search in
+ * @param textLen Length of the text
+ * @param threadCount Number of threads to use
+ * @param counts Receives the number of matches of every pattern
+ * @param filterStats Receives the prefilter counters, or NULL
+ * @return Total number of matches, or -1 on error
+ */
+int dnaPatternSetCount(const DnaPatternSet* set, const char* text, int textLen, int threadCount,
+                       int* counts, DnaFilterStats* filterStats) {
+    MultiCountWork work;
+    int total = 0;
+    int t, p;
+
+    memset(counts, 0, set->count * sizeof(int));
+    if (filterStats != NULL) {
+        memset(filterStats, 0, sizeof(DnaFilterStats));
+    }
+    if (textLen <= 0 || set->count == 0) {
+        return 0;
+    }
+
+    work.set = set;
+    work.text = text;
+    work.textLen = textLen;
+    work.chunkCount = (textLen + MULTI_CHUNK - 1) / MULTI_CHUNK;
+    if (threadCount > work.chunkCount) {
+        threadCount = work.chunkCount;
+    }
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+    atomic_init(&work.nextChunk, 0);
+    atomic_init(&work.nextThread, 0);
+
+    // Private counts per thread, summed at the end, so no counter is shared
+    work.threadCounts = (int**)trackedCalloc(threadCount, sizeof(int*));
+    work.threadFilterStats = (DnaFilterStats*)trackedCalloc(threadCount, sizeof(DnaFilterStats));
+    if (work.threadCounts == NULL || work.threadFilterStats == NULL) {
+        free(work.threadCounts);
+        free(work.threadFilterStats);
+        return -1;
+    }
+    for (t = 0; t < threadCount; t++) {
+        work.threadCounts[t] = (int*)trackedCalloc(set->count, sizeof(int));
+        if (work.threadCounts[t] == NULL) {
+            while (t > 0) {
+                free(work.threadCounts[--t]);
+            }
+            free(work.threadCounts);
+            free(work.threadFilterStats);
+            return -1;
+        }
+    }
+
+    runWorkers(threadCount, multiCountWorker, &work);
+
+    for (t = 0; t < threadCount; t++) {
+        for (p = 0; p < set->count; p++) {
+            counts[p] += work.threadCounts[t][p];
+            total += work.threadCounts[t][p];
+        }
+        if (filterStats != NULL) {
+            filterStats->windows += work.threadFilterStats[t].windows;
+            filterStats->passed += work.threadFilterStats[t].passed;
+            filterStats->hits += work.threadFilterStats[t].hits;
+        }
+        free(work.threadCounts[t]);
+    }
+    free(work.threadCounts);
+    free(work.threadFilterStats);
+    return total;
+}
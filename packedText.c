@@ -0,0 +1,260 @@
+/**
+ * @file packedText.c
+ * @brief Bit-sliced 2-bit text and the count-only popcount engine (part of libdnamatch)
+ * @author George Fotiou
+ * @date 01/10/2025
+ *
+ * The text is stored as three bit-planes: the low and high bit of every base
+ * code and a plane marking which positions hold a base at all. Bit i % 64 of
+ * word i / 64 describes position i. Comparing one pattern base against the
+ * planes tests 64 text positions with a handful of word operations, and ANDing
+ * the results for every pattern base leaves a bitmask with one bit per match
+ * start. Counting is then a popcount per word, with no branch per match.
+ *
+ * Bases are compared exactly, as by the other engines: only upper-case A, C,
+ * G and T are packed, so lower-case (soft-masked) text never matches.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dnamatch.h"
+#include "dnamatchInternal.h"
+
+/** Words processed together; 4 x 64 bits is one 256-bit vector */
+#define STRIDE_WORDS 4
+
+/** Zero words after the text, enough for a full stride plus a shifted read */
+#define PAD_WORDS (STRIDE_WORDS + 2)
+
+/** A text packed by dnaPackText() */
+struct DnaPackedText {
+    int length;       /**< Number of positions */
+    int words;        /**< Words per plane, excluding padding */
+    uint64_t* lo;     /**< Low bit of every base code */
+    uint64_t* hi;     /**< High bit of every base code */
+    uint64_t* valid;  /**< Set where the text holds A, C, G or T */
+};
+
+/**
+ * @brief Packs a text into bit-planes
+ * @param text Text to pack
+ * @param textLen Length of the text
+ * @return New packed text to release with dnaPackedTextFree(), or NULL on error
+ */
+DnaPackedText* dnaPackText(const char* text, int textLen) {
+    DnaPackedText* packed = (DnaPackedText*)trackedMalloc(sizeof(DnaPackedText));
+    if (packed == NULL) {
+        return NULL;
+    }
+
+    packed->length = textLen;
+    packed->words = textLen / 64 + 1;
+    size_t total = (size_t)packed->words + PAD_WORDS;
+    packed->lo = (uint64_t*)trackedCalloc(3 * total, sizeof(uint64_t));
+    if (packed->lo == NULL) {
+        free(packed);
+        return NULL;
+    }
+    packed->hi = packed->lo + total;
+    packed->valid = packed->hi + total;
+
+    int i;
+    for (i = 0; i < textLen; i++) {
+        int code = encodeExactBase(text[i]);
+        uint64_t bit = 1ull << (i & 63);
+        if (code >= 0) {
+            packed->valid[i >> 6] |= bit;
+            packed->lo[i >> 6] |= (code & 1) ? bit : 0;
+            packed->hi[i >> 6] |= (code & 2) ? bit : 0;
+        }
+    }
+
+    return packed;
+}
+
+/**
+ * @brief Releases a packed text
+ * @param packed Packed text returned by dnaPackText(), or NULL
+ */
+void dnaPackedTextFree(DnaPackedText* packed) {
+    if (packed == NULL) {
+        return;
+    }
+    free(packed->lo);
+    free(packed);
+}
+
+/**
+ * @brief Returns the number of positions of a packed text
+ * @param packed Packed text
+ * @return Text length
+ */
+int dnaPackedTextLength(const DnaPackedText* packed) {
+    return packed->length;
+}
+
+/**
+ * @brief Reads 64 bits of a plane starting at an arbitrary bit offset
+ * @param plane Bit-plane
+ * @param word Word holding the first bit
+ * @param shift Bit offset of the first bit within that word
+ * @return Bits word*64+shift .. word*64+shift+63
+ */
+static inline uint64_t planeBits(const uint64_t* plane, size_t word, int shift) {
+    return shift == 0 ? plane[word] : (plane[word] >> shift) | (plane[word + 1] << (64 - shift));
+}
+
+/**
+ * @brief Computes the match-start bitmasks of one stride of blocks
+ * @param packed Packed text
+ * @param codes 2-bit codes of the pattern
+ * @param patternLen Length of the pattern
+ * @param first First block of the stride
+ * @param masks Receives one bitmask per block of the stride
+ */
+static void strideMatches(const DnaPackedText* packed, const unsigned char* codes, int patternLen,
+                          size_t first, uint64_t masks[STRIDE_WORDS]) {
+    int b, j;
+
+    for (b = 0; b < STRIDE_WORDS; b++) {
+        masks[b] = ~0ull;
+    }
+
+    for (j = 0; j < patternLen; j++) {
+        size_t word = first + (j >> 6);
+        int shift = j & 63;
+        // Broadcast the pattern base's bits to whole words
+        uint64_t wantLo = -(uint64_t)(codes[j] & 1);
+        uint64_t wantHi = -(uint64_t)(codes[j] >> 1);
+        uint64_t any = 0;
+
+        for (b = 0; b < STRIDE_WORDS; b++) {
+            uint64_t lo = planeBits(packed->lo, word + b, shift);
+            uint64_t hi = planeBits(packed->hi, word + b, shift);
+            uint64_t valid = planeBits(packed->valid, word + b, shift);
+            masks[b] &= valid & ~(lo ^ wantLo) & ~(hi ^ wantHi);
+            any |= masks[b];
+        }
+
+        // The whole stride has failed; the remaining bases cannot revive it
+        if (any == 0) {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Encodes a pattern for the popcount engine
+ * @param pattern Pattern to encode
+ * @param patternLen Length of the pattern
+ * @return Newly allocated codes, or NULL if the pattern holds anything but
+ *         upper-case ACGT (it cannot match) or memory ran out
+ */
+static unsigned char* encodePattern(const char* pattern, int patternLen) {
+    unsigned char* codes = (unsigned char*)trackedMalloc(patternLen);
+    int j;
+
+    for (j = 0; codes != NULL && j < patternLen; j++) {
+        int code = encodeExactBase(pattern[j]);
+        if (code < 0) {
+            free(codes);
+            return NULL;
+        }
+        codes[j] = (unsigned char)code;
+    }
+    return codes;
+}
+
+/**
+ * @brief Counts the matches of a pattern in a packed text, without locating them
+ * @param packed Packed text
+ * @param pattern Pattern to count; only upper-case A, C, G and T can match
+ * @param patternLen Length of the pattern
+ * @return Number of matches found
+ */
+int dnaPopcountCount(const DnaPackedText* packed, const char* pattern, int patternLen) {
+    if (patternLen <= 0 || patternLen > packed->length) {
+        return 0;
+    }
+
+    unsigned char* codes = encodePattern(pattern, patternLen);
+    if (codes == NULL) {
+        return 0;
+    }
+
+    // Match starts past length - patternLen are cleared by the valid plane
+    size_t lastBlock = (size_t)(packed->length - patternLen) / 64;
+    size_t first;
+    int matches = 0;
+
+    for (first = 0; first <= lastBlock; first += STRIDE_WORDS) {
+        uint64_t masks[STRIDE_WORDS];
+        int b;
+        strideMatches(packed, codes, patternLen, first, masks);
+        for (b = 0; b < STRIDE_WORDS; b++) {
+            matches += __builtin_popcountll(masks[b]);
+        }
+    }
+
+    free(codes);
+    return matches;
+}
+
+/**
+ * @brief Reports every match of a pattern in a packed text, in position order
+ *
+ * In non-overlapping mode the bits of match starts covered by the last hit are
+ * masked off a whole word at a time, so skipped starts cost nothing.
+ *
+ * @param packed Packed text
+ * @param pattern Pattern to search for; only upper-case A, C, G and T can match
+ * @param patternLen Length of the pattern
+ * @param nonOverlapping Non-zero to skip matches overlapping the previous hit
+ * @param onHit Callback for each match, or NULL
+ * @param userData Passed through to onHit
+ * @return Number of matches reported
+ */
+int dnaPopcountSearch(const DnaPackedText* packed, const char* pattern, int patternLen,
+                      int nonOverlapping, DnaHitCallback onHit, void* userData) {
+    if (patternLen <= 0 || patternLen > packed->length) {
+        return 0;
+    }
+
+    unsigned char* codes = encodePattern(pattern, patternLen);
+    if (codes == NULL) {
+        return 0;
+    }
+
+    size_t lastBlock = (size_t)(packed->length - patternLen) / 64;
+    size_t first;
+    size_t nextFree = 0;
+    int matches = 0;
+    int stop = 0;
+
+    for (first = 0; first <= lastBlock && !stop; first += STRIDE_WORDS) {
+        uint64_t masks[STRIDE_WORDS];
+        int b;
+        strideMatches(packed, codes, patternLen, first, masks);
+        for (b = 0; b < STRIDE_WORDS && !stop; b++) {
+            size_t base = (first + b) * 64;
+            // Drop the starts still covered by the last hit
+            if (nextFree > base) {
+                masks[b] &= nextFree - base >= 64 ? 0 : ~0ull << (nextFree - base);
+            }
+            while (masks[b] != 0 && !stop) {
+                int bit = __builtin_ctzll(masks[b]);
+                masks[b] &= masks[b] - 1;
+                matches++;
+                stop = onHit != NULL && onHit((int)(base + bit), userData);
+                if (nonOverlapping) {
+                    nextFree = base + bit + patternLen;
+                    masks[b] &= bit + patternLen >= 64 ? 0 : ~0ull << (bit + patternLen);
+                }
+            }
+        }
+    }
+
+    free(codes);
+    return matches;
+}
@@ -1,262 +1,558 @@
 /**
  * @file patternMatching.c
- * @brief DNA Sequence Pattern Matching using Brute Force and Karp-Rabin algorithms
+ * @brief Command line front end of libdnamatch: DNA pattern search and sequence analysis
  * @author George Fotiou
  * @date 01/10/2025
  * 
- * This program implements two pattern matching algorithms for DNA sequences:
+ * This program searches DNA sequences for patterns with five engines:
  * 1. Brute Force algorithm (-bf)
  * 2. Karp-Rabin algorithm (-kr)
+ * 3. Count-only popcount engine over packed text (-pc)
+ * 4. Period-aware KMP scan for repetitive patterns (-kmp)
+ * 5. Two-Way, linear time in constant space (-tw)
  * 
- * Usage: ./patternMatching -alg DNASequenceFile.txt patternFile.txt
+ * or lets -auto pick one. Further modes run batches of patterns, serve
+ * queries from resident references, count k-mers, align probes, search
+ * indexes approximately, and scan a sequence for maximal matches, tandem
+ * repeats, restriction sites, base composition and low-complexity regions.
+ * 
+ * The engines themselves live in libdnamatch (dnamatch.h); this file is the
+ * command line front end.
+ * 
+ * Usage: ./patternMatching [options] -alg DNASequenceFile.txt patternFile.txt
+ *        ./patternMatching [options] batch -alg DNASequenceFile.txt queryFile.txt|-
+ *        ./patternMatching [options] multi -kr|-wm DNASequenceFile.txt patternFile.txt|-
+ *        ./patternMatching [options] serve socketPath DNASequenceFile.txt...
+ *        ./patternMatching query socketPath count|locate reference -alg PATTERN
+ *        ./patternMatching query socketPath stats
+ *        ./patternMatching [options] kmers -k K DNASequenceFile.txt
+ *        ./patternMatching [options] align DNASequenceFile.txt probeFile.txt
+ *        ./patternMatching [options] approx DNASequenceFile.txt patternFile.txt
+ *        ./patternMatching [options] minimizer -alg DNASequenceFile.txt patternFile.txt
+ *        ./patternMatching [options] qgram DNASequenceFile.txt queryFile.txt|-
+ *        ./patternMatching [options] sam DNASequenceFile.txt queryFile.txt|-
+ *        ./patternMatching [options] mem referenceFile.txt queryFile.txt
+ *        ./patternMatching [options] repeats DNASequenceFile.txt
+ *        ./patternMatching [options] sites DNASequenceFile.txt
+ *        ./patternMatching [options] gc DNASequenceFile.txt
+ *        ./patternMatching [options] dust DNASequenceFile.txt
+ * 
+ * --region and --bed restrict the search and batch modes to parts of the
+ * reference; --dust makes them skip its low-complexity regions.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sys/resource.h>
+#include "dnamatch.h"
+#include "dnamatchInternal.h"
+#include "queryServer.h"
 
 /** Maximum sequence size that can be handled */
 #define N 512000
 
-/** Modulo value for Karp-Rabin hash function */
-#define MOD INT_MAX
+/** Maximum number of positional arguments of any mode */
+#define MAX_POSITIONAL 8
+
+/** Window of the DUST low-complexity masker, as in dustmasker */
+#define DUST_WINDOW 64
+
+/** DUST level used by --dust and the dust mode unless --dust-level is given */
+#define DUST_DEFAULT_LEVEL 20
+
+/** Command line options shared by all modes */
+typedef struct {
+    int showStats;  /**< Print statistics after the run (--stats) */
+    int statsJson;  /**< Print them as JSON (--stats=json) */
+    int threads;    /**< Worker threads for parallel modes (--threads) */
+    int canonical;  /**< Merge k-mers with their reverse complement (--canonical) */
+    int maxHits;    /**< Stop after this many hits, 0 for no limit (--max-hits) */
+    int exists;     /**< Only report whether the pattern occurs (--exists) */
+    int matchFlags; /**< dnaMatcherCreateFlags() flags (--non-overlapping) */
+    double bloomFpr;  /**< multi: Bloom prefilter false-positive rate, 0 for none (--bloom-fpr) */
+    DnaAlignScoring scoring;  /**< align, approx: match, mismatch, gap open and gap extend scores (--scores) */
+    int seedLength; /**< approx: length of the exact seeds (--seed) */
+    int minScore;   /**< approx: lowest score reported, 0 for half the perfect score (--min-score) */
+    int minimizerW; /**< minimizer: window of the index, in k-mers (--minimizer) */
+    int minimizerK; /**< minimizer: k-mer length of the index (--minimizer) */
+    int qgramLength;  /**< qgram: q-gram length of the index (--qgram) */
+    int mismatches;   /**< qgram: mismatches allowed per occurrence (--mismatches) */
+    int minLength;    /**< mem, repeats: shortest match or repeat reported, 0 for the mode default (--min-length) */
+    int maxPeriod;    /**< repeats: longest repeat unit looked for (--max-period) */
+    const char* enzymes;  /**< sites: comma-separated enzyme names, NULL for all, "none" for none (--enzymes) */
+    int palindromeMin;    /**< sites: shortest palindrome reported, 0 for no palindrome scan (--palindrome) */
+    int palindromeMax;    /**< sites: longest palindrome reported (--palindrome) */
+    int window;       /**< gc: window length (--window) */
+    int windowStep;   /**< gc: distance between window starts, 0 for the window length (--window) */
+    const char* track;  /**< gc: statistic written out: "gc", "skew" or "entropy" (--track) */
+    int dustLevel;    /**< search, batch: DUST level of the regions skipped, 0 for no masking (--dust, --dust-level) */
+    DnaRegion* regions;  /**< Regions the search is restricted to (--region, --bed) */
+    int regionCount;     /**< Number of regions, 0 to search the whole text */
+    int regionCapacity;  /**< Allocated size of regions */
+} CliOptions;
+
+/** Phases of a run that are timed separately by --stats */
+typedef enum {
+    PHASE_LOAD,        /**< Reading the raw input files */
+    PHASE_NORMALIZE,   /**< Filtering and upper-casing the bases */
+    PHASE_PREPROCESS,  /**< Pattern hashing / table construction */
+    PHASE_SEARCH,      /**< Scanning the text */
+    PHASE_COUNT
+} Phase;
+
+/** Printable names of the phases, indexed by Phase */
+static const char* phaseNames[PHASE_COUNT] = {
+    "load", "normalize", "preprocess", "search"
+};
+
+/** Accumulated wall and CPU time of every phase of a run */
+typedef struct {
+    double wall[PHASE_COUNT];  /**< Wall-clock seconds per phase */
+    double cpu[PHASE_COUNT];   /**< Process CPU seconds per phase */
+    double wallStart;          /**< Wall clock when the current phase began */
+    double cpuStart;           /**< CPU clock when the current phase began */
+    const char* engine;        /**< Engine that ran the search, if known */
+    int hasFilter;             /**< A Bloom prefilter was used */
+    DnaFilterStats filter;     /**< Its counters */
+    size_t indexBytes;         /**< Size of the index searched, 0 if none */
+    int indexEntries;          /**< Positions it holds */
+    int hasDust;               /**< Low-complexity regions were masked */
+    int maskedBases;           /**< Bases they cover */
+    int maskedRegions;         /**< Number of them */
+    double dustWall;           /**< Wall-clock seconds spent finding them */
+} RunStats;
+
+/**
+ * @brief Reads a clock as seconds
+ * @param clockId Clock to read (CLOCK_MONOTONIC or CLOCK_PROCESS_CPUTIME_ID)
+ * @return Current value of the clock in seconds
+ */
+double clockSeconds(clockid_t clockId) {
+    struct timespec ts;
+    clock_gettime(clockId, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Marks the start of a timed phase
+ * @param stats Statistics being collected
+ */
+void beginPhase(RunStats* stats) {
+    stats->wallStart = clockSeconds(CLOCK_MONOTONIC);
+    stats->cpuStart = clockSeconds(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+/**
+ * @brief Adds the time elapsed since beginPhase() to a phase
+ * @param stats Statistics being collected
+ * @param phase Phase that just finished
+ */
+void endPhase(RunStats* stats, Phase phase) {
+    stats->wall[phase] += clockSeconds(CLOCK_MONOTONIC) - stats->wallStart;
+    stats->cpu[phase] += clockSeconds(CLOCK_PROCESS_CPUTIME_ID) - stats->cpuStart;
+}
+
+/**
+ * @brief Prints the collected statistics to stderr
+ * @param stats Statistics collected during the run
+ * @param json Non-zero for a single-line JSON object, zero for a table
+ */
+void printStats(const RunStats* stats, int json) {
+    struct rusage usage;
+    long peakRssKb = 0;
+    int i;
+
+    // Keep the results ahead of the statistics when both go to one log
+    fflush(stdout);
+    
+    // ru_maxrss is reported in kilobytes on Linux
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        peakRssKb = usage.ru_maxrss;
+    }
+
+    if (json) {
+        fprintf(stderr, "{\"phases\":{");
+        for (i = 0; i < PHASE_COUNT; i++) {
+            fprintf(stderr, "%s\"%s\":{\"wall_s\":%.6f,\"cpu_s\":%.6f}",
+                    i > 0 ? "," : "", phaseNames[i], stats->wall[i], stats->cpu[i]);
+        }
+        fprintf(stderr, "},\"peak_rss_kb\":%ld,\"bytes_allocated\":%zu", peakRssKb, allocatedBytes());
+        if (stats->engine != NULL) {
+            fprintf(stderr, ",\"engine\":\"%s\"", stats->engine);
+        }
+        if (stats->hasFilter) {
+            fprintf(stderr, ",\"bloom\":{\"windows\":%llu,\"passed\":%llu,\"hits\":%llu}",
+                    (unsigned long long)stats->filter.windows, (unsigned long long)stats->filter.passed,
+                    (unsigned long long)stats->filter.hits);
+        }
+        if (stats->indexBytes > 0) {
+            fprintf(stderr, ",\"index\":{\"entries\":%d,\"bytes\":%zu}", stats->indexEntries, stats->indexBytes);
+        }
+        if (stats->hasDust) {
+            fprintf(stderr, ",\"dust\":{\"masked_bases\":%d,\"regions\":%d,\"wall_s\":%.6f}",
+                    stats->maskedBases, stats->maskedRegions, stats->dustWall);
+        }
+        fprintf(stderr, "}\n");
+        return;
+    }
+
+    fprintf(stderr, "%-12s %12s %12s\n", "Phase", "Wall (s)", "CPU (s)");
+    for (i = 0; i < PHASE_COUNT; i++) {
+        fprintf(stderr, "%-12s %12.6f %12.6f\n", phaseNames[i], stats->wall[i], stats->cpu[i]);
+    }
+    fprintf(stderr, "Peak RSS: %ld KB\n", peakRssKb);
+    fprintf(stderr, "Bytes allocated: %zu\n", allocatedBytes());
+    if (stats->engine != NULL) {
+        fprintf(stderr, "Engine: %s\n", stats->engine);
+    }
+    if (stats->hasFilter) {
+        // Windows passing the filter without a hit are its false positives
+        double windows = stats->filter.windows > 0 ? (double)stats->filter.windows : 1;
+        fprintf(stderr, "Bloom filter: %llu windows, %llu passed (%.4f%%), %llu hits\n",
+                (unsigned long long)stats->filter.windows, (unsigned long long)stats->filter.passed,
+                100.0 * stats->filter.passed / windows, (unsigned long long)stats->filter.hits);
+    }
+    if (stats->indexBytes > 0) {
+        fprintf(stderr, "Index: %d entries, %zu bytes\n", stats->indexEntries, stats->indexBytes);
+    }
+    if (stats->hasDust) {
+        fprintf(stderr, "DUST: %d bases masked in %d regions (%.6f s)\n", stats->maskedBases,
+                stats->maskedRegions, stats->dustWall);
+    }
+}
 
 /**
- * @brief Reads a DNA sequence from a file into a character array
+ * @brief Reads a sequence file, timing the load and normalization phases
  * @param filename Name of the file to read from
  * @param sequence Array to store the sequence
  * @param maxSize Maximum size of the sequence
+ * @param stats Statistics the phase times are added to
  * @return Length of the sequence read, or -1 on error
  */
-int readSequence(const char* filename, char* sequence, int maxSize) {
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
-        printf("Error: Cannot open file %s\n", filename);
-        return -1;
-    }
-    
-    int length = 0;
-    int ch;
+int readSequenceTimed(const char* filename, char* sequence, int maxSize, RunStats* stats) {
+    int rawLen;
     
-    while ((ch = fgetc(file)) != EOF && ch != '\n' && length < maxSize - 1) {
-        if (ch == 'A' || ch == 'T' || ch == 'C' || ch == 'G' || 
-            ch == 'a' || ch == 't' || ch == 'c' || ch == 'g') {
-            // Convert to uppercase for consistency
-            if (ch >= 'a' && ch <= 'z') {
-                ch = ch - 'a' + 'A';
-            }
-            sequence[length++] = ch;
-        }
+    beginPhase(stats);
+    char* raw = loadLine(filename, &rawLen);
+    endPhase(stats, PHASE_LOAD);
+    if (raw == NULL) {
+        return -1;
     }
     
-    sequence[length] = '\0';
-    fclose(file);
-    
-    if (length == maxSize - 1) {
-        printf("Warning: Sequence may have been truncated\n");
-    }
+    beginPhase(stats);
+    int length = normalizeSequence(raw, rawLen, sequence, maxSize);
+    endPhase(stats, PHASE_NORMALIZE);
     
+    free(raw);
     return length;
 }
 
 /**
- * @brief Implements brute force pattern matching algorithm
- * @param text The DNA sequence text to search in
- * @param pattern The pattern to search for
- * @param textLen Length of the text
- * @param patternLen Length of the pattern
- * @return Number of matches found
+ * @brief Prints usage information
+ * @param programName Name of the program
  */
-int bruteForceSearch(const char* text, const char* pattern, int textLen, int patternLen) {
-    int matches = 0;
-    int i, j;
-    
-    // Search for pattern in text
-    for (i = 0; i <= textLen - patternLen; i++) {
-        j = 0;
-        
-        // Check if pattern matches at current position
-        while (j < patternLen && text[i + j] == pattern[j]) {
-            j++;
-        }
-        
-        // If we matched the entire pattern
-        if (j == patternLen) {
-            matches++;
+void printUsage(const char* programName) {
+    printf("Usage: %s [options] -alg DNASequenceFile.txt patternFile.txt\n", programName);
+    printf("       %s [options] batch -alg DNASequenceFile.txt queryFile.txt|-\n", programName);
+    printf("       %s [options] multi -kr|-wm DNASequenceFile.txt patternFile.txt|-\n", programName);
+    printf("       %s [options] serve socketPath DNASequenceFile.txt...\n", programName);
+    printf("       %s query socketPath count|locate reference -alg PATTERN\n", programName);
+    printf("       %s query socketPath stats\n", programName);
+    printf("       %s [options] kmers -k K DNASequenceFile.txt\n", programName);
+    printf("       %s [options] align DNASequenceFile.txt probeFile.txt\n", programName);
+    printf("       %s [options] approx DNASequenceFile.txt patternFile.txt\n", programName);
+    printf("       %s [options] minimizer -alg DNASequenceFile.txt patternFile.txt\n", programName);
+    printf("       %s [options] qgram DNASequenceFile.txt queryFile.txt|-\n", programName);
+    printf("       %s [options] sam DNASequenceFile.txt queryFile.txt|-\n", programName);
+    printf("       %s [options] mem referenceFile.txt queryFile.txt\n", programName);
+    printf("       %s [options] repeats DNASequenceFile.txt\n", programName);
+    printf("       %s [options] sites DNASequenceFile.txt\n", programName);
+    printf("       %s [options] gc DNASequenceFile.txt\n", programName);
+    printf("       %s [options] dust DNASequenceFile.txt\n", programName);
+    printf("Where alg can be:\n");
+    printf("  -bf  : Brute Force algorithm\n");
+    printf("  -kr  : Karp-Rabin algorithm\n");
+    printf("  -pc  : Count-only popcount engine over packed text\n");
+    printf("  -kmp : Period-aware KMP scan, linear on repetitive patterns\n");
+    printf("  -tw  : Two-Way algorithm, linear time in constant space\n");
+    printf("  -auto : Pick one of the above from the pattern and the text composition\n");
+    printf("Options:\n");
+    printf("  --stats       : Print per-phase timing and memory statistics to stderr\n");
+    printf("  --stats=json  : Same, as a single-line JSON object\n");
+    printf("  --threads T   : Number of worker threads (default: all CPUs)\n");
+    printf("  --canonical   : kmers: count each k-mer together with its reverse complement\n");
+    printf("  --max-hits N  : Stop after the first N hits and print their positions;\n");
+    printf("                  batch and qgram only cap the count of each query\n");
+    printf("  --exists      : Only report whether the pattern occurs, stopping at the first hit\n");
+    printf("  --non-overlapping : Count matches left to right without overlaps\n");
+    printf("  --bloom-fpr P : multi: prefilter windows with a Bloom filter of false-positive rate P\n");
+    printf("  --region R    : search, batch: only search chr:start-end (1-based, inclusive); may be repeated\n");
+    printf("  --bed FILE    : search, batch: only search the regions of a BED file (0-based, half-open)\n");
+    printf("  --scores M,X,O,E : align, approx: match, mismatch, gap open and gap extend (default 2,-3,5,2)\n");
+    printf("  --seed K      : approx: length of the exact seeds (default 11)\n");
+    printf("  --min-score S : approx: lowest score reported (default: half the perfect score)\n");
+    printf("  --minimizer W,K : minimizer: window and k-mer length of the index (default 10,15)\n");
+    printf("  --qgram Q     : qgram: q-gram length of the index, 1 to 12 (default 10)\n");
+    printf("  --mismatches K : qgram: count occurrences with up to K mismatches\n");
+    printf("  --min-length L : mem: shortest maximal match reported (default 20);\n");
+    printf("                   repeats: shortest tandem repeat reported (default 12)\n");
+    printf("  --max-period P : repeats: longest repeat unit looked for (default 6)\n");
+    printf("  --enzymes LIST : sites: comma-separated enzymes to look for, or none (default: all)\n");
+    printf("  --palindrome MIN,MAX : sites: also report palindromes of MIN to MAX bases\n");
+    printf("  --window W[,S] : gc: windows of W bases starting every S bases (default 1000, S = W)\n");
+    printf("  --track T     : gc: statistic written as bedGraph, gc, skew or entropy (default gc)\n");
+    printf("  --dust        : search, batch: skip low-complexity regions found by DUST\n");
+    printf("  --dust-level L : search, batch, dust: DUST score threshold times ten, implies --dust (default 20)\n");
+}
+
+/**
+ * @brief Appends a region to the options
+ * @param options Options being parsed
+ * @param start First 0-based position of the region
+ * @param end One past the last position of the region
+ * @return 0 on success, 1 on error
+ */
+int addRegion(CliOptions* options, int start, int end) {
+    if (options->regionCount == options->regionCapacity) {
+        int capacity = options->regionCapacity > 0 ? 2 * options->regionCapacity : 16;
+        DnaRegion* bigger = (DnaRegion*)trackedRealloc(options->regions,
+                                                       options->regionCapacity * sizeof(DnaRegion),
+                                                       capacity * sizeof(DnaRegion));
+        if (bigger == NULL) {
+            printf("Error: Memory allocation failed\n");
+            return 1;
         }
+        options->regions = bigger;
+        options->regionCapacity = capacity;
     }
     
-    return matches;
+    options->regions[options->regionCount].start = start;
+    options->regions[options->regionCount].end = end;
+    options->regionCount++;
+    return 0;
 }
 
 /**
- * @brief Calculates hash value for a string using rolling hash
- * @param str String to hash
- * @param len Length of the string
- * @return Hash value
+ * @brief Parses a whole decimal number within a range
+ * @param text Number to parse
+ * @param min Smallest accepted value
+ * @param max Largest accepted value
+ * @param value Receives the number
+ * @return 0 on success, 1 if text is not a number between min and max
  */
-long long calculateHash(const char* str, int len) {
-    long long hash = 0;
-    long long base = 1;
-    int i;
+int parseNumber(const char* text, long min, long max, int* value) {
+    char* rest;
+    errno = 0;
+    long number = strtol(text, &rest, 10);
+    if (rest == text || *rest != '\0' || errno == ERANGE || number < min || number > max) {
+        return 1;
+    }
+    *value = (int)number;
+    return 0;
+}
+
+/**
+ * @brief Parses a --region argument
+ * @param options Options being parsed
+ * @param spec Region as chr:start-end or start-end, 1-based and inclusive.
+ *             The reference is a single sequence, so the name is ignored.
+ * @return 0 on success, 1 on error
+ */
+int parseRegion(CliOptions* options, const char* spec) {
+    const char* colon = strrchr(spec, ':');
+    const char* range = colon != NULL ? colon + 1 : spec;
+    char* rest;
     
-    // Calculate hash = (str[0]*2^(len-1) + str[1]*2^(len-2) + ... + str[len-1]*2^0) % MOD
-    for (i = len - 1; i >= 0; i--) {
-        hash = (hash + ((long long)str[i] * base) % MOD) % MOD;
-        if (i > 0) {
-            base = (base * 2) % MOD;
-        }
+    long start = strtol(range, &rest, 10);
+    if (rest == range || *rest != '-') {
+        printf("Error: Invalid region %s. Use chr:start-end\n", spec);
+        return 1;
+    }
+    range = rest + 1;
+    long end = strtol(range, &rest, 10);
+    if (rest == range || *rest != '\0' || start < 1 || end < start || end > INT_MAX) {
+        printf("Error: Invalid region %s. Use chr:start-end\n", spec);
+        return 1;
     }
     
-    return hash;
+    return addRegion(options, (int)start - 1, (int)end);
 }
 
 /**
- * @brief Recalculates hash value by removing old character and adding new one
- * @param oldChar Character being removed
- * @param oldHash Previous hash value
- * @param newChar Character being added
- * @param patternLen Length of the pattern
- * @return New hash value
+ * @brief Reads the regions of a BED file
+ * @param options Options being parsed
+ * @param filename BED file; only the chrom, start and end columns are used
+ * @return 0 on success, 1 on error
  */
-long long rehash(char oldChar, long long oldHash, char newChar, int patternLen) {
-    long long powerOf2 = 1;
-    int i;
-    
-    // Calculate 2^(patternLen-1)
-    for (i = 0; i < patternLen - 1; i++) {
-        powerOf2 = (powerOf2 * 2) % MOD;
+int readBedFile(CliOptions* options, const char* filename) {
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) {
+        printf("Error: Cannot open file %s\n", filename);
+        return 1;
     }
     
-    // rehash(a, h, b) = ((h - a*2^(M-1)) * 2 + b) % MOD
-    long long newHash = oldHash - ((long long)oldChar * powerOf2) % MOD;
-    if (newHash < 0) {
-        newHash += MOD;
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    int lineNumber = 0;
+    int status = 0;
+    
+    while (status == 0 && getline(&line, &lineCapacity, file) != -1) {
+        char chrom[256];
+        long start, end;
+        lineNumber++;
+        
+        // Header and comment lines carry no regions
+        if (line[strspn(line, " \t\r\n")] == '\0' || line[0] == '#' ||
+            strncmp(line, "track", 5) == 0 || strncmp(line, "browser", 7) == 0) {
+            continue;
+        }
+        
+        if (sscanf(line, "%255s %ld %ld", chrom, &start, &end) != 3 ||
+            start < 0 || end < start || end > INT_MAX) {
+            printf("Error: Invalid BED line %d in %s\n", lineNumber, filename);
+            status = 1;
+        } else {
+            status = addRegion(options, (int)start, (int)end);
+        }
     }
-    newHash = (newHash * 2 + newChar) % MOD;
     
-    return newHash;
+    free(line);
+    fclose(file);
+    return status;
 }
 
 /**
- * @brief Verifies if pattern actually matches at given position
- * @param text The text to check
- * @param pattern The pattern to match
- * @param pos Position in text to start checking
- * @param patternLen Length of pattern
- * @return 1 if match, 0 otherwise
+ * @brief Maps an algorithm flag to an engine, reporting invalid flags
+ * @param flag Algorithm flag from the command line
+ * @param engine Receives the engine
+ * @return 0 on success, 1 if the flag is invalid
  */
-int verifyMatch(const char* text, const char* pattern, int pos, int patternLen) {
-    int i;
-    for (i = 0; i < patternLen; i++) {
-        if (text[pos + i] != pattern[i]) {
-            return 0;
-        }
+int parseAlgorithm(const char* flag, DnaAlgorithm* engine) {
+    if (dnaAlgorithmFromFlag(flag, engine) != 0) {
+        printf("Error: Invalid algorithm. Use -bf for Brute Force, -kr for Karp-Rabin, -pc for Popcount, -kmp for KMP or -tw for Two-Way\n");
+        return 1;
     }
-    return 1;
+    return 0;
 }
 
 /**
- * @brief Implements Karp-Rabin pattern matching algorithm
- * @param text The DNA sequence text to search in
- * @param pattern The pattern to search for
- * @param textLen Length of the text
- * @param patternLen Length of the pattern
- * @return Number of matches found
+ * @brief Allocates a sequence buffer and reads a DNA sequence file into it
+ * @param filename Name of the file to read from
+ * @param role What the file holds ("DNA sequence", "pattern", ...), named in errors
+ * @param length Receives the length of the sequence
+ * @param stats Statistics the phase times are added to
+ * @return Newly allocated sequence of capacity N, or NULL on error
  */
-int karpRabinSearch(const char* text, const char* pattern, int textLen, int patternLen) {
-    if (patternLen > textLen) {
-        return 0;
+char* loadReference(const char* filename, const char* role, int* length, RunStats* stats) {
+    char* dnaSeq = (char*)trackedMalloc(N * sizeof(char));
+    if (dnaSeq == NULL) {
+        printf("Error: Memory allocation failed\n");
+        return NULL;
     }
     
-    int matches = 0;
-    long long patternHash = calculateHash(pattern, patternLen);
-    long long textHash = calculateHash(text, patternLen);
-    int i;
-    
-    // Check first window
-    if (patternHash == textHash && verifyMatch(text, pattern, 0, patternLen)) {
-        matches++;
+    int dnaLen = readSequenceTimed(filename, dnaSeq, N, stats);
+    if (dnaLen == -1) {
+        printf("Error: Failed to read %s file\n", role);
+        free(dnaSeq);
+        return NULL;
     }
     
-    // Roll through the rest of the text
-    for (i = 1; i <= textLen - patternLen; i++) {
-        textHash = rehash(text[i - 1], textHash, text[i + patternLen - 1], patternLen);
-        
-        if (patternHash == textHash && verifyMatch(text, pattern, i, patternLen)) {
-            matches++;
-        }
+    if (dnaLen >= N - 1) {
+        printf("Error: Sequence in %s file too large\n", role);
+        free(dnaSeq);
+        return NULL;
     }
     
-    return matches;
+    *length = dnaLen;
+    return dnaSeq;
 }
 
 /**
- * @brief Prints usage information
- * @param programName Name of the program
+ * @brief Finds the low-complexity regions of a reference and cuts them out of the searched regions
+ * @param options Parsed command line options; dustLevel must be set
+ * @param dnaSeq Reference
+ * @param dnaLen Length of the reference
+ * @param regionCount Receives the number of regions left to search, at least 1
+ * @param stats Statistics being collected; receives the masked bases and the time taken
+ * @return Regions to search (free()), or NULL on error
  */
-void printUsage(const char* programName) {
-    printf("Usage: %s -alg DNASequenceFile.txt patternFile.txt\n", programName);
-    printf("Where alg can be:\n");
-    printf("  -bf  : Brute Force algorithm\n");
-    printf("  -kr  : Karp-Rabin algorithm\n");
+DnaRegion* dustRegions(const CliOptions* options, const char* dnaSeq, int dnaLen, int* regionCount,
+                       RunStats* stats) {
+    int maskedCount;
+    int r;
+    
+    beginPhase(stats);
+    double wallBefore = stats->wall[PHASE_PREPROCESS];
+    DnaRegion* masked = dnaDustMask(dnaSeq, dnaLen, DUST_WINDOW, options->dustLevel, &maskedCount);
+    DnaRegion* unmasked = NULL;
+    if (masked != NULL) {
+        unmasked = dnaUnmaskedRegions(options->regions, options->regionCount, masked, maskedCount, dnaLen,
+                                      regionCount);
+    }
+    endPhase(stats, PHASE_PREPROCESS);
+    
+    if (unmasked == NULL) {
+        free(masked);
+        return NULL;
+    }
+    stats->hasDust = 1;
+    stats->dustWall = stats->wall[PHASE_PREPROCESS] - wallBefore;
+    stats->maskedRegions = maskedCount;
+    stats->maskedBases = 0;
+    for (r = 0; r < maskedCount; r++) {
+        stats->maskedBases += masked[r].end - masked[r].start;
+    }
+    free(masked);
+    
+    // No regions at all would mean the whole text, so keep an empty one
+    if (*regionCount == 0) {
+        unmasked[0].start = 0;
+        unmasked[0].end = 0;
+        *regionCount = 1;
+    }
+    return unmasked;
 }
 
 /**
- * @brief Main function
- * @param argc Number of command line arguments
- * @param argv Array of command line arguments
+ * @brief Searches one pattern file in one DNA sequence file
+ * @param options Parsed command line options
+ * @param algorithm Algorithm flag (-bf, -kr, ... or -auto)
+ * @param dnaFile DNA sequence file
+ * @param patternFile Pattern file
+ * @param stats Statistics being collected
  * @return 0 on success, 1 on error
  */
-int main(int argc, char *argv[]) {
-    // Check command line arguments
-    if (argc != 4) {
-        printf("Error: Invalid number of arguments\n");
-        printUsage(argv[0]);
-        return 1;
-    }
-    
-    char* algorithm = argv[1];
-    char* dnaFile = argv[2];
-    char* patternFile = argv[3];
+int runSearch(const CliOptions* options, const char* algorithm, const char* dnaFile,
+              const char* patternFile, RunStats* stats) {
+    DnaAlgorithm engine = DNA_ALG_TWO_WAY;
+    int autoSelect = strcmp(algorithm, "-auto") == 0;
+    int i;
     
     // Validate algorithm argument
-    if (strcmp(algorithm, "-bf") != 0 && strcmp(algorithm, "-kr") != 0) {
-        printf("Error: Invalid algorithm. Use -bf for Brute Force or -kr for Karp-Rabin\n");
-        printUsage(argv[0]);
-        return 1;
-    }
-    
-    // Allocate memory for sequences
-    char* dnaSeq = (char*)malloc(N * sizeof(char));
-    char* patSeq = (char*)malloc(N * sizeof(char));
-    
-    if (dnaSeq == NULL || patSeq == NULL) {
-        printf("Error: Memory allocation failed\n");
-        if (dnaSeq) free(dnaSeq);
-        if (patSeq) free(patSeq);
+    if (!autoSelect && parseAlgorithm(algorithm, &engine) != 0) {
         return 1;
     }
     
     // Read DNA sequence
-    int dnaLen = readSequence(dnaFile, dnaSeq, N);
-    if (dnaLen == -1) {
-        printf("Error: Failed to read DNA sequence file\n");
-        free(dnaSeq);
-        free(patSeq);
+    int dnaLen;
+    char* dnaSeq = loadReference(dnaFile, "DNA sequence", &dnaLen, stats);
+    if (dnaSeq == NULL) {
         return 1;
     }
     
-    if (dnaLen >= N - 1) {
-        printf("Error: DNA sequence too large\n");
+    char* patSeq = (char*)trackedMalloc(N * sizeof(char));
+    if (patSeq == NULL) {
+        printf("Error: Memory allocation failed\n");
         free(dnaSeq);
-        free(patSeq);
         return 1;
     }
     
     // Read pattern sequence
-    int patLen = readSequence(patternFile, patSeq, N);
+    int patLen = readSequenceTimed(patternFile, patSeq, N, stats);
     if (patLen == -1) {
         printf("Error: Failed to read pattern file\n");
         free(dnaSeq);
@@ -278,21 +574,1441 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
-    // Perform pattern matching based on selected algorithm
-    int matches = 0;
+    // With --dust the search is restricted to what the masker leaves
+    CliOptions dustOptions;
+    DnaRegion* unmasked = NULL;
+    if (options->dustLevel > 0) {
+        dustOptions = *options;
+        unmasked = dustRegions(options, dnaSeq, dnaLen, &dustOptions.regionCount, stats);
+        if (unmasked == NULL) {
+            printf("Error: Memory allocation failed\n");
+            free(dnaSeq);
+            free(patSeq);
+            return 1;
+        }
+        dustOptions.regions = unmasked;
+        options = &dustOptions;
+    }
+    
+    // A hit limit needs positions, and regions need offsets, neither of
+    // which the packed counter handles
+    int limit = options->exists ? 1 : options->maxHits;
+    int countOnly = limit == 0 && options->regionCount == 0;
+    int* positions = NULL;
+    
+    // Compile the pattern once (and pack the text for -pc), then scan
+    DnaPackedText* packed = NULL;
+    beginPhase(stats);
+    if (autoSelect) {
+        DnaComposition composition;
+        dnaBaseComposition(dnaSeq, dnaLen, &composition);
+        engine = dnaChooseAlgorithm(patSeq, patLen, &composition, countOnly);
+    }
+    int usePacked = engine == DNA_ALG_POPCOUNT && countOnly;
+    DnaMatcher* matcher = dnaMatcherCreateFlags(engine, patSeq, patLen, options->matchFlags);
+    if (matcher != NULL && usePacked) {
+        packed = dnaPackText(dnaSeq, dnaLen);
+    }
+    if (limit > 0) {
+        positions = (int*)trackedMalloc(limit * sizeof(int));
+    }
+    endPhase(stats, PHASE_PREPROCESS);
+    
+    if (matcher == NULL || (usePacked && packed == NULL) || (limit > 0 && positions == NULL)) {
+        printf("Error: Memory allocation failed\n");
+        dnaPackedTextFree(packed);
+        dnaMatcherFree(matcher);
+        free(positions);
+        free(unmasked);
+        free(dnaSeq);
+        free(patSeq);
+        return 1;
+    }
     
-    if (strcmp(algorithm, "-bf") == 0) {
-        matches = bruteForceSearch(dnaSeq, patSeq, dnaLen, patLen);
-    } else if (strcmp(algorithm, "-kr") == 0) {
-        matches = karpRabinSearch(dnaSeq, patSeq, dnaLen, patLen);
+    beginPhase(stats);
+    int matches;
+    if (usePacked) {
+        matches = dnaMatcherCountPacked(matcher, packed);
+    } else if (options->regionCount > 0) {
+        matches = dnaRegionSearch(matcher, dnaSeq, dnaLen, options->regions, options->regionCount,
+                                  options->threads, limit, positions);
+    } else {
+        matches = dnaParallelSearch(matcher, dnaSeq, dnaLen, options->threads, limit, positions);
     }
+    endPhase(stats, PHASE_SEARCH);
+    stats->engine = dnaMatcherEngine(matcher);
     
     // Output result
-    printf("The pattern was found: %d times\n", matches);
+    if (matches < 0) {
+        printf("Error: Memory allocation failed\n");
+    } else if (options->exists) {
+        printf("The pattern exists: %s\n", matches > 0 ? "yes" : "no");
+    } else {
+        for (i = 0; i < matches && limit > 0; i++) {
+            printf("Match at position %d\n", positions[i]);
+        }
+        printf("The pattern was found: %d times\n", matches);
+    }
     
     // Cleanup
+    free(positions);
+    dnaPackedTextFree(packed);
+    dnaMatcherFree(matcher);
+    free(unmasked);
     free(dnaSeq);
     free(patSeq);
     
+    return matches < 0;
+}
+
+/** One line of a batch query file */
+typedef struct {
+    char* pattern;        /**< Normalized pattern */
+    int patternLen;       /**< Length of the pattern */
+    DnaMatcher* matcher;  /**< Compiled pattern, NULL for empty queries */
+    int matches;          /**< Result, -1 if the query could not be run */
+} BatchQuery;
+
+/** State shared by the batch worker threads */
+typedef struct {
+    const char* text;     /**< Reference sequence, shared read-only */
+    int textLen;          /**< Length of the reference */
+    const DnaPackedText* packed;  /**< Packed reference for -pc, else NULL */
+    int limit;            /**< Stop each query after this many hits, 0 for none */
+    const DnaRegion* regions;  /**< Regions to search, or NULL for the whole text */
+    int regionCount;      /**< Number of regions */
+    BatchQuery* queries;  /**< All queries */
+    int queryCount;       /**< Number of queries */
+    atomic_int next;      /**< Index of the next query to claim */
+} BatchWork;
+
+/**
+ * @brief Hit callback that stops the search after a number of hits
+ * @param position Offset of the match (unused)
+ * @param userData Number of hits still wanted, decremented per hit
+ * @return Non-zero once no more hits are wanted
+ */
+int stopAfterHits(int position, void* userData) {
+    int* remaining = (int*)userData;
+    (void)position;
+    return --*remaining <= 0;
+}
+
+/**
+ * @brief Batch worker: claims queries one at a time until none are left
+ * @param arg The shared BatchWork
+ * @return NULL
+ */
+void* batchWorker(void* arg) {
+    BatchWork* work = (BatchWork*)arg;
+    int q;
+    
+    while ((q = atomic_fetch_add(&work->next, 1)) < work->queryCount) {
+        BatchQuery* query = &work->queries[q];
+        if (query->matcher != NULL && work->packed != NULL && work->limit > 0) {
+            int remaining = work->limit;
+            query->matches = dnaMatcherSearchPacked(query->matcher, work->packed, stopAfterHits, &remaining);
+        } else if (query->matcher != NULL && work->packed != NULL) {
+            query->matches = dnaMatcherCountPacked(query->matcher, work->packed);
+        } else if (query->matcher != NULL && work->regionCount > 0) {
+            // Queries already run in parallel, so each one scans on its own
+            query->matches = dnaRegionSearch(query->matcher, work->text, work->textLen, work->regions,
+                                             work->regionCount, 1, work->limit, NULL);
+        } else if (query->matcher != NULL && work->limit > 0) {
+            int remaining = work->limit;
+            query->matches = dnaMatcherSearch(query->matcher, work->text, work->textLen,
+                                              stopAfterHits, &remaining);
+        } else if (query->matcher != NULL) {
+            query->matches = dnaMatcherCount(query->matcher, work->text, work->textLen);
+        }
+    }
+    
+    return NULL;
+}
+
+/**
+ * @brief Reads every line of a query file, normalizing each into a pattern
+ * @param filename Query file, or "-" for stdin
+ * @param count Receives the number of queries
+ * @param stats Statistics the phase times are added to
+ * @return Newly allocated query array, or NULL on error
+ */
+BatchQuery* readQueries(const char* filename, int* count, RunStats* stats) {
+    FILE* file = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "r");
+    if (file == NULL) {
+        printf("Error: Cannot open file %s\n", filename);
+        return NULL;
+    }
+    
+    int capacity = 1024;
+    int used = 0;
+    BatchQuery* queries = (BatchQuery*)trackedMalloc(capacity * sizeof(BatchQuery));
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    ssize_t lineLen;
+    
+    beginPhase(stats);
+    while (queries != NULL && (lineLen = getline(&line, &lineCapacity, file)) != -1) {
+        if (used == capacity) {
+            BatchQuery* bigger = (BatchQuery*)trackedRealloc(queries, capacity * sizeof(BatchQuery),
+                                                             2 * capacity * sizeof(BatchQuery));
+            if (bigger == NULL) {
+                break;
+            }
+            capacity *= 2;
+            queries = bigger;
+        }
+        
+        BatchQuery* query = &queries[used];
+        query->pattern = (char*)trackedMalloc(lineLen + 1);
+        if (query->pattern == NULL) {
+            break;
+        }
+        query->patternLen = normalizeSequence(line, (int)lineLen, query->pattern, (int)lineLen + 1);
+        query->matcher = NULL;
+        query->matches = -1;
+        used++;
+    }
+    endPhase(stats, PHASE_LOAD);
+    
+    int complete = queries != NULL && feof(file);
+    free(line);
+    if (file != stdin) {
+        fclose(file);
+    }
+    
+    if (!complete) {
+        printf("Error: Memory allocation failed\n");
+        if (queries != NULL) {
+            while (used > 0) {
+                free(queries[--used].pattern);
+            }
+            free(queries);
+        }
+        return NULL;
+    }
+    
+    *count = used;
+    return queries;
+}
+
+/**
+ * @brief Runs every query of a query file against one loaded reference
+ * @param options Parsed command line options
+ * @param algorithm Algorithm flag (-bf, -kr, ... or -auto, chosen per query)
+ * @param dnaFile DNA sequence file, loaded once
+ * @param queryFile One pattern per line, or "-" for stdin
+ * @param stats Statistics being collected
+ * @return 0 on success, 1 on error
+ */
+int runBatch(const CliOptions* options, const char* algorithm, const char* dnaFile,
+             const char* queryFile, RunStats* stats) {
+    DnaAlgorithm engine = DNA_ALG_TWO_WAY;
+    int autoSelect = strcmp(algorithm, "-auto") == 0;
+    int i;
+    
+    if (!autoSelect && parseAlgorithm(algorithm, &engine) != 0) {
+        return 1;
+    }
+    
+    int dnaLen;
+    char* dnaSeq = loadReference(dnaFile, "DNA sequence", &dnaLen, stats);
+    if (dnaSeq == NULL) {
+        return 1;
+    }
+    
+    int queryCount;
+    BatchQuery* queries = readQueries(queryFile, &queryCount, stats);
+    if (queries == NULL) {
+        free(dnaSeq);
+        return 1;
+    }
+    
+    // With --dust every query skips what the masker finds
+    CliOptions dustOptions;
+    DnaRegion* unmasked = NULL;
+    if (options->dustLevel > 0) {
+        dustOptions = *options;
+        unmasked = dustRegions(options, dnaSeq, dnaLen, &dustOptions.regionCount, stats);
+        if (unmasked == NULL) {
+            printf("Error: Memory allocation failed\n");
+            for (i = 0; i < queryCount; i++) {
+                free(queries[i].pattern);
+            }
+            free(queries);
+            free(dnaSeq);
+            return 1;
+        }
+        dustOptions.regions = unmasked;
+        options = &dustOptions;
+    }
+    
+    // Compile every pattern up front so the workers only scan
+    BatchWork work;
+    work.packed = NULL;
+    work.limit = options->exists ? 1 : options->maxHits;
+    int countOnly = work.limit == 0 && options->regionCount == 0;
+    int packText = 0;
+    DnaComposition composition;
+    beginPhase(stats);
+    if (autoSelect) {
+        // One composition of the reference serves every query
+        dnaBaseComposition(dnaSeq, dnaLen, &composition);
+    }
+    for (i = 0; i < queryCount; i++) {
+        if (queries[i].patternLen > 0) {
+            DnaAlgorithm queryEngine = autoSelect ? dnaChooseAlgorithm(queries[i].pattern, queries[i].patternLen,
+                                                                       &composition, countOnly)
+                                                  : engine;
+            queries[i].matcher = dnaMatcherCreateFlags(queryEngine, queries[i].pattern, queries[i].patternLen,
+                                                       options->matchFlags);
+            packText |= queryEngine == DNA_ALG_POPCOUNT;
+        }
+    }
+    if (packText && options->regionCount == 0) {
+        // Packed once, shared read-only by every worker, limited or not
+        work.packed = dnaPackText(dnaSeq, dnaLen);
+    }
+    endPhase(stats, PHASE_PREPROCESS);
+    
+    work.text = dnaSeq;
+    work.textLen = dnaLen;
+    work.regions = options->regions;
+    work.regionCount = options->regionCount;
+    work.queries = queries;
+    work.queryCount = queryCount;
+    atomic_init(&work.next, 0);
+    
+    beginPhase(stats);
+    runWorkers(options->threads, batchWorker, &work);
+    endPhase(stats, PHASE_SEARCH);
+    
+    // One result line per query, in input order
+    for (i = 0; i < queryCount; i++) {
+        printf("%d\t%s\t%d\n", i + 1, queries[i].pattern, queries[i].matches);
+        dnaMatcherFree(queries[i].matcher);
+        free(queries[i].pattern);
+    }
+    
+    dnaPackedTextFree((DnaPackedText*)work.packed);
+    free(unmasked);
+    free(queries);
+    free(dnaSeq);
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Counts every pattern of a pattern file in one pass per pattern length
+ * @param options Parsed command line options
+ * @param algorithm Multi-pattern engine flag (-kr or -wm)
+ * @param dnaFile DNA sequence file
+ * @param patternFile One pattern per line, or "-" for stdin
+ * @param stats Statistics being collected
+ * @return 0 on success, 1 on error
+ */
+int runMulti(const CliOptions* options, const char* algorithm, const char* dnaFile,
+             const char* patternFile, RunStats* stats) {
+    DnaPatternSetOptions setOptions;
+    int i;
+    
+    memset(&setOptions, 0, sizeof(setOptions));
+    if (strcmp(algorithm, "-kr") == 0) {
+        setOptions.algorithm = DNA_MULTI_KARP_RABIN;
+        setOptions.bloomFpr = options->bloomFpr;
+    } else if (strcmp(algorithm, "-wm") == 0) {
+        setOptions.algorithm = DNA_MULTI_WU_MANBER;
+    } else {
+        printf("Error: Invalid algorithm. multi supports -kr for Karp-Rabin or -wm for Wu-Manber\n");
+        return 1;
+    }
+    
+    int dnaLen;
+    char* dnaSeq = loadReference(dnaFile, "DNA sequence", &dnaLen, stats);
+    if (dnaSeq == NULL) {
+        return 1;
+    }
+    
+    int queryCount;
+    BatchQuery* queries = readQueries(patternFile, &queryCount, stats);
+    if (queries == NULL) {
+        free(dnaSeq);
+        return 1;
+    }
+    
+    const char** patterns = (const char**)trackedMalloc((queryCount > 0 ? queryCount : 1) * sizeof(char*));
+    int* lengths = (int*)trackedMalloc((queryCount > 0 ? queryCount : 1) * sizeof(int));
+    int* counts = (int*)trackedMalloc((queryCount > 0 ? queryCount : 1) * sizeof(int));
+    DnaPatternSet* set = NULL;
+    int total = -1;
+    
+    beginPhase(stats);
+    if (patterns != NULL && lengths != NULL && counts != NULL) {
+        for (i = 0; i < queryCount; i++) {
+            patterns[i] = queries[i].pattern;
+            lengths[i] = queries[i].patternLen;
+        }
+        set = dnaPatternSetCreateWith(patterns, lengths, queryCount, &setOptions);
+    }
+    endPhase(stats, PHASE_PREPROCESS);
+    
+    if (set != NULL) {
+        beginPhase(stats);
+        total = dnaPatternSetCount(set, dnaSeq, dnaLen, options->threads, counts, &stats->filter);
+        endPhase(stats, PHASE_SEARCH);
+        stats->engine = setOptions.algorithm == DNA_MULTI_WU_MANBER ? "wu-manber" : "multi-karp-rabin";
+        stats->hasFilter = setOptions.bloomFpr > 0;
+    }
+    
+    if (total < 0) {
+        printf("Error: Memory allocation failed\n");
+    }
+    
+    // One result line per pattern, in input order, as in batch mode
+    for (i = 0; i < queryCount; i++) {
+        if (total >= 0) {
+            printf("%d\t%s\t%d\n", i + 1, queries[i].pattern,
+                   queries[i].patternLen > 0 ? counts[i] : -1);
+        }
+        free(queries[i].pattern);
+    }
+    
+    dnaPatternSetFree(set);
+    free(patterns);
+    free(lengths);
+    free(counts);
+    free(queries);
+    free(dnaSeq);
+    return total < 0;
+}
+
+/**
+ * @brief Parses the --scores argument
+ * @param spec "match,mismatch,gapOpen,gapExtend", e.g. "2,-3,5,2"
+ * @param scoring Receives the scores
+ * @return 0 on success, 1 on error
+ */
+int parseScores(const char* spec, DnaAlignScoring* scoring) {
+    char extra;
+    if (sscanf(spec, "%d,%d,%d,%d%c", &scoring->match, &scoring->mismatch, &scoring->gapOpen,
+               &scoring->gapExtend, &extra) != 4 ||
+        scoring->match <= 0 || scoring->mismatch > 0 || scoring->gapOpen < 1 || scoring->gapExtend < 1 ||
+        scoring->match + scoring->gapOpen - scoring->mismatch > 255) {
+        printf("Error: --scores needs M,X,O,E with M > 0, X <= 0, O >= 1, E >= 1 and M + O - X <= 255\n");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Reports the best local alignment of a probe against the reference
+ * @param options Parsed command line options
+ * @param dnaFile DNA sequence file
+ * @param probeFile Probe sequence file
+ * @param stats Statistics being collected
+ * @return 0 on success, 1 on error
+ */
+int runAlign(const CliOptions* options, const char* dnaFile, const char* probeFile, RunStats* stats) {
+    int dnaLen;
+    char* dnaSeq = loadReference(dnaFile, "DNA sequence", &dnaLen, stats);
+    if (dnaSeq == NULL) {
+        return 1;
+    }
+    
+    int probeLen;
+    char* probe = loadReference(probeFile, "probe", &probeLen, stats);
+    if (probe == NULL) {
+        free(dnaSeq);
+        return 1;
+    }
+    
+    if (probeLen == 0) {
+        printf("Error: Empty pattern\n");
+        free(dnaSeq);
+        free(probe);
+        return 1;
+    }
+    
+    DnaAlignment best;
+    beginPhase(stats);
+    int failed = dnaAlignBest(probe, probeLen, dnaSeq, dnaLen, &options->scoring, options->threads, &best);
+    endPhase(stats, PHASE_SEARCH);
+    
+    if (failed == -2) {
+        printf("Error: Could not trace the best alignment back to its start\n");
+    } else if (failed) {
+        printf("Error: Memory allocation failed\n");
+    } else if (best.score == 0) {
+        printf("No alignment found\n");
+    } else {
+        // Same 0-based positions as the match listings, end inclusive
+        printf("Best alignment score: %d at position %d-%d\n", best.score, best.textStart, best.textEnd - 1);
+        stats->engine = best.engine;
+    }
+    
+    free(dnaSeq);
+    free(probe);
+    return failed ? 1 : 0;
+}
+
+/**
+ * @brief Reports the approximate occurrences of a pattern found by seed and extend
+ * @param options Parsed command line options
+ * @param dnaFile DNA sequence file
+ * @param patternFile Pattern sequence file
+ * @param stats Statistics being collected
+ * @return 0 on success, 1 on error
+ */
+int runApprox(const CliOptions* options, const char* dnaFile, const char* patternFile, RunStats* stats) {
+    int dnaLen;
+    char* dnaSeq = loadReference(dnaFile, "DNA sequence", &dnaLen, stats);
+    if (dnaSeq == NULL) {
+        return 1;
+    }
+    
+    int patLen;
+    char* patSeq = loadReference(patternFile, "pattern", &patLen, stats);
+    if (patSeq == NULL) {
+        free(dnaSeq);
+        return 1;
+    }
+    
+    if (patLen == 0) {
+        printf("Error: Empty pattern\n");
+        free(dnaSeq);
+        free(patSeq);
+        return 1;
+    }
+    
+    // Two seeds on one diagonal before anything is aligned, as in two-hit BLAST
+    DnaApproxOptions approx;
+    approx.seedLength = options->seedLength;
+    approx.minSeeds = 2;
+    approx.minScore = options->minScore > 0 ? options->minScore : patLen * options->scoring.match / 2;
+    approx.scoring = options->scoring;
+    
+    int hitCount = 0;
+    beginPhase(stats);
+    DnaApproxHit* hits = dnaApproxSearch(patSeq, patLen, dnaSeq, dnaLen, &approx, &hitCount);
+    endPhase(stats, PHASE_SEARCH);
+    
+    if (hits == NULL) {
+        printf("Error: Memory allocation failed\n");
+        free(dnaSeq);
+        free(patSeq);
+        return 1;
+    }
+    
+    int i;
+    for (i = 0; i < hitCount; i++) {
+        printf("Approximate match at position %d-%d (score %d)\n", hits[i].textStart,
+               hits[i].textEnd - 1, hits[i].score);
+    }
+    printf("The pattern was found approximately: %d times\n", hitCount);
+    stats->engine = "seed-and-extend";
+    
+    free(hits);
+    free(dnaSeq);
+    free(patSeq);
+    return 0;
+}
+
+/**
+ * @brief Searches a pattern through a minimizer index of the reference
+ * @param options Parsed command line options
+ * @param algorithm Algorithm flag used to verify the candidates
+ * @param dnaFile DNA sequence file
+ * @param patternFile Pattern sequence file
+ * @param stats Statistics being collected
+ * @return 0 on success, 1 on error
+ */
+int runMinimizer(const CliOptions* options, const char* algorithm, const char* dnaFile,
+                 const char* patternFile, RunStats* stats) {
+    DnaAlgorithm engine;
+    int i;
+    
+    if (parseAlgorithm(algorithm, &engine) != 0) {
+        return 1;
+    }
+    
+    int dnaLen;
+    char* dnaSeq = loadReference(dnaFile, "DNA sequence", &dnaLen, stats);
+    if (dnaSeq == NULL) {
+        return 1;
+    }
+    
+    int patLen;
+    char* patSeq = loadReference(patternFile, "pattern", &patLen, stats);
+    if (patSeq == NULL) {
+        free(dnaSeq);
+        return 1;
+    }
+    
+    if (patLen == 0) {
+        printf("Error: Empty pattern\n");
+        free(dnaSeq);
+        free(patSeq);
+        return 1;
+    }
+    
+    int limit = options->exists ? 1 : options->maxHits;
+    int* positions = NULL;
+    beginPhase(stats);
+    DnaMinimizerIndex* index = dnaMinimizerIndexBuild(dnaSeq, dnaLen, options->minimizerK, options->minimizerW);
+    DnaMatcher* matcher = dnaMatcherCreate(engine, patSeq, patLen);
+    if (limit > 0) {
+        positions = (int*)trackedMalloc(limit * sizeof(int));
+    }
+    endPhase(stats, PHASE_PREPROCESS);
+    
+    int matches = -1;
+    if (index != NULL && matcher != NULL && (limit == 0 || positions != NULL)) {
+        beginPhase(stats);
+        matches = dnaMinimizerSearch(index, matcher, patSeq, patLen, dnaSeq, dnaLen, limit, positions);
+        endPhase(stats, PHASE_SEARCH);
+        stats->engine = dnaMatcherEngine(matcher);
+        stats->indexBytes = dnaMinimizerIndexBytes(index);
+        stats->indexEntries = dnaMinimizerIndexSize(index);
+    }
+    
+    if (matches < 0) {
+        printf("Error: Memory allocation failed\n");
+    } else if (options->exists) {
+        printf("The pattern exists: %s\n", matches > 0 ? "yes" : "no");
+    } else {
+        for (i = 0; i < matches && limit > 0; i++) {
+            printf("Match at position %d\n", positions[i]);
+        }
+        printf("The pattern was found: %d times\n", matches);
+    }
+    
+    free(positions);
+    dnaMatcherFree(matcher);
+    dnaMinimizerIndexFree(index);
+    free(dnaSeq);
+    free(patSeq);
+    return matches < 0;
+}
+
+/**
+ * @brief Answers every query of a query file from one q-gram index of the reference
+ * @param options Parsed command line options
+ * @param dnaFile DNA sequence file, indexed once
+ * @param queryFile One pattern per line, or "-" for stdin
+ * @param stats Statistics being collected
+ * @return 0 on success, 1 on error
+ */
+int runQgram(const CliOptions* options, const char* dnaFile, const char* queryFile, RunStats* stats) {
+    int i;
+    
+    int dnaLen;
+    char* dnaSeq = loadReference(dnaFile, "DNA sequence", &dnaLen, stats);
+    if (dnaSeq == NULL) {
+        return 1;
+    }
+    
+    int queryCount;
+    BatchQuery* queries = readQueries(queryFile, &queryCount, stats);
+    if (queries == NULL) {
+        free(dnaSeq);
+        return 1;
+    }
+    
+    beginPhase(stats);
+    DnaQgramIndex* index = dnaQgramIndexBuild(dnaSeq, dnaLen, options->qgramLength);
+    endPhase(stats, PHASE_PREPROCESS);
+    
+    int failed = index == NULL;
+    if (!failed) {
+        // --max-hits and --exists cap every count, as in batch mode
+        int limit = options->exists ? 1 : options->maxHits;
+        int* positions = limit > 0 ? (int*)trackedMalloc(limit * sizeof(int)) : NULL;
+        failed = limit > 0 && positions == NULL;
+        beginPhase(stats);
+        for (i = 0; i < queryCount && !failed; i++) {
+            queries[i].matches = queries[i].patternLen > 0 ?
+                dnaQgramSearch(index, dnaSeq, dnaLen, queries[i].pattern, queries[i].patternLen,
+                               options->mismatches, limit, positions) : -1;
+            failed = queries[i].patternLen > 0 && queries[i].matches < 0;
+        }
+        endPhase(stats, PHASE_SEARCH);
+        stats->engine = "qgram-index";
+        stats->indexBytes = dnaQgramIndexBytes(index);
+        stats->indexEntries = dnaQgramIndexSize(index);
+        free(positions);
+    }
+    
+    if (failed) {
+        printf("Error: Memory allocation failed\n");
+    }
+    
+    // One result line per query, in input order, as in batch mode
+    for (i = 0; i < queryCount; i++) {
+        if (!failed) {
+            printf("%d\t%s\t%d\n", i + 1, queries[i].pattern, queries[i].matches);
+        }
+        free(queries[i].pattern);
+    }
+    
+    dnaQgramIndexFree(index);
+    free(queries);
+    free(dnaSeq);
+    return failed;
+}
+
+/**
+ * @brief Counts substrings of the reference through its suffix automaton
+ *
+ * Queries are answered as they are read, so "-" can be used interactively.
+ *
+ * @param dnaFile DNA sequence file
+ * @param queryFile One substring per line, or "-" for stdin
+ * @param stats Statistics being collected
+ * @return 0 on success, 1 on error
+ */
+int runSam(const char* dnaFile, const char* queryFile, RunStats* stats) {
+    int dnaLen;
+    char* dnaSeq = loadReference(dnaFile, "DNA sequence", &dnaLen, stats);
+    if (dnaSeq == NULL) {
+        return 1;
+    }
+    
+    beginPhase(stats);
+    DnaSuffixAutomaton* automaton = dnaSuffixAutomatonBuild(dnaSeq, dnaLen);
+    endPhase(stats, PHASE_PREPROCESS);
+    free(dnaSeq);
+    if (automaton == NULL) {
+        printf("Error: Memory allocation failed\n");
+        return 1;
+    }
+    stats->engine = "suffix-automaton";
+    stats->indexBytes = dnaSuffixAutomatonBytes(automaton);
+    stats->indexEntries = dnaSuffixAutomatonStates(automaton);
+    
+    FILE* file = strcmp(queryFile, "-") == 0 ? stdin : fopen(queryFile, "r");
+    if (file == NULL) {
+        printf("Error: Cannot open file %s\n", queryFile);
+        dnaSuffixAutomatonFree(automaton);
+        return 1;
+    }
+    
+    char* line = NULL;
+    char* pattern = NULL;
+    size_t lineCapacity = 0;
+    int patternCapacity = 0;
+    ssize_t lineLen;
+    int number = 0;
+    int status = 0;
+    
+    while ((lineLen = getline(&line, &lineCapacity, file)) != -1) {
+        if ((int)lineLen + 1 > patternCapacity) {
+            char* bigger = (char*)trackedRealloc(pattern, patternCapacity, lineLen + 1);
+            if (bigger == NULL) {
+                printf("Error: Memory allocation failed\n");
+                status = 1;
+                break;
+            }
+            pattern = bigger;
+            patternCapacity = (int)lineLen + 1;
+        }
+        
+        beginPhase(stats);
+        int patternLen = normalizeSequence(line, (int)lineLen, pattern, patternCapacity);
+        int count = patternLen > 0 ? dnaSuffixAutomatonCount(automaton, pattern, patternLen) : -1;
+        endPhase(stats, PHASE_SEARCH);
+        
+        // Same line format as batch mode, flushed for interactive use
+        printf("%d\t%s\t%d\n", ++number, pattern, count);
+        if (file == stdin) {
+            fflush(stdout);
+        }
+    }
+    
+    free(line);
+    free(pattern);
+    if (file != stdin) {
+        fclose(file);
+    }
+    dnaSuffixAutomatonFree(automaton);
+    return status;
+}
+
+/**
+ * @brief Reports the maximal matches between a query sequence and a reference
+ * @param options Parsed command line options
+ * @param referenceFile Reference sequence file, turned into a suffix automaton
+ * @param queryFile Query sequence file, scanned in chunks by the threads
+ * @param stats Statistics being collected
+ * @return 0 on success, 1 on error
+ */
+int runMem(const CliOptions* options, const char* referenceFile, const char* queryFile, RunStats* stats) {
+    int referenceLen;
+    char* reference = loadReference(referenceFile, "DNA sequence", &referenceLen, stats);
+    if (reference == NULL) {
+        return 1;
+    }
+    
+    int queryLen;
+    char* query = loadReference(queryFile, "query", &queryLen, stats);
+    if (query == NULL) {
+        free(reference);
+        return 1;
+    }
+    
+    beginPhase(stats);
+    DnaSuffixAutomaton* automaton = dnaSuffixAutomatonBuild(reference, referenceLen);
+    endPhase(stats, PHASE_PREPROCESS);
+    
+    int matchCount = 0;
+    DnaMaximalMatch* matches = NULL;
+    if (automaton != NULL) {
+        beginPhase(stats);
+        int minLength = options->minLength > 0 ? options->minLength : 20;
+        matches = dnaMaximalMatches(automaton, query, queryLen, minLength, options->threads, &matchCount);
+        endPhase(stats, PHASE_SEARCH);
+        stats->engine = "suffix-automaton";
+        stats->indexBytes = dnaSuffixAutomatonBytes(automaton);
+        stats->indexEntries = dnaSuffixAutomatonStates(automaton);
+    }
+    
+    if (matches == NULL) {
+        printf("Error: Memory allocation failed\n");
+    }
+    
+    // One line per match: query start, first reference start, length, reference occurrences
+    int i;
+    for (i = 0; i < matchCount; i++) {
+        printf("%d\t%d\t%d\t%d\n", matches[i].queryStart, matches[i].textStart, matches[i].length,
+               matches[i].count);
+    }
+    
+    free(matches);
+    dnaSuffixAutomatonFree(automaton);
+    free(reference);
+    free(query);
+    return matches == NULL;
+}
+
+/**
+ * @brief Reports the tandem repeats (micro- and minisatellites) of a DNA sequence
+ * @param options Parsed command line options
+ * @param dnaFile DNA sequence file
+ * @param stats Statistics being collected
+ * @return 0 on success, 1 on error
+ */
+int runRepeats(const CliOptions* options, const char* dnaFile, RunStats* stats) {
+    int dnaLen;
+    char* dnaSeq = loadReference(dnaFile, "DNA sequence", &dnaLen, stats);
+    if (dnaSeq == NULL) {
+        return 1;
+    }
+    
+    int repeatCount = 0;
+    int minLength = options->minLength > 0 ? options->minLength : 12;
+    beginPhase(stats);
+    DnaTandemRepeat* repeats = dnaTandemRepeats(dnaSeq, dnaLen, options->maxPeriod, minLength, &repeatCount);
+    endPhase(stats, PHASE_SEARCH);
+    stats->engine = "offset-window";
+    
+    if (repeats == NULL) {
+        printf("Error: Memory allocation failed\n");
+        free(dnaSeq);
+        return 1;
+    }
+    
+    // One line per repeat: start, end (0-based, half-open), period, copies, unit
+    int i;
+    for (i = 0; i < repeatCount; i++) {
+        int length = repeats[i].end - repeats[i].start;
+        printf("%d\t%d\t%d\t%.1f\t%.*s\n", repeats[i].start, repeats[i].end, repeats[i].period,
+               (double)length / repeats[i].period, repeats[i].period, dnaSeq + repeats[i].start);
+    }
+    
+    free(repeats);
+    free(dnaSeq);
+    return 0;
+}
+
+/**
+ * @brief Prints a DNA sequence with its low-complexity regions soft-masked (in lower case)
+ * @param options Parsed command line options
+ * @param dnaFile DNA sequence file
+ * @param stats Statistics being collected
+ * @return 0 on success, 1 on error
+ */
+int runDust(const CliOptions* options, const char* dnaFile, RunStats* stats) {
+    int dnaLen;
+    char* dnaSeq = loadReference(dnaFile, "DNA sequence", &dnaLen, stats);
+    if (dnaSeq == NULL) {
+        return 1;
+    }
+    
+    int maskedCount;
+    int level = options->dustLevel > 0 ? options->dustLevel : DUST_DEFAULT_LEVEL;
+    beginPhase(stats);
+    DnaRegion* masked = dnaDustMask(dnaSeq, dnaLen, DUST_WINDOW, level, &maskedCount);
+    endPhase(stats, PHASE_SEARCH);
+    stats->engine = "dust";
+    
+    if (masked == NULL) {
+        printf("Error: Memory allocation failed\n");
+        free(dnaSeq);
+        return 1;
+    }
+    
+    stats->hasDust = 1;
+    stats->dustWall = stats->wall[PHASE_SEARCH];
+    stats->maskedRegions = maskedCount;
+    stats->maskedBases = dnaSoftMask(dnaSeq, masked, maskedCount);
+    printf("%s\n", dnaSeq);
+    
+    free(masked);
+    free(dnaSeq);
+    return 0;
+}
+
+/**
+ * @brief Writes the GC content, GC skew or entropy of a DNA sequence in sliding windows as bedGraph
+ * @param options Parsed command line options
+ * @param dnaFile DNA sequence file; its name without directory and extension is the chrom column
+ * @param stats Statistics being collected
+ * @return 0 on success, 1 on error
+ */
+int runGc(const CliOptions* options, const char* dnaFile, RunStats* stats) {
+    int dnaLen;
+    char* dnaSeq = loadReference(dnaFile, "DNA sequence", &dnaLen, stats);
+    if (dnaSeq == NULL) {
+        return 1;
+    }
+    
+    int windowCount = 0;
+    int step = options->windowStep > 0 ? options->windowStep : options->window;
+    beginPhase(stats);
+    DnaCompositionWindow* windows = dnaCompositionProfile(dnaSeq, dnaLen, options->window, step, &windowCount);
+    endPhase(stats, PHASE_SEARCH);
+    stats->engine = "sliding-window";
+    
+    if (windows == NULL) {
+        printf("Error: Memory allocation failed\n");
+        free(dnaSeq);
+        return 1;
+    }
+    
+    // The sequence is named after its file, as bedGraph needs a chrom
+    const char* chrom = strrchr(dnaFile, '/') != NULL ? strrchr(dnaFile, '/') + 1 : dnaFile;
+    const char* extension = strrchr(chrom, '.');
+    int chromLen = extension != NULL && extension != chrom ? (int)(extension - chrom) : (int)strlen(chrom);
+    
+    printf("track type=bedGraph name=\"%.*s %s\"\n", chromLen, chrom, options->track);
+    int i;
+    for (i = 0; i < windowCount; i++) {
+        const DnaComposition* composition = &windows[i].composition;
+        double value = strcmp(options->track, "skew") == 0 ? composition->skew :
+                       strcmp(options->track, "entropy") == 0 ? composition->entropy : composition->gc;
+        printf("%.*s\t%d\t%d\t%.4f\n", chromLen, chrom, windows[i].start, windows[i].end, value);
+    }
+    
+    free(windows);
+    free(dnaSeq);
+    return 0;
+}
+
+/**
+ * @brief Turns the --enzymes list into indices of the built-in enzyme table
+ * @param list Comma-separated enzyme names, NULL for every enzyme, "none" for none
+ * @param enzymeCount Receives the number of enzymes
+ * @return Enzyme indices (free()), or NULL on error (message printed)
+ */
+int* parseEnzymes(const char* list, int* enzymeCount) {
+    int tableSize;
+    dnaEnzymeTable(&tableSize);
+    int capacity = tableSize;
+    int i;
+    
+    if (list != NULL) {
+        for (i = 0; list[i] != '\0'; i++) {
+            capacity += list[i] == ',';
+        }
+    }
+    int* enzymes = (int*)trackedMalloc(capacity * sizeof(int));
+    if (enzymes == NULL) {
+        printf("Error: Memory allocation failed\n");
+        return NULL;
+    }
+    
+    *enzymeCount = 0;
+    if (list == NULL) {
+        for (i = 0; i < tableSize; i++) {
+            enzymes[(*enzymeCount)++] = i;
+        }
+        return enzymes;
+    }
+    if (strcmp(list, "none") == 0) {
+        return enzymes;
+    }
+    
+    const char* name = list;
+    while (1) {
+        const char* comma = strchr(name, ',');
+        int length = comma != NULL ? (int)(comma - name) : (int)strlen(name);
+        char buffer[32];
+        int enzyme = -1;
+        if (length < (int)sizeof(buffer)) {
+            memcpy(buffer, name, length);
+            buffer[length] = '\0';
+            enzyme = dnaFindEnzyme(buffer);
+        }
+        if (enzyme < 0) {
+            printf("Error: Unknown enzyme %.*s\n", length, name);
+            free(enzymes);
+            return NULL;
+        }
+        enzymes[(*enzymeCount)++] = enzyme;
+        if (comma == NULL) {
+            break;
+        }
+        name = comma + 1;
+    }
+    return enzymes;
+}
+
+/**
+ * @brief Reports the restriction sites and, optionally, the palindromes of a DNA sequence
+ * @param options Parsed command line options
+ * @param dnaFile DNA sequence file
+ * @param stats Statistics being collected
+ * @return 0 on success, 1 on error
+ */
+int runSites(const CliOptions* options, const char* dnaFile, RunStats* stats) {
+    int enzymeCount;
+    int* enzymes = parseEnzymes(options->enzymes, &enzymeCount);
+    if (enzymes == NULL) {
+        return 1;
+    }
+    
+    int dnaLen;
+    char* dnaSeq = loadReference(dnaFile, "DNA sequence", &dnaLen, stats);
+    if (dnaSeq == NULL) {
+        free(enzymes);
+        return 1;
+    }
+    
+    int hitCount = 0;
+    int palindromeCount = 0;
+    DnaPalindrome* palindromes = NULL;
+    beginPhase(stats);
+    DnaSiteHit* hits = dnaEnzymeSites(dnaSeq, dnaLen, enzymes, enzymeCount, &hitCount);
+    if (hits != NULL && options->palindromeMin > 0) {
+        palindromes = dnaPalindromes(dnaSeq, dnaLen, options->palindromeMin, options->palindromeMax,
+                                     &palindromeCount);
+    }
+    endPhase(stats, PHASE_SEARCH);
+    stats->engine = "multi-karp-rabin";
+    
+    int status = 0;
+    if (hits == NULL || (options->palindromeMin > 0 && palindromes == NULL)) {
+        printf("Error: Memory allocation failed\n");
+        status = 1;
+    } else {
+        // One line per site, grouped by enzyme: enzyme, position, bases
+        int tableSize;
+        const DnaEnzyme* table = dnaEnzymeTable(&tableSize);
+        int i;
+        for (i = 0; i < hitCount; i++) {
+            const DnaEnzyme* enzyme = &table[enzymes[hits[i].enzyme]];
+            printf("%s\t%d\t%.*s\n", enzyme->name, hits[i].position, (int)strlen(enzyme->site),
+                   dnaSeq + hits[i].position);
+        }
+        for (i = 0; i < palindromeCount; i++) {
+            printf("palindrome\t%d\t%.*s\n", palindromes[i].start, palindromes[i].length,
+                   dnaSeq + palindromes[i].start);
+        }
+    }
+    
+    free(hits);
+    free(palindromes);
+    free(enzymes);
+    free(dnaSeq);
+    return status;
+}
+
+/**
+ * @brief Loads every reference once and serves queries on a Unix socket
+ * @param options Parsed command line options
+ * @param socketPath Filesystem path of the socket
+ * @param dnaFiles Reference files, numbered from 0 in this order
+ * @param fileCount Number of reference files
+ * @param stats Statistics being collected
+ * @return 0 on clean shutdown, 1 on error
+ */
+int runServe(const CliOptions* options, const char* socketPath, char** dnaFiles, int fileCount,
+             RunStats* stats) {
+    char* references[MAX_POSITIONAL];
+    int referenceLens[MAX_POSITIONAL];
+    int loaded;
+    int status = 1;
+    
+    for (loaded = 0; loaded < fileCount; loaded++) {
+        references[loaded] = loadReference(dnaFiles[loaded], "DNA sequence", &referenceLens[loaded],
+                                           stats);
+        if (references[loaded] == NULL) {
+            break;
+        }
+    }
+    
+    if (loaded == fileCount) {
+        status = runServer(socketPath, references, referenceLens, fileCount, options->threads);
+    }
+    
+    while (loaded > 0) {
+        free(references[--loaded]);
+    }
+    return status;
+}
+
+/**
+ * @brief Sends a single count/locate/stats request to a running server
+ * @param socketPath Filesystem path of the server socket
+ * @param operation "count", "locate" or "stats"
+ * @param arguments Reference index, algorithm flag and pattern (unused for stats)
+ * @param argumentCount Number of arguments
+ * @return 0 on success, 1 on error
+ */
+int runQuery(const char* socketPath, const char* operation, char** arguments, int argumentCount) {
+    if (strcmp(operation, "stats") == 0 && argumentCount == 0) {
+        return runQueryClient(socketPath, QUERY_OP_STATS, 0, 0, "");
+    }
+    
+    int op = strcmp(operation, "count") == 0 ? QUERY_OP_COUNT :
+             strcmp(operation, "locate") == 0 ? QUERY_OP_LOCATE : 0;
+    if (op == 0 || argumentCount != 3) {
+        printf("Error: Invalid query. Use count, locate or stats\n");
+        return 1;
+    }
+    
+    DnaAlgorithm engine;
+    if (parseAlgorithm(arguments[1], &engine) != 0) {
+        return 1;
+    }
+    
+    int rawLen = (int)strlen(arguments[2]);
+    char* pattern = (char*)trackedMalloc(rawLen + 1);
+    if (pattern == NULL) {
+        printf("Error: Memory allocation failed\n");
+        return 1;
+    }
+    
+    int status;
+    int reference;
+    if (parseNumber(arguments[0], 0, INT_MAX, &reference) != 0) {
+        printf("Error: Invalid reference index %s\n", arguments[0]);
+        status = 1;
+    } else if (normalizeSequence(arguments[2], rawLen, pattern, rawLen + 1) == 0) {
+        printf("Error: Empty pattern\n");
+        status = 1;
+    } else {
+        status = runQueryClient(socketPath, op, reference, engine, pattern);
+    }
+    
+    free(pattern);
+    return status;
+}
+
+/**
+ * @brief Counts every k-mer of a DNA sequence file and prints the counts
+ * @param options Parsed command line options
+ * @param kFlag Must be "-k"
+ * @param kValue K-mer length, 1 to 32
+ * @param dnaFile DNA sequence file
+ * @param stats Statistics being collected
+ * @return 0 on success, 1 on error
+ */
+int runKmers(const CliOptions* options, const char* kFlag, const char* kValue,
+             const char* dnaFile, RunStats* stats) {
+    int k;
+    if (strcmp(kFlag, "-k") != 0 || parseNumber(kValue, 1, 32, &k) != 0) {
+        printf("Error: kmers needs -k K with K between 1 and 32\n");
+        return 1;
+    }
+    
+    int dnaLen;
+    char* dnaSeq = loadReference(dnaFile, "DNA sequence", &dnaLen, stats);
+    if (dnaSeq == NULL) {
+        return 1;
+    }
+    
+    int distinct;
+    beginPhase(stats);
+    DnaKmerCount* counts = dnaCountKmers(dnaSeq, dnaLen, k, options->canonical, options->threads,
+                                         &distinct);
+    endPhase(stats, PHASE_SEARCH);
+    
+    if (counts == NULL) {
+        printf("Error: Memory allocation failed\n");
+        free(dnaSeq);
+        return 1;
+    }
+    
+    char kmer[33];
+    int i;
+    for (i = 0; i < distinct; i++) {
+        dnaDecodeKmer(counts[i].kmer, k, kmer);
+        printf("%s\t%u\n", kmer, counts[i].count);
+    }
+    
+    free(counts);
+    free(dnaSeq);
+    return 0;
+}
+
+/**
+ * @brief Main function
+ * @param argc Number of command line arguments
+ * @param argv Array of command line arguments
+ * @return 0 on success, 1 on error
+ */
+int main(int argc, char *argv[]) {
+    CliOptions options;
+    char* positional[MAX_POSITIONAL];
+    int positionalCount = 0;
+    int i;
+    
+    memset(&options, 0, sizeof(options));
+    options.threads = defaultThreadCount();
+    options.scoring.match = 2;
+    options.scoring.mismatch = -3;
+    options.scoring.gapOpen = 5;
+    options.scoring.gapExtend = 2;
+    options.seedLength = 11;
+    options.minimizerW = 10;
+    options.minimizerK = 15;
+    options.qgramLength = 10;
+    options.maxPeriod = 6;
+    options.window = 1000;
+    options.track = "gc";
+    
+    // Separate --options from the positional arguments
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stats") == 0) {
+            options.showStats = 1;
+        } else if (strcmp(argv[i], "--stats=json") == 0) {
+            options.showStats = 1;
+            options.statsJson = 1;
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            if (i + 1 >= argc || parseNumber(argv[++i], 1, INT_MAX, &options.threads) != 0) {
+                printf("Error: --threads needs a positive number\n");
+                free(options.regions);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--canonical") == 0) {
+            options.canonical = 1;
+        } else if (strcmp(argv[i], "--non-overlapping") == 0) {
+            options.matchFlags |= DNA_NON_OVERLAPPING;
+        } else if (strcmp(argv[i], "--exists") == 0) {
+            options.exists = 1;
+        } else if (strcmp(argv[i], "--max-hits") == 0) {
+            if (i + 1 >= argc || parseNumber(argv[++i], 1, INT_MAX, &options.maxHits) != 0) {
+                printf("Error: --max-hits needs a positive number\n");
+                free(options.regions);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--bloom-fpr") == 0) {
+            if (i + 1 >= argc || (options.bloomFpr = atof(argv[++i])) <= 0 || options.bloomFpr >= 1) {
+                printf("Error: --bloom-fpr needs a rate between 0 and 1\n");
+                free(options.regions);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--scores") == 0) {
+            if (i + 1 >= argc) {
+                printf("Error: --scores needs an argument\n");
+                free(options.regions);
+                return 1;
+            }
+            if (parseScores(argv[++i], &options.scoring) != 0) {
+                free(options.regions);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            if (i + 1 >= argc || parseNumber(argv[++i], 1, INT_MAX, &options.seedLength) != 0) {
+                printf("Error: --seed needs a positive length\n");
+                free(options.regions);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--min-score") == 0) {
+            if (i + 1 >= argc || parseNumber(argv[++i], 1, INT_MAX, &options.minScore) != 0) {
+                printf("Error: --min-score needs a positive score\n");
+                free(options.regions);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--minimizer") == 0) {
+            char extra;
+            if (i + 1 >= argc ||
+                sscanf(argv[++i], "%d,%d%c", &options.minimizerW, &options.minimizerK, &extra) != 2 ||
+                options.minimizerW < 1 || options.minimizerK < 1 || options.minimizerK > 32) {
+                printf("Error: --minimizer needs W,K with W >= 1 and K between 1 and 32\n");
+                free(options.regions);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--qgram") == 0) {
+            if (i + 1 >= argc || parseNumber(argv[++i], 1, 12, &options.qgramLength) != 0) {
+                printf("Error: --qgram needs a length between 1 and 12\n");
+                free(options.regions);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--mismatches") == 0) {
+            if (i + 1 >= argc || parseNumber(argv[++i], 0, INT_MAX, &options.mismatches) != 0) {
+                printf("Error: --mismatches needs a number of at least 0\n");
+                free(options.regions);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--min-length") == 0) {
+            if (i + 1 >= argc || parseNumber(argv[++i], 1, INT_MAX, &options.minLength) != 0) {
+                printf("Error: --min-length needs a positive length\n");
+                free(options.regions);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--max-period") == 0) {
+            if (i + 1 >= argc || parseNumber(argv[++i], 1, INT_MAX, &options.maxPeriod) != 0) {
+                printf("Error: --max-period needs a positive length\n");
+                free(options.regions);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--enzymes") == 0) {
+            if (i + 1 >= argc) {
+                printf("Error: --enzymes needs a list of enzymes\n");
+                free(options.regions);
+                return 1;
+            }
+            options.enzymes = argv[++i];
+        } else if (strcmp(argv[i], "--palindrome") == 0) {
+            char extra;
+            if (i + 1 >= argc ||
+                sscanf(argv[++i], "%d,%d%c", &options.palindromeMin, &options.palindromeMax, &extra) != 2 ||
+                options.palindromeMin < 2 || options.palindromeMax < options.palindromeMin) {
+                printf("Error: --palindrome needs MIN,MAX with 2 <= MIN <= MAX\n");
+                free(options.regions);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--window") == 0) {
+            char extra;
+            int fields = i + 1 < argc ? sscanf(argv[++i], "%d,%d%c", &options.window, &options.windowStep, &extra) : 0;
+            if ((fields != 1 && fields != 2) || options.window < 1 || options.windowStep < 0 ||
+                (fields == 2 && options.windowStep == 0)) {
+                printf("Error: --window needs W or W,S with positive lengths\n");
+                free(options.regions);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--track") == 0) {
+            if (i + 1 >= argc || (strcmp(argv[i + 1], "gc") != 0 && strcmp(argv[i + 1], "skew") != 0 &&
+                                  strcmp(argv[i + 1], "entropy") != 0)) {
+                printf("Error: --track needs gc, skew or entropy\n");
+                free(options.regions);
+                return 1;
+            }
+            options.track = argv[++i];
+        } else if (strcmp(argv[i], "--dust") == 0) {
+            if (options.dustLevel == 0) {
+                options.dustLevel = DUST_DEFAULT_LEVEL;
+            }
+        } else if (strcmp(argv[i], "--dust-level") == 0) {
+            if (i + 1 >= argc || parseNumber(argv[++i], 1, INT_MAX, &options.dustLevel) != 0) {
+                printf("Error: --dust-level needs a positive level\n");
+                free(options.regions);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--region") == 0 || strcmp(argv[i], "--bed") == 0) {
+            if (i + 1 >= argc) {
+                printf("Error: %s needs an argument\n", argv[i]);
+                free(options.regions);
+                return 1;
+            }
+            int failed = strcmp(argv[i], "--bed") == 0 ? readBedFile(&options, argv[i + 1])
+                                                        : parseRegion(&options, argv[i + 1]);
+            i++;
+            if (failed) {
+                free(options.regions);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            printf("Error: Unknown option %s\n", argv[i]);
+            printUsage(argv[0]);
+            free(options.regions);
+            return 1;
+        } else if (positionalCount < MAX_POSITIONAL) {
+            positional[positionalCount++] = argv[i];
+        } else {
+            printf("Error: Invalid number of arguments\n");
+            printUsage(argv[0]);
+            free(options.regions);
+            return 1;
+        }
+    }
+    
+    // Regions and DUST masking only narrow searches and batches; refuse them
+    // elsewhere instead of ignoring them. Searches name an engine flag, modes a word.
+    if (positionalCount > 0) {
+        const char* mode = positional[0];
+        int searching = (positionalCount == 3 && mode[0] == '-') ||
+                        (positionalCount == 4 && strcmp(mode, "batch") == 0);
+        if (!searching && options.regionCount > 0) {
+            printf("Error: --region and --bed only apply to searches and batches\n");
+            free(options.regions);
+            return 1;
+        }
+        if (!searching && options.dustLevel > 0 && strcmp(mode, "dust") != 0) {
+            printf("Error: --dust and --dust-level only apply to searches, batches and dust\n");
+            free(options.regions);
+            return 1;
+        }
+    }
+    
+    RunStats stats;
+    memset(&stats, 0, sizeof(stats));
+    int status;
+    
+    if (positionalCount >= 3 && strcmp(positional[0], "serve") == 0) {
+        status = runServe(&options, positional[1], positional + 2, positionalCount - 2, &stats);
+    } else if (positionalCount >= 3 && strcmp(positional[0], "query") == 0) {
+        status = runQuery(positional[1], positional[2], positional + 3, positionalCount - 3);
+    } else if (positionalCount == 4 && strcmp(positional[0], "kmers") == 0) {
+        status = runKmers(&options, positional[1], positional[2], positional[3], &stats);
+    } else if (positionalCount == 4 && strcmp(positional[0], "multi") == 0) {
+        status = runMulti(&options, positional[1], positional[2], positional[3], &stats);
+    } else if (positionalCount == 4 && strcmp(positional[0], "minimizer") == 0) {
+        status = runMinimizer(&options, positional[1], positional[2], positional[3], &stats);
+    } else if (positionalCount == 4 && strcmp(positional[0], "batch") == 0) {
+        status = runBatch(&options, positional[1], positional[2], positional[3], &stats);
+    } else if (positionalCount == 3 && strcmp(positional[0], "align") == 0) {
+        status = runAlign(&options, positional[1], positional[2], &stats);
+    } else if (positionalCount == 2 && strcmp(positional[0], "dust") == 0) {
+        status = runDust(&options, positional[1], &stats);
+    } else if (positionalCount == 2 && strcmp(positional[0], "gc") == 0) {
+        status = runGc(&options, positional[1], &stats);
+    } else if (positionalCount == 2 && strcmp(positional[0], "sites") == 0) {
+        status = runSites(&options, positional[1], &stats);
+    } else if (positionalCount == 2 && strcmp(positional[0], "repeats") == 0) {
+        status = runRepeats(&options, positional[1], &stats);
+    } else if (positionalCount == 3 && strcmp(positional[0], "mem") == 0) {
+        status = runMem(&options, positional[1], positional[2], &stats);
+    } else if (positionalCount == 3 && strcmp(positional[0], "sam") == 0) {
+        status = runSam(positional[1], positional[2], &stats);
+    } else if (positionalCount == 3 && strcmp(positional[0], "qgram") == 0) {
+        status = runQgram(&options, positional[1], positional[2], &stats);
+    } else if (positionalCount == 3 && strcmp(positional[0], "approx") == 0) {
+        status = runApprox(&options, positional[1], positional[2], &stats);
+    } else if (positionalCount == 3) {
+        status = runSearch(&options, positional[0], positional[1], positional[2], &stats);
+    } else {
+        // Check command line arguments
+        printf("Error: Invalid number of arguments\n");
+        printUsage(argv[0]);
+        free(options.regions);
+        return 1;
+    }
+    
+    if (status == 0 && options.showStats) {
+        printStats(&stats, options.statsJson);
+    }
+    
+    free(options.regions);
+    return status;
+}
@@ -0,0 +1,403 @@
+/**
+ * @file qgramIndex.c
+ * @brief Direct-addressed q-gram inverted index of a sequence (part of libdnamatch)
+ * @author George Fotiou
+ * @date 01/10/2025
+ *
+ * Every q-gram of the text (q at most 12) is 2-bit encoded and used directly
+ * as an index into an array of 4^q + 1 offsets, which delimit its positions,
+ * in increasing order, inside one array of all positions. A query then only
+ * touches the positions of its own q-grams:
+ *
+ * - An exact query intersects the lists of its two rarest q-grams, aligned
+ *   on their offsets in the pattern, and confirms what is left with
+ *   verifyMatch().
+ * - A query with up to k mismatches uses the q-gram lemma: an occurrence
+ *   with k mismatches still shares at least (m - q + 1) - k * q of its
+ *   q-grams with the pattern at the same offsets, since each mismatch spoils
+ *   at most q of them. Start positions reaching that many shared q-grams are
+ *   then checked base by base.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dnamatch.h"
+#include "dnamatchInternal.h"
+
+/** Compiled q-gram index, immutable after dnaQgramIndexBuild() */
+struct DnaQgramIndex {
+    int q;            /**< Q-gram length */
+    int textLen;      /**< Length of the indexed text */
+    int entryCount;   /**< Number of indexed positions */
+    int* offsets;     /**< 4^q + 1 starts of each q-gram's positions */
+    int* positions;   /**< Start of every q-gram of the text, grouped by q-gram, ascending */
+};
+
+/**
+ * @brief Encodes the q-gram at a position
+ * @param text Sequence
+ * @param position Start of the q-gram
+ * @param q Q-gram length
+ * @return 2-bit code, first base most significant, or -1 if it holds a non-ACGT base
+ */
+static inline long encodeQgram(const char* text, int position, int q) {
+    long code = 0;
+    int i;
+    for (i = 0; i < q; i++) {
+        int base = encodeBase(text[position + i]);
+        if (base < 0) {
+            return -1;
+        }
+        code = (code << 2) | base;
+    }
+    return code;
+}
+
+/**
+ * @brief Counts or places every q-gram of a sequence, rolling the code
+ * @param text Sequence
+ * @param textLen Length of the sequence
+ * @param q Q-gram length
+ * @param positions NULL to count into offsets[code + 1], else the array to fill
+ * @param offsets Counts when counting, else the next free slot of every q-gram
+ */
+static void scanQgrams(const char* text, int textLen, int q, int* positions, int* offsets) {
+    long mask = (1L << (2 * q)) - 1;
+    long code = 0;
+    int valid = 0;
+    int i;
+
+    for (i = 0; i < textLen; i++) {
+        int base = encodeBase(text[i]);
+        if (base < 0) {
+            valid = 0;
+            continue;
+        }
+        code = ((code << 2) | base) & mask;
+        if (++valid >= q) {
+            if (positions == NULL) {
+                offsets[code + 1]++;
+            } else {
+                positions[offsets[code]++] = i - q + 1;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Builds the q-gram index of a sequence
+ * @param text Sequence to index; not kept, pass it again to dnaQgramSearch()
+ * @param textLen Length of the sequence
+ * @param q Q-gram length, 1 to 12
+ * @return New index to release with dnaQgramIndexFree(), or NULL on error
+ */
+DnaQgramIndex* dnaQgramIndexBuild(const char* text, int textLen, int q) {
+    long codes = 1L << (2 * q);
+    long c;
+
+    if (q < 1 || q > 12) {
+        return NULL;
+    }
+
+    DnaQgramIndex* index = (DnaQgramIndex*)trackedCalloc(1, sizeof(DnaQgramIndex));
+    if (index == NULL) {
+        return NULL;
+    }
+    index->q = q;
+    index->textLen = textLen;
+    index->offsets = (int*)trackedCalloc(codes + 1, sizeof(int));
+    if (index->offsets == NULL) {
+        dnaQgramIndexFree(index);
+        return NULL;
+    }
+
+    // Count every q-gram, turn the counts into starts, then place the positions
+    scanQgrams(text, textLen, q, NULL, index->offsets);
+    for (c = 0; c < codes; c++) {
+        index->offsets[c + 1] += index->offsets[c];
+    }
+    index->entryCount = index->offsets[codes];
+    index->positions = (int*)trackedMalloc((index->entryCount > 0 ? index->entryCount : 1) * sizeof(int));
+    int* next = (int*)trackedMalloc(codes * sizeof(int));
+    if (index->positions == NULL || next == NULL) {
+        free(next);
+        dnaQgramIndexFree(index);
+        return NULL;
+    }
+    memcpy(next, index->offsets, codes * sizeof(int));
+    scanQgrams(text, textLen, q, index->positions, next);
+    free(next);
+    return index;
+}
+
+/**
+ * @brief Releases a q-gram index
+ * @param index Index returned by dnaQgramIndexBuild(), or NULL
+ */
+void dnaQgramIndexFree(DnaQgramIndex* index) {
+    if (index == NULL) {
+        return;
+    }
+    free(index->offsets);
+    free(index->positions);
+    free(index);
+}
+
+/**
+ * @brief Reports the memory held by an index
+ * @param index Q-gram index
+ * @return Bytes of offsets and positions
+ */
+size_t dnaQgramIndexBytes(const DnaQgramIndex* index) {
+    return sizeof(DnaQgramIndex) + ((1L << (2 * index->q)) + 1) * sizeof(int) +
+           (size_t)index->entryCount * sizeof(int);
+}
+
+/**
+ * @brief Reports the number of positions held by an index
+ * @param index Q-gram index
+ * @return Number of indexed q-gram positions
+ */
+int dnaQgramIndexSize(const DnaQgramIndex* index) {
+    return index->entryCount;
+}
+
+/**
+ * @brief Checks a window against the pattern, allowing some mismatches
+ * @param text Text
+ * @param pattern Pattern
+ * @param pos Start of the window in the text
+ * @param patternLen Length of the pattern
+ * @param maxMismatches Mismatches allowed
+ * @return 1 if the window has at most maxMismatches mismatches, 0 otherwise
+ */
+static int verifyMismatches(const char* text, const char* pattern, int pos, int patternLen, int maxMismatches) {
+    int i;
+    for (i = 0; i < patternLen; i++) {
+        if (text[pos + i] != pattern[i] && --maxMismatches < 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/** Positions found by a query, in increasing order */
+typedef struct {
+    int matches;     /**< Number of matches so far */
+    int maxHits;     /**< Stop after this many, 0 for no limit */
+    int* positions;  /**< Receives the first maxHits positions */
+} QgramHits;
+
+/**
+ * @brief Records one verified match
+ * @param hits Matches so far
+ * @param position Start of the match
+ * @return Non-zero once maxHits matches are recorded
+ */
+static int addQgramHit(QgramHits* hits, int position) {
+    if (hits->maxHits > 0) {
+        hits->positions[hits->matches] = position;
+    }
+    return ++hits->matches == hits->maxHits;
+}
+
+/**
+ * @brief Verifies every window of the text, for queries the index cannot filter
+ * @param text Text
+ * @param textLen Length of the text
+ * @param pattern Pattern
+ * @param patternLen Length of the pattern
+ * @param maxMismatches Mismatches allowed
+ * @param hits Receives the matches
+ */
+static void scanWindows(const char* text, int textLen, const char* pattern, int patternLen,
+                        int maxMismatches, QgramHits* hits) {
+    int s;
+    for (s = 0; s + patternLen <= textLen; s++) {
+        if (verifyMismatches(text, pattern, s, patternLen, maxMismatches) && addQgramHit(hits, s)) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Orders ints increasingly
+ * @param a First int
+ * @param b Second int
+ * @return Negative, zero or positive as for qsort()
+ */
+static int compareStarts(const void* a, const void* b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Finds a pattern through the q-gram index
+ *
+ * Exact queries intersect the position lists of the pattern's two rarest
+ * q-grams; queries with mismatches count, for every candidate start, the
+ * pattern q-grams found at their offsets and keep the starts that reach the
+ * q-gram lemma threshold. If the pattern is shorter than q, or allows so many
+ * mismatches that the threshold drops to zero, every window is checked.
+ *
+ * @param index Index of text
+ * @param text The indexed text
+ * @param textLen Its length
+ * @param pattern Pattern
+ * @param patternLen Length of the pattern, at least 1
+ * @param maxMismatches Mismatches allowed per occurrence, 0 for exact matching
+ * @param maxHits Stop after this many hits, 0 for no limit
+ * @param positions Receives the first min(maxHits, matches) positions in text order; may be NULL if maxHits is 0
+ * @return Number of matches (at most maxHits if non-zero), or -1 on error
+ */
+int dnaQgramSearch(const DnaQgramIndex* index, const char* text, int textLen, const char* pattern,
+                   int patternLen, int maxMismatches, int maxHits, int* positions) {
+    int q = index->q;
+    int last = textLen - patternLen;
+    QgramHits hits;
+    int o;
+
+    hits.matches = 0;
+    hits.maxHits = maxHits;
+    hits.positions = positions;
+    if (patternLen <= 0 || last < 0) {
+        return 0;
+    }
+
+    // Valid q-grams of the pattern, and the two rarest in the text
+    int validCount = 0;
+    int rarest = -1;
+    int rarestCount = 0;
+    int second = -1;
+    int secondCount = 0;
+    long total = 0;
+    for (o = 0; o + q <= patternLen; o++) {
+        long code = encodeQgram(pattern, o, q);
+        if (code < 0) {
+            continue;
+        }
+        int count = index->offsets[code + 1] - index->offsets[code];
+        validCount++;
+        total += count;
+        if (rarest < 0 || count < rarestCount) {
+            second = rarest;
+            secondCount = rarestCount;
+            rarest = o;
+            rarestCount = count;
+        } else if (second < 0 || count < secondCount) {
+            second = o;
+            secondCount = count;
+        }
+    }
+
+    if (maxMismatches == 0 && rarest >= 0) {
+        long a = encodeQgram(pattern, rarest, q);
+        const int* listA = index->positions + index->offsets[a];
+        int countA = index->offsets[a + 1] - index->offsets[a];
+        const int* listB = listA;
+        int countB = countA;
+        int offsetB = rarest;
+        if (second >= 0) {
+            long b = encodeQgram(pattern, second, q);
+            listB = index->positions + index->offsets[b];
+            countB = index->offsets[b + 1] - index->offsets[b];
+            offsetB = second;
+        }
+
+        // Merge the two lists as candidate starts; both are increasing
+        int i = 0;
+        int j = 0;
+        while (i < countA && j < countB) {
+            int startA = listA[i] - rarest;
+            int startB = listB[j] - offsetB;
+            if (startA < startB) {
+                i++;
+            } else if (startB < startA) {
+                j++;
+            } else {
+                if (startA >= 0 && startA <= last && verifyMatch(text, pattern, startA, patternLen) &&
+                    addQgramHit(&hits, startA)) {
+                    break;
+                }
+                i++;
+                j++;
+            }
+        }
+        return hits.matches;
+    }
+
+    // q-gram lemma; pattern q-grams holding a non-ACGT base can never be shared
+    long threshold = validCount - (long)maxMismatches * q;
+    if (threshold <= 0) {
+        scanWindows(text, textLen, pattern, patternLen, maxMismatches, &hits);
+        return hits.matches;
+    }
+
+    // Dense candidates are counted per start, sparse ones sorted into runs
+    if (total > last) {
+        int* shared = (int*)trackedCalloc(last + 1, sizeof(int));
+        if (shared == NULL) {
+            return -1;
+        }
+        for (o = 0; o + q <= patternLen; o++) {
+            long code = encodeQgram(pattern, o, q);
+            int p;
+            if (code < 0) {
+                continue;
+            }
+            for (p = index->offsets[code]; p < index->offsets[code + 1]; p++) {
+                int start = index->positions[p] - o;
+                if (start >= 0 && start <= last) {
+                    shared[start]++;
+                }
+            }
+        }
+        for (o = 0; o <= last; o++) {
+            if (shared[o] >= threshold && verifyMismatches(text, pattern, o, patternLen, maxMismatches) &&
+                addQgramHit(&hits, o)) {
+                break;
+            }
+        }
+        free(shared);
+        return hits.matches;
+    }
+
+    int* starts = (int*)trackedMalloc((total > 0 ? total : 1) * sizeof(int));
+    if (starts == NULL) {
+        return -1;
+    }
+    int used = 0;
+    for (o = 0; o + q <= patternLen; o++) {
+        long code = encodeQgram(pattern, o, q);
+        int p;
+        if (code < 0) {
+            continue;
+        }
+        for (p = index->offsets[code]; p < index->offsets[code + 1]; p++) {
+            int start = index->positions[p] - o;
+            if (start >= 0 && start <= last) {
+                starts[used++] = start;
+            }
+        }
+    }
+
+    // Runs of equal starts count the q-grams each candidate shares with the pattern
+    qsort(starts, used, sizeof(int), compareStarts);
+    int i = 0;
+    while (i < used) {
+        int run = i;
+        while (run < used && starts[run] == starts[i]) {
+            run++;
+        }
+        if (run - i >= threshold && verifyMismatches(text, pattern, starts[i], patternLen, maxMismatches) &&
+            addQgramHit(&hits, starts[i])) {
+            break;
+        }
+        i = run;
+    }
+
+    free(starts);
+    return hits.matches;
+}
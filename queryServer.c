@@ -0,0 +1,929 @@
+/**
+ * @file queryServer.c
+ * @brief Resident query daemon over a Unix domain socket, and its client
+ * @author George Fotiou
+ * @date 01/10/2025
+ *
+ * One event-loop thread owns every connection: it accepts clients, reads
+ * request frames and writes responses. All complete frames that have arrived
+ * on a connection are handed to the worker pool as one batch job, and a
+ * connection has at most one job in flight so its responses stay in request
+ * order. Workers return finished jobs through a completion queue and wake the
+ * event loop with an eventfd.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include "dnamatch.h"
+#include "dnamatchInternal.h"
+#include "queryServer.h"
+
+/** Latency histogram buckets; bucket b counts latencies below 2^b microseconds */
+#define LATENCY_BUCKETS 32
+
+/** Largest pattern accepted in a request */
+#define MAX_PATTERN_LEN 512000
+
+/** Events fetched per epoll_wait() call */
+#define MAX_EVENTS 64
+
+/** One client connection, touched only by the event-loop thread */
+typedef struct Connection {
+    int fd;             /**< Client socket, -1 once closed */
+    char* in;           /**< Received bytes not yet handed to a job */
+    size_t inLen;       /**< Bytes used in in */
+    size_t inCap;       /**< Capacity of in */
+    char* out;          /**< Response bytes waiting to be written */
+    size_t outLen;      /**< Bytes used in out */
+    size_t outSent;     /**< Bytes of out already written */
+    size_t outCap;      /**< Capacity of out */
+    int busy;           /**< A job for this connection is in flight */
+    struct Connection* prevOpen;    /**< Previous open connection */
+    struct Connection* nextOpen;    /**< Next open connection */
+    struct Connection* nextClosed;  /**< Next connection awaiting release */
+} Connection;
+
+/** A batch of consecutive requests from one connection */
+typedef struct Job {
+    Connection* conn;   /**< Connection the requests came from */
+    char* requests;     /**< Copy of the complete request frames */
+    size_t requestsLen; /**< Length of requests */
+    double enqueued;    /**< Monotonic time the batch was queued */
+    char* response;     /**< Concatenated response frames */
+    size_t responseLen; /**< Length of response */
+    struct Job* next;   /**< Next job in the queue */
+} Job;
+
+/** A queue of jobs protected by a mutex */
+typedef struct {
+    Job* head;              /**< Oldest job */
+    Job* tail;              /**< Newest job */
+    pthread_mutex_t lock;   /**< Protects head and tail */
+    pthread_cond_t ready;   /**< Signalled when a job is pushed */
+} JobQueue;
+
+/** State of a running server */
+typedef struct {
+    char** references;            /**< Loaded reference sequences */
+    const int* referenceLens;     /**< Their lengths */
+    int referenceCount;           /**< Number of references */
+    DnaPackedText** packed;       /**< References packed once for -pc count requests */
+    JobQueue pending;             /**< Jobs waiting for a worker */
+    JobQueue done;                /**< Jobs waiting for the event loop */
+    int wakeFd;                   /**< eventfd signalled when a job is done */
+    atomic_int stopping;          /**< Set when the workers should exit */
+    atomic_ulong requests;        /**< Requests served */
+    atomic_ulong batches;         /**< Jobs served */
+    atomic_ulong errors;          /**< Requests answered with an error */
+    atomic_ulong latency[LATENCY_BUCKETS];  /**< Request latency histogram */
+    Connection* open;             /**< Open connections, closed at shutdown */
+    Connection* closed;           /**< Closed idle connections, freed after each loop pass */
+} Server;
+
+/**
+ * @brief Reads the monotonic clock
+ * @return Seconds since an arbitrary point
+ */
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Makes room for more bytes in a growable buffer
+ * @param buffer Buffer to grow, updated on success
+ * @param capacity Capacity of the buffer, updated on success
+ * @param needed Number of bytes the buffer must hold
+ * @return 0 on success, -1 if memory ran out
+ */
+static int reserve(char** buffer, size_t* capacity, size_t needed) {
+    if (needed <= *capacity) {
+        return 0;
+    }
+
+    size_t newCap = *capacity > 0 ? *capacity : 4096;
+    while (newCap < needed) {
+        newCap *= 2;
+    }
+
+    char* bigger = (char*)trackedRealloc(*buffer, *capacity, newCap);
+    if (bigger == NULL) {
+        return -1;
+    }
+    *buffer = bigger;
+    *capacity = newCap;
+    return 0;
+}
+
+/**
+ * @brief Appends a job to the tail of a queue and wakes one waiter
+ * @param queue Queue to push to
+ * @param job Job to push
+ */
+static void pushJob(JobQueue* queue, Job* job) {
+    job->next = NULL;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail != NULL) {
+        queue->tail->next = job;
+    } else {
+        queue->head = job;
+    }
+    queue->tail = job;
+    pthread_cond_signal(&queue->ready);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * @brief Removes every job from a queue without waiting
+ * @param queue Queue to drain
+ * @return The jobs in queue order, or NULL if it was empty
+ */
+static Job* takeAllJobs(JobQueue* queue) {
+    pthread_mutex_lock(&queue->lock);
+    Job* jobs = queue->head;
+    queue->head = NULL;
+    queue->tail = NULL;
+    pthread_mutex_unlock(&queue->lock);
+    return jobs;
+}
+
+/** State passed to the locate callback */
+typedef struct {
+    char** response;      /**< Response buffer positions are appended to */
+    size_t* responseLen;  /**< Used length of the response buffer */
+    size_t* responseCap;  /**< Capacity of the response buffer */
+    uint32_t limit;       /**< Maximum positions to record, 0 for all */
+    uint32_t recorded;    /**< Positions recorded so far */
+    int failed;           /**< Set if the buffer could not grow */
+} LocateState;
+
+/**
+ * @brief Hit callback that appends positions to a locate response
+ * @param position Offset of the match
+ * @param userData The LocateState
+ * @return 0 to continue searching
+ */
+static int recordPosition(int position, void* userData) {
+    LocateState* state = (LocateState*)userData;
+    uint32_t value = (uint32_t)position;
+
+    if (state->failed || (state->limit != 0 && state->recorded == state->limit)) {
+        return 0;
+    }
+    if (reserve(state->response, state->responseCap, *state->responseLen + sizeof(value)) != 0) {
+        state->failed = 1;
+        return 0;
+    }
+    memcpy(*state->response + *state->responseLen, &value, sizeof(value));
+    *state->responseLen += sizeof(value);
+    state->recorded++;
+    return 0;
+}
+
+/**
+ * @brief Formats the statistics report returned by QUERY_OP_STATS
+ * @param server Running server
+ * @param report Buffer for the report
+ * @param size Size of the buffer
+ * @return Length of the report
+ */
+static int formatStats(Server* server, char* report, int size) {
+    unsigned long counts[LATENCY_BUCKETS];
+    unsigned long total = 0;
+    int used;
+    int b;
+
+    for (b = 0; b < LATENCY_BUCKETS; b++) {
+        counts[b] = atomic_load(&server->latency[b]);
+        total += counts[b];
+    }
+
+    used = snprintf(report, size, "requests %lu\nbatches %lu\nerrors %lu\n",
+                    atomic_load(&server->requests), atomic_load(&server->batches),
+                    atomic_load(&server->errors));
+
+    // Percentiles are reported as the upper bound of their bucket
+    const double quantiles[3] = {0.5, 0.9, 0.99};
+    const char* names[3] = {"p50", "p90", "p99"};
+    int q;
+    for (q = 0; q < 3 && total > 0; q++) {
+        unsigned long seen = 0;
+        for (b = 0; b < LATENCY_BUCKETS; b++) {
+            seen += counts[b];
+            if (seen >= quantiles[q] * total) {
+                break;
+            }
+        }
+        used += snprintf(report + used, size - used, "latency_%s_us < %lu\n", names[q], 1ul << b);
+    }
+
+    for (b = 0; b < LATENCY_BUCKETS; b++) {
+        if (counts[b] > 0) {
+            used += snprintf(report + used, size - used, "latency_us < %lu: %lu\n",
+                             1ul << b, counts[b]);
+        }
+    }
+
+    return used;
+}
+
+/**
+ * @brief Serves one request and appends its response frame
+ * @param server Running server
+ * @param header Request header
+ * @param pattern Request pattern (header->patternLen bytes)
+ * @param response Response buffer, grown as needed
+ * @param responseLen Used length of the response buffer
+ * @param responseCap Capacity of the response buffer
+ * @return 0 on success, -1 if memory ran out
+ */
+static int serveRequest(Server* server, const QueryRequestHeader* header, const char* pattern,
+                        char** response, size_t* responseLen, size_t* responseCap) {
+    QueryResponseHeader reply;
+    size_t headerAt = *responseLen;
+
+    memset(&reply, 0, sizeof(reply));
+    if (reserve(response, responseCap, headerAt + sizeof(reply)) != 0) {
+        return -1;
+    }
+    *responseLen += sizeof(reply);
+
+    if (header->op == QUERY_OP_STATS) {
+        char report[4096];
+        int reportLen = formatStats(server, report, sizeof(report));
+        if (reserve(response, responseCap, *responseLen + reportLen) != 0) {
+            return -1;
+        }
+        memcpy(*response + *responseLen, report, reportLen);
+        *responseLen += reportLen;
+        reply.payloadLen = reportLen;
+    } else if (header->op != QUERY_OP_COUNT && header->op != QUERY_OP_LOCATE) {
+        reply.status = QUERY_BAD_REQUEST;
+    } else if (header->reference >= (uint32_t)server->referenceCount) {
+        reply.status = QUERY_NO_REFERENCE;
+    } else if (header->patternLen == 0 || header->algorithm >= DNA_ALGORITHM_COUNT) {
+        reply.status = QUERY_BAD_REQUEST;
+    } else {
+        const char* text = server->references[header->reference];
+        int textLen = server->referenceLens[header->reference];
+        DnaMatcher* matcher = dnaMatcherCreate((DnaAlgorithm)header->algorithm,
+                                               pattern, (int)header->patternLen);
+        int matches = 0;
+        if (matcher == NULL) {
+            reply.status = QUERY_NO_MEMORY;
+        } else if (header->op == QUERY_OP_COUNT && header->algorithm == DNA_ALG_POPCOUNT) {
+            // Counted straight from the bit-planes packed at startup
+            matches = dnaMatcherCountPacked(matcher, server->packed[header->reference]);
+        } else if (header->op == QUERY_OP_COUNT) {
+            matches = dnaMatcherCount(matcher, text, textLen);
+        } else {
+            LocateState state;
+            state.response = response;
+            state.responseLen = responseLen;
+            state.responseCap = responseCap;
+            state.limit = header->limit;
+            state.recorded = 0;
+            state.failed = 0;
+            matches = dnaMatcherSearch(matcher, text, textLen, recordPosition, &state);
+            reply.positionCount = state.recorded;
+            reply.payloadLen = state.recorded * sizeof(uint32_t);
+            if (state.failed) {
+                *responseLen = headerAt + sizeof(reply);
+                reply.positionCount = 0;
+                reply.payloadLen = 0;
+                reply.status = QUERY_NO_MEMORY;
+            }
+        }
+        if (matches < 0) {
+            reply.status = QUERY_NO_MEMORY;
+        } else {
+            reply.matches = matches;
+        }
+        dnaMatcherFree(matcher);
+    }
+
+    if (reply.status != QUERY_OK) {
+        atomic_fetch_add(&server->errors, 1);
+    }
+    memcpy(*response + headerAt, &reply, sizeof(reply));
+    return 0;
+}
+
+/**
+ * @brief Worker thread: serves batch jobs until the server stops
+ * @param arg The Server
+ * @return NULL
+ */
+static void* serverWorker(void* arg) {
+    Server* server = (Server*)arg;
+
+    while (1) {
+        pthread_mutex_lock(&server->pending.lock);
+        while (server->pending.head == NULL && !atomic_load(&server->stopping)) {
+            pthread_cond_wait(&server->pending.ready, &server->pending.lock);
+        }
+        Job* job = server->pending.head;
+        if (job == NULL) {
+            pthread_mutex_unlock(&server->pending.lock);
+            break;
+        }
+        server->pending.head = job->next;
+        if (server->pending.head == NULL) {
+            server->pending.tail = NULL;
+        }
+        pthread_mutex_unlock(&server->pending.lock);
+
+        size_t responseCap = 0;
+        size_t offset = 0;
+        job->response = NULL;
+        job->responseLen = 0;
+
+        // The event loop only queues complete frames
+        while (offset < job->requestsLen) {
+            QueryRequestHeader header;
+            memcpy(&header, job->requests + offset, sizeof(header));
+            const char* pattern = job->requests + offset + sizeof(header);
+            offset += sizeof(header) + header.patternLen;
+
+            if (serveRequest(server, &header, pattern, &job->response,
+                             &job->responseLen, &responseCap) != 0) {
+                // Drop the rest of the batch; the connection will be closed
+                free(job->response);
+                job->response = NULL;
+                job->responseLen = 0;
+                break;
+            }
+
+            double micros = (nowSeconds() - job->enqueued) * 1e6;
+            int bucket = 0;
+            while (bucket < LATENCY_BUCKETS - 1 && micros >= (double)(1ul << bucket)) {
+                bucket++;
+            }
+            atomic_fetch_add(&server->latency[bucket], 1);
+            atomic_fetch_add(&server->requests, 1);
+        }
+        atomic_fetch_add(&server->batches, 1);
+
+        pushJob(&server->done, job);
+        uint64_t one = 1;
+        if (write(server->wakeFd, &one, sizeof(one)) < 0) {
+            // The counter can only overflow after 2^64 wakeups; nothing to do
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Closes a connection's socket; the struct is released once it is idle
+ * @param server Running server
+ * @param epollFd Event loop descriptor
+ * @param conn Connection to close
+ */
+static void closeConnection(Server* server, int epollFd, Connection* conn) {
+    if (conn->fd >= 0) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->fd, NULL);
+        close(conn->fd);
+        conn->fd = -1;
+        if (conn->prevOpen != NULL) {
+            conn->prevOpen->nextOpen = conn->nextOpen;
+        } else {
+            server->open = conn->nextOpen;
+        }
+        if (conn->nextOpen != NULL) {
+            conn->nextOpen->prevOpen = conn->prevOpen;
+        }
+    }
+    // Events already fetched may still point at conn, so release it later
+    if (!conn->busy) {
+        conn->nextClosed = server->closed;
+        server->closed = conn;
+    }
+}
+
+/**
+ * @brief Frees the connections closed during the last event loop pass
+ * @param server Running server
+ */
+static void releaseClosed(Server* server) {
+    while (server->closed != NULL) {
+        Connection* conn = server->closed;
+        server->closed = conn->nextClosed;
+        free(conn->in);
+        free(conn->out);
+        free(conn);
+    }
+}
+
+/**
+ * @brief Writes as much pending output as the socket accepts
+ * @param server Running server
+ * @param epollFd Event loop descriptor
+ * @param conn Connection to flush
+ * @return 0 if the connection is still usable, -1 if it was closed
+ */
+static int flushConnection(Server* server, int epollFd, Connection* conn) {
+    while (conn->outSent < conn->outLen) {
+        ssize_t n = write(conn->fd, conn->out + conn->outSent, conn->outLen - conn->outSent);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n <= 0) {
+            closeConnection(server, epollFd, conn);
+            return -1;
+        }
+        conn->outSent += n;
+    }
+
+    if (conn->outSent == conn->outLen) {
+        conn->outSent = 0;
+        conn->outLen = 0;
+    }
+
+    // Only ask for writability while output is pending
+    struct epoll_event event;
+    event.events = EPOLLIN | (conn->outLen > 0 ? EPOLLOUT : 0);
+    event.data.ptr = conn;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, conn->fd, &event);
+    return 0;
+}
+
+/**
+ * @brief Queues every complete request frame of an idle connection as one job
+ * @param server Running server
+ * @param epollFd Event loop descriptor
+ * @param conn Connection to dispatch from
+ * @return 0 if the connection is still usable, -1 if it was closed
+ */
+static int dispatchRequests(Server* server, int epollFd, Connection* conn) {
+    size_t offset = 0;
+
+    if (conn->busy) {
+        return 0;
+    }
+
+    while (conn->inLen - offset >= sizeof(QueryRequestHeader)) {
+        QueryRequestHeader header;
+        memcpy(&header, conn->in + offset, sizeof(header));
+        if (header.magic != QUERY_MAGIC || header.patternLen > MAX_PATTERN_LEN) {
+            // The stream cannot be resynchronized
+            closeConnection(server, epollFd, conn);
+            return -1;
+        }
+        if (conn->inLen - offset < sizeof(header) + header.patternLen) {
+            break;
+        }
+        offset += sizeof(header) + header.patternLen;
+    }
+
+    if (offset == 0) {
+        return 0;
+    }
+
+    Job* job = (Job*)trackedMalloc(sizeof(Job));
+    char* requests = (char*)trackedMalloc(offset);
+    if (job == NULL || requests == NULL) {
+        free(job);
+        free(requests);
+        closeConnection(server, epollFd, conn);
+        return -1;
+    }
+
+    memcpy(requests, conn->in, offset);
+    memmove(conn->in, conn->in + offset, conn->inLen - offset);
+    conn->inLen -= offset;
+
+    job->conn = conn;
+    job->requests = requests;
+    job->requestsLen = offset;
+    job->enqueued = nowSeconds();
+    conn->busy = 1;
+    pushJob(&server->pending, job);
+    return 0;
+}
+
+/**
+ * @brief Reads everything available on a connection and dispatches it
+ * @param server Running server
+ * @param epollFd Event loop descriptor
+ * @param conn Readable connection
+ */
+static void readConnection(Server* server, int epollFd, Connection* conn) {
+    while (1) {
+        if (reserve(&conn->in, &conn->inCap, conn->inLen + 65536) != 0) {
+            closeConnection(server, epollFd, conn);
+            return;
+        }
+        ssize_t n = read(conn->fd, conn->in + conn->inLen, conn->inCap - conn->inLen);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n <= 0) {
+            closeConnection(server, epollFd, conn);
+            return;
+        }
+        conn->inLen += n;
+    }
+
+    dispatchRequests(server, epollFd, conn);
+}
+
+/**
+ * @brief Moves finished jobs back to their connections
+ * @param server Running server
+ * @param epollFd Event loop descriptor
+ */
+static void completeJobs(Server* server, int epollFd) {
+    uint64_t wakeups;
+    if (read(server->wakeFd, &wakeups, sizeof(wakeups)) < 0) {
+        // Spurious wakeup; the queue is checked regardless
+    }
+
+    Job* job = takeAllJobs(&server->done);
+    while (job != NULL) {
+        Job* next = job->next;
+        Connection* conn = job->conn;
+        conn->busy = 0;
+
+        if (conn->fd < 0) {
+            // Client went away while the job ran
+            closeConnection(server, epollFd, conn);
+        } else if (job->response == NULL && job->requestsLen > 0) {
+            closeConnection(server, epollFd, conn);
+        } else if (reserve(&conn->out, &conn->outCap, conn->outLen + job->responseLen) != 0) {
+            closeConnection(server, epollFd, conn);
+        } else {
+            memcpy(conn->out + conn->outLen, job->response, job->responseLen);
+            conn->outLen += job->responseLen;
+            if (flushConnection(server, epollFd, conn) == 0) {
+                dispatchRequests(server, epollFd, conn);
+            }
+        }
+
+        free(job->requests);
+        free(job->response);
+        free(job);
+        job = next;
+    }
+}
+
+/**
+ * @brief Creates the listening socket
+ * @param socketPath Filesystem path of the socket; a stale socket is replaced
+ * @return Listening descriptor, or -1 on error
+ */
+static int listenOn(const char* socketPath) {
+    struct sockaddr_un address;
+
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        printf("Error: Socket path too long\n");
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        printf("Error: Cannot create socket\n");
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath);
+    unlink(socketPath);
+
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 128) != 0) {
+        printf("Error: Cannot listen on %s\n", socketPath);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * @brief Releases the packed references of a server
+ * @param server Server whose packed references are freed
+ */
+static void freePackedReferences(Server* server) {
+    int i;
+    for (i = 0; server->packed != NULL && i < server->referenceCount; i++) {
+        dnaPackedTextFree(server->packed[i]);
+    }
+    free(server->packed);
+    server->packed = NULL;
+}
+
+/**
+ * @brief Serves count/locate requests until SIGINT or SIGTERM
+ * @param socketPath Filesystem path of the socket to listen on
+ * @param references Loaded reference sequences, indexed by request
+ * @param referenceLens Lengths of the references
+ * @param referenceCount Number of references
+ * @param threadCount Number of worker threads
+ * @return 0 on clean shutdown, 1 on error
+ */
+int runServer(const char* socketPath, char** references, const int* referenceLens,
+              int referenceCount, int threadCount) {
+    Server server;
+    sigset_t signals;
+    int i;
+
+    memset(&server, 0, sizeof(server));
+    server.references = references;
+    server.referenceLens = referenceLens;
+    server.referenceCount = referenceCount;
+    pthread_mutex_init(&server.pending.lock, NULL);
+    pthread_cond_init(&server.pending.ready, NULL);
+    pthread_mutex_init(&server.done.lock, NULL);
+    pthread_cond_init(&server.done.ready, NULL);
+    atomic_init(&server.stopping, 0);
+
+    // Pack every reference once, so -pc counts never repack the text
+    server.packed = (DnaPackedText**)trackedCalloc(referenceCount, sizeof(DnaPackedText*));
+    for (i = 0; server.packed != NULL && i < referenceCount; i++) {
+        server.packed[i] = dnaPackText(references[i], referenceLens[i]);
+        if (server.packed[i] == NULL) {
+            freePackedReferences(&server);
+        }
+    }
+    if (server.packed == NULL) {
+        printf("Error: Memory allocation failed\n");
+        return 1;
+    }
+
+    // Block the shutdown signals before any thread starts so only signalfd sees them
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    int listenFd = listenOn(socketPath);
+    if (listenFd < 0) {
+        freePackedReferences(&server);
+        return 1;
+    }
+
+    int signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    server.wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    pthread_t* workers = (pthread_t*)trackedMalloc(threadCount * sizeof(pthread_t));
+
+    if (signalFd < 0 || epollFd < 0 || server.wakeFd < 0 || workers == NULL) {
+        printf("Error: Cannot start the event loop\n");
+        close(listenFd);
+        unlink(socketPath);
+        freePackedReferences(&server);
+        return 1;
+    }
+
+    // Tag the fixed descriptors by address so they are told apart from connections
+    static char listenTag, signalTag, wakeTag;
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = &listenTag;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+    event.data.ptr = &signalTag;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, signalFd, &event);
+    event.data.ptr = &wakeTag;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, server.wakeFd, &event);
+
+    int started = 0;
+    for (i = 0; i < threadCount; i++) {
+        if (pthread_create(&workers[started], NULL, serverWorker, &server) == 0) {
+            started++;
+        }
+    }
+
+    printf("Serving %d reference(s) on %s with %d worker(s)\n", referenceCount, socketPath, started);
+    fflush(stdout);
+
+    int running = started > 0;
+    while (running) {
+        struct epoll_event events[MAX_EVENTS];
+        int ready = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready < 0) {
+            break;
+        }
+
+        for (i = 0; i < ready; i++) {
+            void* tag = events[i].data.ptr;
+
+            if (tag == &signalTag) {
+                running = 0;
+            } else if (tag == &wakeTag) {
+                completeJobs(&server, epollFd);
+            } else if (tag == &listenTag) {
+                int clientFd;
+                while ((clientFd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    Connection* conn = (Connection*)calloc(1, sizeof(Connection));
+                    if (conn == NULL) {
+                        close(clientFd);
+                        continue;
+                    }
+                    conn->fd = clientFd;
+                    conn->nextOpen = server.open;
+                    if (server.open != NULL) {
+                        server.open->prevOpen = conn;
+                    }
+                    server.open = conn;
+                    event.events = EPOLLIN;
+                    event.data.ptr = conn;
+                    epoll_ctl(epollFd, EPOLL_CTL_ADD, clientFd, &event);
+                }
+            } else {
+                Connection* conn = (Connection*)tag;
+                if (conn->fd < 0) {
+                    continue;
+                }
+                if ((events[i].events & EPOLLOUT) && flushConnection(&server, epollFd, conn) != 0) {
+                    continue;
+                }
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    readConnection(&server, epollFd, conn);
+                }
+            }
+        }
+        releaseClosed(&server);
+    }
+
+    // Let the workers finish what is queued, then stop them
+    pthread_mutex_lock(&server.pending.lock);
+    atomic_store(&server.stopping, 1);
+    pthread_cond_broadcast(&server.pending.ready);
+    pthread_mutex_unlock(&server.pending.lock);
+    for (i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    // Finished jobs hold the last references to busy connections
+    Job* job = takeAllJobs(&server.done);
+    while (job != NULL) {
+        Job* next = job->next;
+        job->conn->busy = 0;
+        closeConnection(&server, epollFd, job->conn);
+        free(job->requests);
+        free(job->response);
+        free(job);
+        job = next;
+    }
+
+    // Clients still connected are idle now; close them too
+    while (server.open != NULL) {
+        closeConnection(&server, epollFd, server.open);
+    }
+    releaseClosed(&server);
+
+    free(workers);
+    freePackedReferences(&server);
+    close(epollFd);
+    close(signalFd);
+    close(server.wakeFd);
+    close(listenFd);
+    unlink(socketPath);
+    printf("Server stopped after %lu request(s)\n", atomic_load(&server.requests));
+    return 0;
+}
+
+/**
+ * @brief Reads exactly size bytes from a blocking descriptor
+ * @param fd Descriptor to read from
+ * @param buffer Destination
+ * @param size Number of bytes to read
+ * @return 0 on success, -1 on error or end of file
+ */
+static int readFully(int fd, void* buffer, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, (char*)buffer + done, size - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Sends one request to a running server and prints the response
+ * @param socketPath Filesystem path of the server socket
+ * @param op QUERY_OP_COUNT, QUERY_OP_LOCATE or QUERY_OP_STATS
+ * @param reference Index of the reference to search
+ * @param algorithm DnaAlgorithm to search with
+ * @param pattern Normalized pattern, ignored for QUERY_OP_STATS
+ * @return 0 on success, 1 on error
+ */
+int runQueryClient(const char* socketPath, int op, int reference, int algorithm,
+                   const char* pattern) {
+    struct sockaddr_un address;
+    QueryRequestHeader header;
+    QueryResponseHeader reply;
+
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        printf("Error: Socket path too long\n");
+        return 1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        printf("Error: Cannot connect to %s\n", socketPath);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = QUERY_MAGIC;
+    header.op = (uint8_t)op;
+    header.algorithm = (uint8_t)algorithm;
+    header.reference = (uint32_t)reference;
+    header.patternLen = op == QUERY_OP_STATS ? 0 : (uint32_t)strlen(pattern);
+
+    size_t requestLen = sizeof(header) + header.patternLen;
+    char* request = (char*)trackedMalloc(requestLen);
+    if (request == NULL) {
+        printf("Error: Memory allocation failed\n");
+        close(fd);
+        return 1;
+    }
+    memcpy(request, &header, sizeof(header));
+    memcpy(request + sizeof(header), pattern, header.patternLen);
+
+    size_t sent = 0;
+    while (sent < requestLen) {
+        ssize_t n = write(fd, request + sent, requestLen - sent);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        sent += n;
+    }
+    free(request);
+
+    if (sent < requestLen || readFully(fd, &reply, sizeof(reply)) != 0) {
+        printf("Error: Lost connection to server\n");
+        close(fd);
+        return 1;
+    }
+
+    char* payload = (char*)trackedMalloc(reply.payloadLen + 1);
+    if (payload == NULL || readFully(fd, payload, reply.payloadLen) != 0) {
+        printf("Error: Lost connection to server\n");
+        free(payload);
+        close(fd);
+        return 1;
+    }
+    close(fd);
+
+    int status = 0;
+    if (reply.status != QUERY_OK) {
+        printf("Error: Server answered with status %u\n", reply.status);
+        status = 1;
+    } else if (op == QUERY_OP_STATS) {
+        payload[reply.payloadLen] = '\0';
+        printf("%s", payload);
+    } else {
+        uint32_t i;
+        for (i = 0; i < reply.positionCount; i++) {
+            uint32_t position;
+            memcpy(&position, payload + i * sizeof(position), sizeof(position));
+            printf("%u\n", position);
+        }
+        printf("The pattern was found: %u times\n", reply.matches);
+    }
+
+    free(payload);
+    return status;
+}
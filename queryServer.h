@@ -0,0 +1,61 @@
+/**
+ * @file queryServer.h
+ * @brief Resident query daemon over a Unix domain socket, and its client
+ * @author George Fotiou
+ * @date 01/10/2025
+ *
+ * The server keeps its references in memory and answers count/locate
+ * requests framed with the small binary protocol below. All integers are
+ * 32-bit in host byte order, since both ends run on the same machine.
+ *
+ * Request:  QueryRequestHeader, then patternLen bytes of pattern
+ * Response: QueryResponseHeader, then payloadLen bytes of payload
+ *
+ * A locate response carries positionCount uint32 positions; a stats
+ * response carries a human-readable text report.
+ */
+
+#ifndef QUERY_SERVER_H
+#define QUERY_SERVER_H
+
+#include <stdint.h>
+
+/** First word of every request ("DNAQ") */
+#define QUERY_MAGIC 0x51414e44u
+
+/** Request operations */
+#define QUERY_OP_COUNT  1  /**< Count the matches of a pattern */
+#define QUERY_OP_LOCATE 2  /**< Count and return the match positions */
+#define QUERY_OP_STATS  3  /**< Return the server statistics report */
+
+/** Response status codes */
+#define QUERY_OK            0  /**< Request served */
+#define QUERY_BAD_REQUEST   1  /**< Malformed request or unknown operation */
+#define QUERY_NO_REFERENCE  2  /**< Reference index out of range */
+#define QUERY_NO_MEMORY     3  /**< Server ran out of memory */
+
+/** Fixed part of every request */
+typedef struct {
+    uint32_t magic;       /**< QUERY_MAGIC */
+    uint8_t op;           /**< QUERY_OP_* */
+    uint8_t algorithm;    /**< DnaAlgorithm used for the search */
+    uint16_t reserved;    /**< Must be 0 */
+    uint32_t reference;   /**< Index of the reference, in server order */
+    uint32_t limit;       /**< Maximum positions returned by locate, 0 for all */
+    uint32_t patternLen;  /**< Number of pattern bytes that follow */
+} QueryRequestHeader;
+
+/** Fixed part of every response */
+typedef struct {
+    uint32_t status;         /**< QUERY_OK or an error code */
+    uint32_t matches;        /**< Number of matches found */
+    uint32_t positionCount;  /**< Positions in the payload (locate only) */
+    uint32_t payloadLen;     /**< Number of payload bytes that follow */
+} QueryResponseHeader;
+
+int runServer(const char* socketPath, char** references, const int* referenceLens,
+              int referenceCount, int threadCount);
+int runQueryClient(const char* socketPath, int op, int reference, int algorithm,
+                   const char* pattern);
+
+#endif
@@ -0,0 +1,423 @@
+/**
+ * @file restrictionSites.c
+ * @brief Restriction enzyme sites and reverse-complement palindromes (part of libdnamatch)
+ * @author George Fotiou
+ * @date 01/10/2025
+ *
+ * Most restriction enzymes recognise a reverse-complement palindrome: a
+ * site that reads the same on both strands, such as GAATTC for EcoRI.
+ * Palindromes are found in one pass over the text by growing the two arms
+ * around every point between two bases for as long as they are complementary.
+ *
+ * The sites of a built-in table of common enzymes are all searched together
+ * as one multi-pattern set. Degenerate sites written with IUPAC codes are
+ * expanded into every concrete site they stand for, and sites that are not
+ * palindromes are also searched for on the reverse strand.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "dnamatch.h"
+#include "dnamatchInternal.h"
+
+/** Built-in enzymes, by name; sites use IUPAC codes for degenerate bases */
+static const DnaEnzyme enzymeTable[] = {
+    {"AatII", "GACGTC"},
+    {"AluI", "AGCT"},
+    {"ApaI", "GGGCCC"},
+    {"AvaI", "CYCGRG"},
+    {"BamHI", "GGATCC"},
+    {"BglII", "AGATCT"},
+    {"BsaI", "GGTCTC"},
+    {"BsmBI", "CGTCTC"},
+    {"ClaI", "ATCGAT"},
+    {"EcoRI", "GAATTC"},
+    {"EcoRV", "GATATC"},
+    {"HaeIII", "GGCC"},
+    {"HhaI", "GCGC"},
+    {"HincII", "GTYRAC"},
+    {"HindIII", "AAGCTT"},
+    {"HinfI", "GANTC"},
+    {"HpaI", "GTTAAC"},
+    {"KpnI", "GGTACC"},
+    {"MboI", "GATC"},
+    {"MluI", "ACGCGT"},
+    {"MspI", "CCGG"},
+    {"NcoI", "CCATGG"},
+    {"NdeI", "CATATG"},
+    {"NheI", "GCTAGC"},
+    {"NotI", "GCGGCCGC"},
+    {"PstI", "CTGCAG"},
+    {"PvuII", "CAGCTG"},
+    {"SacI", "GAGCTC"},
+    {"SalI", "GTCGAC"},
+    {"SfiI", "GGCCNNNNNGGCC"},
+    {"SmaI", "CCCGGG"},
+    {"SpeI", "ACTAGT"},
+    {"SphI", "GCATGC"},
+    {"TaqI", "TCGA"},
+    {"XbaI", "TCTAGA"},
+    {"XhoI", "CTCGAG"}
+};
+
+/** Number of built-in enzymes */
+#define ENZYME_COUNT ((int)(sizeof(enzymeTable) / sizeof(enzymeTable[0])))
+
+/** Concrete sites collected for the pattern set */
+typedef struct {
+    char* bases;     /**< Every site back to back */
+    int* lengths;    /**< Length of every site */
+    int* enzymes;    /**< Index into the caller's enzyme list of every site */
+    int count;       /**< Number of sites */
+    int capacity;    /**< Allocated number of sites */
+    int baseBytes;   /**< Bytes used in bases */
+    int baseCapacity;  /**< Allocated size of bases */
+} SiteList;
+
+/** Hits being collected by the pattern-set callback */
+typedef struct {
+    const int* enzymes;  /**< Enzyme of every pattern */
+    DnaSiteHit* hits;    /**< Hits found so far */
+    int count;           /**< Number of hits */
+    int capacity;        /**< Allocated size of hits */
+    int failed;          /**< Set when growing the list failed */
+} SiteHits;
+
+/**
+ * @brief Gives the bases an IUPAC code stands for
+ * @param code IUPAC nucleotide code (upper case)
+ * @return The bases as a string, or NULL for an unknown code
+ */
+static const char* iupacBases(char code) {
+    switch (code) {
+        case 'A': return "A";
+        case 'C': return "C";
+        case 'G': return "G";
+        case 'T': return "T";
+        case 'R': return "AG";
+        case 'Y': return "CT";
+        case 'S': return "CG";
+        case 'W': return "AT";
+        case 'K': return "GT";
+        case 'M': return "AC";
+        case 'B': return "CGT";
+        case 'D': return "AGT";
+        case 'H': return "ACT";
+        case 'V': return "ACG";
+        case 'N': return "ACGT";
+        default: return NULL;
+    }
+}
+
+/**
+ * @brief Complements an IUPAC code
+ * @param code IUPAC nucleotide code (upper case)
+ * @return The code of the complementary bases
+ */
+static char iupacComplement(char code) {
+    switch (code) {
+        case 'A': return 'T';
+        case 'C': return 'G';
+        case 'G': return 'C';
+        case 'T': return 'A';
+        case 'R': return 'Y';
+        case 'Y': return 'R';
+        case 'K': return 'M';
+        case 'M': return 'K';
+        case 'B': return 'V';
+        case 'V': return 'B';
+        case 'D': return 'H';
+        case 'H': return 'D';
+        default: return code;  // S, W and N are their own complement
+    }
+}
+
+/**
+ * @brief Adds every concrete site an IUPAC site stands for
+ * @param list Sites being collected
+ * @param site IUPAC site
+ * @param length Length of the site
+ * @param enzyme Enzyme the sites belong to
+ * @return 0 on success, -1 on an unknown code or allocation failure
+ */
+static int expandSite(SiteList* list, const char* site, int length, int enzyme) {
+    const char* choices[64];
+    int variants = 1;
+    int v, i;
+
+    if (length > 64) {
+        return -1;
+    }
+    for (i = 0; i < length; i++) {
+        choices[i] = iupacBases(site[i]);
+        if (choices[i] == NULL) {
+            return -1;
+        }
+        variants *= (int)strlen(choices[i]);
+    }
+
+    // Count through the variants as a mixed-radix number, last base fastest
+    for (v = 0; v < variants; v++) {
+        if (list->count == list->capacity) {
+            int capacity = 2 * list->capacity;
+            int* lengths = (int*)trackedRealloc(list->lengths, list->capacity * sizeof(int), capacity * sizeof(int));
+            if (lengths == NULL) {
+                return -1;
+            }
+            list->lengths = lengths;
+            int* enzymes = (int*)trackedRealloc(list->enzymes, list->capacity * sizeof(int), capacity * sizeof(int));
+            if (enzymes == NULL) {
+                return -1;
+            }
+            list->enzymes = enzymes;
+            list->capacity = capacity;
+        }
+        if (list->baseBytes + length > list->baseCapacity) {
+            int capacity = 2 * list->baseCapacity + length;
+            char* bases = (char*)trackedRealloc(list->bases, list->baseCapacity, capacity);
+            if (bases == NULL) {
+                return -1;
+            }
+            list->bases = bases;
+            list->baseCapacity = capacity;
+        }
+
+        int rest = v;
+        for (i = length - 1; i >= 0; i--) {
+            int radix = (int)strlen(choices[i]);
+            list->bases[list->baseBytes + i] = choices[i][rest % radix];
+            rest /= radix;
+        }
+        list->lengths[list->count] = length;
+        list->enzymes[list->count] = enzyme;
+        list->count++;
+        list->baseBytes += length;
+    }
+    return 0;
+}
+
+/**
+ * @brief Pattern-set callback recording one site hit
+ * @param pattern Index of the concrete site
+ * @param position Text position of the hit
+ * @param userData The SiteHits
+ * @return 0 to continue, 1 to stop after an allocation failure
+ */
+static int collectSite(int pattern, int position, void* userData) {
+    SiteHits* found = (SiteHits*)userData;
+
+    if (found->count == found->capacity) {
+        DnaSiteHit* grown = (DnaSiteHit*)trackedRealloc(found->hits, found->capacity * sizeof(DnaSiteHit),
+                                                        2 * found->capacity * sizeof(DnaSiteHit));
+        if (grown == NULL) {
+            found->failed = 1;
+            return 1;
+        }
+        found->hits = grown;
+        found->capacity *= 2;
+    }
+    found->hits[found->count].enzyme = found->enzymes[pattern];
+    found->hits[found->count].position = position;
+    found->count++;
+    return 0;
+}
+
+/**
+ * @brief Orders site hits by enzyme, then by position
+ * @param a First DnaSiteHit
+ * @param b Second DnaSiteHit
+ * @return Negative, zero or positive as for qsort()
+ */
+static int compareSiteHits(const void* a, const void* b) {
+    const DnaSiteHit* x = (const DnaSiteHit*)a;
+    const DnaSiteHit* y = (const DnaSiteHit*)b;
+    if (x->enzyme != y->enzyme) {
+        return x->enzyme < y->enzyme ? -1 : 1;
+    }
+    return (x->position > y->position) - (x->position < y->position);
+}
+
+/**
+ * @brief Gives the built-in table of restriction enzymes
+ * @param enzymeCount Receives the number of enzymes
+ * @return The table, ordered by name
+ */
+const DnaEnzyme* dnaEnzymeTable(int* enzymeCount) {
+    *enzymeCount = ENZYME_COUNT;
+    return enzymeTable;
+}
+
+/**
+ * @brief Looks up an enzyme of the built-in table by name, ignoring case
+ * @param name Enzyme name, e.g. "EcoRI"
+ * @return Its index in dnaEnzymeTable(), or -1 if unknown
+ */
+int dnaFindEnzyme(const char* name) {
+    int e;
+    for (e = 0; e < ENZYME_COUNT; e++) {
+        if (strcasecmp(enzymeTable[e].name, name) == 0) {
+            return e;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Finds the recognition sites of several enzymes in one multi-pattern search
+ *
+ * A site is reported at its leftmost base, whichever strand it is on, and
+ * only once per enzyme and position.
+ *
+ * @param text Text to search in
+ * @param textLen Length of the text
+ * @param enzymes Indices into dnaEnzymeTable() of the enzymes to look for
+ * @param enzymeCount Number of enzymes
+ * @param hitCount Receives the number of hits
+ * @return Hits ordered by their place in enzymes, then by position (free()),
+ *         or NULL on error
+ */
+DnaSiteHit* dnaEnzymeSites(const char* text, int textLen, const int* enzymes, int enzymeCount,
+                           int* hitCount) {
+    SiteList list;
+    SiteHits found;
+    int e, i;
+
+    memset(&list, 0, sizeof(list));
+    memset(&found, 0, sizeof(found));
+    list.capacity = 64;
+    list.baseCapacity = 256;
+    list.bases = (char*)trackedMalloc(list.baseCapacity);
+    list.lengths = (int*)trackedMalloc(list.capacity * sizeof(int));
+    list.enzymes = (int*)trackedMalloc(list.capacity * sizeof(int));
+    found.capacity = 64;
+    found.hits = (DnaSiteHit*)trackedMalloc(found.capacity * sizeof(DnaSiteHit));
+    int failed = list.bases == NULL || list.lengths == NULL || list.enzymes == NULL || found.hits == NULL;
+
+    for (e = 0; e < enzymeCount && !failed; e++) {
+        if (enzymes[e] < 0 || enzymes[e] >= ENZYME_COUNT) {
+            failed = 1;
+            break;
+        }
+        const char* site = enzymeTable[enzymes[e]].site;
+        int length = (int)strlen(site);
+        char reverse[64];
+        if (length > 64 || expandSite(&list, site, length, e) != 0) {
+            failed = 1;
+            break;
+        }
+
+        // The other strand only matters when the site is not its own reverse complement
+        for (i = 0; i < length; i++) {
+            reverse[i] = iupacComplement(site[length - 1 - i]);
+        }
+        if (memcmp(reverse, site, length) != 0 && expandSite(&list, reverse, length, e) != 0) {
+            failed = 1;
+        }
+    }
+
+    const char** patterns = NULL;
+    DnaPatternSet* set = NULL;
+    if (!failed) {
+        patterns = (const char**)trackedMalloc((list.count > 0 ? list.count : 1) * sizeof(char*));
+        failed = patterns == NULL;
+    }
+    if (!failed) {
+        int offset = 0;
+        for (i = 0; i < list.count; i++) {
+            patterns[i] = list.bases + offset;
+            offset += list.lengths[i];
+        }
+        set = dnaPatternSetCreate(patterns, list.lengths, list.count);
+        failed = set == NULL;
+    }
+    if (!failed) {
+        found.enzymes = list.enzymes;
+        dnaPatternSetSearch(set, text, textLen, collectSite, &found);
+        failed = found.failed;
+    }
+
+    dnaPatternSetFree(set);
+    free(patterns);
+    free(list.bases);
+    free(list.lengths);
+    free(list.enzymes);
+    if (failed) {
+        free(found.hits);
+        return NULL;
+    }
+
+    // Both strands of a degenerate site can match at the same place
+    qsort(found.hits, found.count, sizeof(DnaSiteHit), compareSiteHits);
+    int kept = 0;
+    for (i = 0; i < found.count; i++) {
+        if (kept == 0 || compareSiteHits(&found.hits[kept - 1], &found.hits[i]) != 0) {
+            found.hits[kept++] = found.hits[i];
+        }
+    }
+    *hitCount = kept;
+    return found.hits;
+}
+
+/**
+ * @brief Finds the reverse-complement palindromes of a text in one pass
+ *
+ * Around every point between two bases the arms are grown while the bases
+ * on either side are complementary, up to maxLength bases in all. The
+ * palindrome is reported if it reaches minLength, so every center gives at
+ * most one palindrome, the longest one (or its central maxLength bases).
+ * Such palindromes always have an even length.
+ *
+ * @param text Text to scan
+ * @param textLen Length of the text
+ * @param minLength Shortest palindrome reported
+ * @param maxLength Longest palindrome reported
+ * @param palindromeCount Receives the number of palindromes
+ * @return Palindromes ordered by center (free()), or NULL on error
+ */
+DnaPalindrome* dnaPalindromes(const char* text, int textLen, int minLength, int maxLength,
+                              int* palindromeCount) {
+    int capacity = 64;
+    int used = 0;
+    int center;
+
+    if (minLength < 2) {
+        minLength = 2;
+    }
+    DnaPalindrome* palindromes = (DnaPalindrome*)trackedMalloc(capacity * sizeof(DnaPalindrome));
+    if (palindromes == NULL) {
+        return NULL;
+    }
+
+    for (center = 1; center < textLen; center++) {
+        int arm = 0;
+        while (2 * (arm + 1) <= maxLength && arm < center && center + arm < textLen) {
+            int left = encodeBase(text[center - 1 - arm]);
+            if (left < 0 || encodeBase(text[center + arm]) != 3 - left) {
+                break;
+            }
+            arm++;
+        }
+        if (2 * arm < minLength) {
+            continue;
+        }
+
+        if (used == capacity) {
+            DnaPalindrome* grown = (DnaPalindrome*)trackedRealloc(palindromes, capacity * sizeof(DnaPalindrome),
+                                                                  2 * capacity * sizeof(DnaPalindrome));
+            if (grown == NULL) {
+                free(palindromes);
+                return NULL;
+            }
+            palindromes = grown;
+            capacity *= 2;
+        }
+        palindromes[used].start = center - arm;
+        palindromes[used].length = 2 * arm;
+        used++;
+    }
+
+    *palindromeCount = used;
+    return palindromes;
+}
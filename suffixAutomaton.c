@@ -0,0 +1,392 @@
+/**
+ * @file suffixAutomaton.c
+ * @brief Suffix automaton (DAWG) of a sequence with occurrence counts (part of libdnamatch)
+ * @author George Fotiou
+ * @date 01/10/2025
+ *
+ * The suffix automaton is the smallest automaton accepting every substring
+ * of the text; it has at most 2n states and is built online in linear time.
+ * Every state stands for a set of substrings that end at the same set of
+ * text positions (their endpos), so storing the size of that set once per
+ * state answers "how often does this substring occur" by walking the pattern
+ * from the root, in O(m) whatever the size of the text.
+ *
+ * States are one array of small structs with a transition for each of the
+ * four bases. A non-ACGT base in the text ends a segment: the automaton is
+ * then built over the ACGT runs, as a generalized automaton, so no
+ * substring crosses it.
+ *
+ * Walking a second sequence through the automaton gives, for each of its
+ * positions, the longest substring ending there that also occurs in the
+ * text (its matching statistics), from which the maximal matches between
+ * the two sequences follow.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "dnamatch.h"
+#include "dnamatchInternal.h"
+
+/** Query positions per chunk of dnaMaximalMatches() */
+#define SAM_MATCH_CHUNK 65536
+
+/** One state of the automaton */
+typedef struct {
+    int next[4];  /**< Transition on A, C, G, T; 0 (the root, never a target) for none */
+    int link;     /**< Suffix link, -1 for the root */
+    int len;      /**< Length of the longest substring of the state */
+    int count;    /**< Size of its endpos set: occurrences of each of its substrings */
+    int firstEnd; /**< Smallest position of its endpos set: where the first occurrence ends */
+} SamState;
+
+/** Compiled suffix automaton, immutable after dnaSuffixAutomatonBuild() */
+struct DnaSuffixAutomaton {
+    SamState* states;  /**< States; 0 is the root */
+    int stateCount;    /**< Number of states */
+};
+
+/**
+ * @brief Appends one base to the automaton (generalized online construction)
+ * @param states State array with room for two more states
+ * @param stateCount Number of states, updated
+ * @param last State of the whole segment read so far
+ * @param code Base, 0-3
+ * @param position Text position of the base
+ * @return State of the segment extended by the base
+ */
+static int extendAutomaton(SamState* states, int* stateCount, int last, int code, int position) {
+    int p;
+    int q = states[last].next[code];
+
+    // The extended segment is already a substring: reuse or split its state
+    if (q != 0) {
+        if (states[last].len + 1 == states[q].len) {
+            return q;
+        }
+        int clone = (*stateCount)++;
+        states[clone] = states[q];
+        states[clone].len = states[last].len + 1;
+        states[clone].count = 0;
+        for (p = last; p != -1 && states[p].next[code] == q; p = states[p].link) {
+            states[p].next[code] = clone;
+        }
+        states[q].link = clone;
+        return clone;
+    }
+
+    int current = (*stateCount)++;
+    memset(&states[current], 0, sizeof(SamState));
+    states[current].len = states[last].len + 1;
+    states[current].firstEnd = position;
+    for (p = last; p != -1 && states[p].next[code] == 0; p = states[p].link) {
+        states[p].next[code] = current;
+    }
+    if (p == -1) {
+        states[current].link = 0;
+        return current;
+    }
+
+    q = states[p].next[code];
+    if (states[p].len + 1 == states[q].len) {
+        states[current].link = q;
+        return current;
+    }
+
+    int clone = (*stateCount)++;
+    states[clone] = states[q];
+    states[clone].len = states[p].len + 1;
+    states[clone].count = 0;
+    for (; p != -1 && states[p].next[code] == q; p = states[p].link) {
+        states[p].next[code] = clone;
+    }
+    states[q].link = clone;
+    states[current].link = clone;
+    return current;
+}
+
+/**
+ * @brief Builds the suffix automaton of a sequence
+ * @param text Sequence
+ * @param textLen Length of the sequence
+ * @return New automaton to release with dnaSuffixAutomatonFree(), or NULL on error
+ */
+DnaSuffixAutomaton* dnaSuffixAutomatonBuild(const char* text, int textLen) {
+    int capacity = 2 * (textLen > 0 ? textLen : 0) + 2;
+    DnaSuffixAutomaton* automaton = (DnaSuffixAutomaton*)trackedCalloc(1, sizeof(DnaSuffixAutomaton));
+    SamState* states = (SamState*)trackedMalloc(capacity * sizeof(SamState));
+    int last = 0;
+    int i;
+
+    if (automaton == NULL || states == NULL) {
+        free(automaton);
+        free(states);
+        return NULL;
+    }
+
+    memset(&states[0], 0, sizeof(SamState));
+    states[0].link = -1;
+    automaton->stateCount = 1;
+    for (i = 0; i < textLen; i++) {
+        int code = encodeBase(text[i]);
+        if (code < 0) {
+            last = 0;
+            continue;
+        }
+        last = extendAutomaton(states, &automaton->stateCount, last, code, i);
+        // Every position ends the segment read so far, which lives in last
+        states[last].count++;
+    }
+
+    // A substring occurs wherever any longer substring with it as suffix does:
+    // add every state's count into its suffix link, longest states first
+    int* byLength = (int*)trackedCalloc(textLen + 2, sizeof(int));
+    int* order = (int*)trackedMalloc(automaton->stateCount * sizeof(int));
+    if (byLength == NULL || order == NULL) {
+        free(byLength);
+        free(order);
+        free(states);
+        free(automaton);
+        return NULL;
+    }
+    for (i = 0; i < automaton->stateCount; i++) {
+        byLength[states[i].len + 1]++;
+    }
+    for (i = 1; i <= textLen + 1; i++) {
+        byLength[i] += byLength[i - 1];
+    }
+    for (i = 0; i < automaton->stateCount; i++) {
+        order[byLength[states[i].len]++] = i;
+    }
+    for (i = automaton->stateCount - 1; i > 0; i--) {
+        states[states[order[i]].link].count += states[order[i]].count;
+    }
+    free(byLength);
+    free(order);
+
+    // Give back the room reserved for states that were never needed
+    automaton->states = (SamState*)trackedRealloc(states, capacity * sizeof(SamState),
+                                                  automaton->stateCount * sizeof(SamState));
+    if (automaton->states == NULL) {
+        automaton->states = states;
+    }
+    return automaton;
+}
+
+/**
+ * @brief Releases a suffix automaton
+ * @param automaton Automaton returned by dnaSuffixAutomatonBuild(), or NULL
+ */
+void dnaSuffixAutomatonFree(DnaSuffixAutomaton* automaton) {
+    if (automaton == NULL) {
+        return;
+    }
+    free(automaton->states);
+    free(automaton);
+}
+
+/**
+ * @brief Reports the number of states of an automaton
+ * @param automaton Suffix automaton
+ * @return Number of states, at most 2n
+ */
+int dnaSuffixAutomatonStates(const DnaSuffixAutomaton* automaton) {
+    return automaton->stateCount;
+}
+
+/**
+ * @brief Reports the memory held by an automaton
+ * @param automaton Suffix automaton
+ * @return Bytes of its states
+ */
+size_t dnaSuffixAutomatonBytes(const DnaSuffixAutomaton* automaton) {
+    return sizeof(DnaSuffixAutomaton) + (size_t)automaton->stateCount * sizeof(SamState);
+}
+
+/**
+ * @brief Counts the occurrences of a substring, overlapping ones included
+ * @param automaton Suffix automaton of the text
+ * @param pattern Substring to count
+ * @param patternLen Length of the substring, at least 1
+ * @return Number of occurrences, 0 if it does not occur or holds a non-ACGT base
+ */
+int dnaSuffixAutomatonCount(const DnaSuffixAutomaton* automaton, const char* pattern, int patternLen) {
+    int state = 0;
+    int i;
+
+    if (patternLen <= 0) {
+        return 0;
+    }
+    for (i = 0; i < patternLen; i++) {
+        int code = encodeBase(pattern[i]);
+        if (code < 0 || (state = automaton->states[state].next[code]) == 0) {
+            return 0;
+        }
+    }
+    return automaton->states[state].count;
+}
+
+/** One step of the matching statistics of a query: its longest suffix found in the text */
+typedef struct {
+    int length;  /**< Length of the longest suffix of the query prefix that occurs in the text */
+    int state;   /**< State of that suffix */
+} MatchStep;
+
+/** State shared by the threads of dnaMaximalMatches() */
+typedef struct {
+    const DnaSuffixAutomaton* automaton;  /**< Automaton of the text */
+    const char* query;     /**< Query */
+    int queryLen;          /**< Length of the query */
+    int chunkSize;         /**< Query positions per chunk */
+    int chunkCount;        /**< Number of chunks */
+    MatchStep* steps;      /**< Matching statistics of every query position */
+    atomic_int nextChunk;  /**< Next chunk to claim */
+} MatchWork;
+
+/**
+ * @brief Advances the matching statistics by one query base
+ * @param states States of the automaton
+ * @param step Statistics of the previous position, updated in place
+ * @param base Next query base
+ */
+static inline void advanceMatch(const SamState* states, MatchStep* step, char base) {
+    int code = encodeBase(base);
+
+    if (code < 0) {
+        step->state = 0;
+        step->length = 0;
+        return;
+    }
+    // Shorten the match along suffix links until it can take the base
+    while (step->state != 0 && states[step->state].next[code] == 0) {
+        step->state = states[step->state].link;
+        step->length = states[step->state].len;
+    }
+    if (states[step->state].next[code] != 0) {
+        step->state = states[step->state].next[code];
+        step->length++;
+    } else {
+        step->length = 0;
+    }
+}
+
+/**
+ * @brief Matching statistics worker: claims query chunks and scans each from the root
+ *
+ * Restarting at the chunk start only shortens matches that reach back over
+ * it; dnaMaximalMatches() repairs those afterwards.
+ *
+ * @param arg The shared MatchWork
+ * @return NULL
+ */
+static void* matchWorker(void* arg) {
+    MatchWork* work = (MatchWork*)arg;
+    const SamState* states = work->automaton->states;
+    int chunk;
+
+    while ((chunk = atomic_fetch_add(&work->nextChunk, 1)) < work->chunkCount) {
+        int from = chunk * work->chunkSize;
+        int to = from + work->chunkSize < work->queryLen ? from + work->chunkSize : work->queryLen;
+        MatchStep step = {0, 0};
+        int i;
+        for (i = from; i < to; i++) {
+            advanceMatch(states, &step, work->query[i]);
+            work->steps[i] = step;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Finds the maximal matches between a query and the text of an automaton
+ *
+ * For every query position the longest match ending there is found by
+ * walking the automaton (matching statistics); it is reported when the
+ * match cannot be extended to the next position either. Such a match can
+ * be extended in neither direction at any of its text occurrences, so every
+ * occurrence is a maximal exact match; the first one and the number of
+ * occurrences are reported. Shorter matches ending at the same query
+ * position are not reported, even where some of their occurrences are
+ * maximal exact matches too. The query is scanned in chunks by threadCount
+ * threads; a match reaching back over a chunk start is then rescanned from
+ * the end of the previous chunk until it agrees with the chunk's own scan.
+ *
+ * @param automaton Automaton of the text
+ * @param query Query
+ * @param queryLen Length of the query
+ * @param minLength Shortest match reported, at least 1
+ * @param threadCount Number of threads to use
+ * @param matchCount Receives the number of matches
+ * @return Matches in query order (free()), or NULL on error
+ */
+DnaMaximalMatch* dnaMaximalMatches(const DnaSuffixAutomaton* automaton, const char* query, int queryLen,
+                                   int minLength, int threadCount, int* matchCount) {
+    MatchWork work;
+    int used = 0;
+    int capacity = 16;
+    int c, i;
+
+    work.automaton = automaton;
+    work.query = query;
+    work.queryLen = queryLen > 0 ? queryLen : 0;
+    work.chunkSize = SAM_MATCH_CHUNK;
+    work.chunkCount = (work.queryLen + SAM_MATCH_CHUNK - 1) / SAM_MATCH_CHUNK;
+    work.steps = (MatchStep*)trackedMalloc((work.queryLen > 0 ? work.queryLen : 1) * sizeof(MatchStep));
+    DnaMaximalMatch* matches = (DnaMaximalMatch*)trackedMalloc(capacity * sizeof(DnaMaximalMatch));
+    if (work.steps == NULL || matches == NULL) {
+        free(work.steps);
+        free(matches);
+        return NULL;
+    }
+    atomic_init(&work.nextChunk, 0);
+
+    if (threadCount > work.chunkCount) {
+        threadCount = work.chunkCount;
+    }
+    if (threadCount > 0) {
+        runWorkers(threadCount, matchWorker, &work);
+    }
+
+    // Carry the true statistics over every chunk start until they agree again
+    for (c = 1; c < work.chunkCount; c++) {
+        int from = c * work.chunkSize;
+        MatchStep step = work.steps[from - 1];
+        for (i = from; i < work.queryLen; i++) {
+            advanceMatch(automaton->states, &step, query[i]);
+            if (step.length == work.steps[i].length) {
+                break;
+            }
+            work.steps[i] = step;
+        }
+    }
+
+    // A match is maximal where the next position does not extend it
+    for (i = 0; i < work.queryLen; i++) {
+        int length = work.steps[i].length;
+        if (length < minLength || (i + 1 < work.queryLen && work.steps[i + 1].length == length + 1)) {
+            continue;
+        }
+        if (used == capacity) {
+            DnaMaximalMatch* grown = (DnaMaximalMatch*)trackedRealloc(matches, capacity * sizeof(DnaMaximalMatch),
+                                                                      2 * capacity * sizeof(DnaMaximalMatch));
+            if (grown == NULL) {
+                free(work.steps);
+                free(matches);
+                return NULL;
+            }
+            matches = grown;
+            capacity *= 2;
+        }
+        const SamState* state = &automaton->states[work.steps[i].state];
+        matches[used].queryStart = i - length + 1;
+        matches[used].textStart = state->firstEnd - length + 1;
+        matches[used].length = length;
+        matches[used].count = state->count;
+        used++;
+    }
+
+    free(work.steps);
+    *matchCount = used;
+    return matches;
+}
@@ -0,0 +1,220 @@
+/**
+ * @file tandemRepeat.c
+ * @brief Tandem repeat (micro- and minisatellite) scanner (part of libdnamatch)
+ * @author George Fotiou
+ * @date 01/10/2025
+ *
+ * A stretch of text is a tandem repeat of period p when every base in it
+ * equals the base p positions further on. So for each period the text is
+ * compared with itself shifted by p, and every run of agreeing positions of
+ * at least p bases (two full copies of the unit) marks a repeat.
+ *
+ * The text is read once, in blocks small enough to stay in cache, each
+ * block being compared at every period before moving on. With SSE2 sixteen
+ * positions are compared at a time and only the positions where a run
+ * breaks are looked at one by one, so the long runs inside a repeat cost a
+ * single compare per sixteen bases. A repeat also has every multiple of its
+ * period, so only the smallest period describing a stretch is reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "dnamatch.h"
+#include "dnamatchInternal.h"
+
+/** Text positions compared at every period before moving on */
+#define REPEAT_BLOCK 4096
+
+/** Growable list of repeats being collected */
+typedef struct {
+    DnaTandemRepeat* repeats;  /**< Repeats found so far */
+    int count;                 /**< Number of repeats */
+    int capacity;              /**< Allocated size of repeats */
+    int failed;                /**< Set when growing the list failed */
+} RepeatList;
+
+/**
+ * @brief Ends the run of agreeing positions of one period and records it if long enough
+ * @param list Repeats being collected
+ * @param runStart First position of the run; set past the break
+ * @param position Position where the run breaks
+ * @param period Period being scanned
+ * @param minLength Shortest repeat recorded
+ */
+static void closeRun(RepeatList* list, int* runStart, int position, int period, int minLength) {
+    int run = position - *runStart;
+
+    // The run covers the bases up to position + period; it needs two whole copies
+    if (run >= period && run + period >= minLength && !list->failed) {
+        if (list->count == list->capacity) {
+            DnaTandemRepeat* grown = (DnaTandemRepeat*)trackedRealloc(list->repeats,
+                                                                      list->capacity * sizeof(DnaTandemRepeat),
+                                                                      2 * list->capacity * sizeof(DnaTandemRepeat));
+            if (grown == NULL) {
+                list->failed = 1;
+                *runStart = position + 1;
+                return;
+            }
+            list->repeats = grown;
+            list->capacity *= 2;
+        }
+        list->repeats[list->count].start = *runStart;
+        list->repeats[list->count].end = position + period;
+        list->repeats[list->count].period = period;
+        list->count++;
+    }
+    *runStart = position + 1;
+}
+
+/**
+ * @brief Compares a range of positions with the positions one period further on
+ * @param text Text being scanned
+ * @param from First position compared
+ * @param to One past the last position compared; to + period must not exceed the text length
+ * @param period Period being scanned
+ * @param runStart First position of the current run of this period
+ * @param minLength Shortest repeat recorded
+ * @param list Repeats being collected
+ */
+static void scanPeriod(const char* text, int from, int to, int period, int* runStart, int minLength,
+                       RepeatList* list) {
+    int i = from;
+
+#ifdef __SSE2__
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i a = _mm_set1_epi8('a');
+    const __m128i c = _mm_set1_epi8('c');
+    const __m128i g = _mm_set1_epi8('g');
+    const __m128i t = _mm_set1_epi8('t');
+
+    for (; i + 16 <= to; i += 16) {
+        __m128i here = _mm_loadu_si128((const __m128i*)(text + i));
+        __m128i ahead = _mm_loadu_si128((const __m128i*)(text + i + period));
+        __m128i folded = _mm_or_si128(here, lower);
+        __m128i valid = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(folded, a), _mm_cmpeq_epi8(folded, c)),
+                                     _mm_or_si128(_mm_cmpeq_epi8(folded, g), _mm_cmpeq_epi8(folded, t)));
+        int breaks = ~_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(here, ahead), valid)) & 0xFFFF;
+
+        // Inside a repeat no bit is set and the sixteen positions are done
+        while (breaks != 0) {
+            closeRun(list, runStart, i + __builtin_ctz(breaks), period, minLength);
+            breaks &= breaks - 1;
+        }
+    }
+#endif
+
+    for (; i < to; i++) {
+        if (text[i] != text[i + period] || encodeBase(text[i]) < 0) {
+            closeRun(list, runStart, i, period, minLength);
+        }
+    }
+}
+
+/**
+ * @brief Orders repeats by start, then longest first, then by period
+ * @param a First DnaTandemRepeat
+ * @param b Second DnaTandemRepeat
+ * @return Negative, zero or positive as for qsort()
+ */
+static int compareRepeats(const void* a, const void* b) {
+    const DnaTandemRepeat* x = (const DnaTandemRepeat*)a;
+    const DnaTandemRepeat* y = (const DnaTandemRepeat*)b;
+    if (x->start != y->start) {
+        return x->start < y->start ? -1 : 1;
+    }
+    if (x->end != y->end) {
+        return x->end > y->end ? -1 : 1;
+    }
+    return (x->period > y->period) - (x->period < y->period);
+}
+
+/**
+ * @brief Finds the perfect tandem repeats of a text
+ *
+ * Every stretch of at least minLength bases made of two or more copies of
+ * a unit of up to maxPeriod bases is reported with the smallest such unit;
+ * a stretch lying inside a repeat of a smaller period is left out, since
+ * it has that period as well. The last copy may be partial. Only ACGT
+ * bases (either case) take part in a repeat.
+ *
+ * @param text Text to scan
+ * @param textLen Length of the text
+ * @param maxPeriod Longest unit looked for, at least 1
+ * @param minLength Shortest repeat reported
+ * @param repeatCount Receives the number of repeats
+ * @return Repeats ordered by start (free()), or NULL on error
+ */
+DnaTandemRepeat* dnaTandemRepeats(const char* text, int textLen, int maxPeriod, int minLength,
+                                  int* repeatCount) {
+    RepeatList list;
+    int block, period, i;
+
+    if (maxPeriod < 1) {
+        return NULL;
+    }
+    if (textLen < 0) {
+        textLen = 0;
+    }
+
+    list.count = 0;
+    list.capacity = 16;
+    list.failed = 0;
+    list.repeats = (DnaTandemRepeat*)trackedMalloc(list.capacity * sizeof(DnaTandemRepeat));
+    int* runStarts = (int*)trackedCalloc(maxPeriod + 1, sizeof(int));
+    if (list.repeats == NULL || runStarts == NULL) {
+        free(list.repeats);
+        free(runStarts);
+        return NULL;
+    }
+
+    // One pass over the text, every period compared within each block
+    for (block = 0; block < textLen; block += REPEAT_BLOCK) {
+        for (period = 1; period <= maxPeriod && period < textLen; period++) {
+            int end = textLen - period;
+            if (end > block + REPEAT_BLOCK) {
+                end = block + REPEAT_BLOCK;
+            }
+            if (block < end) {
+                scanPeriod(text, block, end, period, &runStarts[period], minLength, &list);
+            }
+        }
+    }
+    for (period = 1; period <= maxPeriod && period < textLen; period++) {
+        closeRun(&list, &runStarts[period], textLen - period, period, minLength);
+    }
+    if (list.failed) {
+        free(list.repeats);
+        free(runStarts);
+        return NULL;
+    }
+
+    // Drop repeats lying inside one of a smaller period; runStarts now holds
+    // the furthest end kept so far for each period
+    qsort(list.repeats, list.count, sizeof(DnaTandemRepeat), compareRepeats);
+    memset(runStarts, 0, (maxPeriod + 1) * sizeof(int));
+    int kept = 0;
+    for (i = 0; i < list.count; i++) {
+        DnaTandemRepeat repeat = list.repeats[i];
+        int covered = 0;
+        for (period = 1; period < repeat.period; period++) {
+            if (runStarts[period] >= repeat.end) {
+                covered = 1;
+                break;
+            }
+        }
+        if (!covered) {
+            if (runStarts[repeat.period] < repeat.end) {
+                runStarts[repeat.period] = repeat.end;
+            }
+            list.repeats[kept++] = repeat;
+        }
+    }
+
+    free(runStarts);
+    *repeatCount = kept;
+    return list.repeats;
+}